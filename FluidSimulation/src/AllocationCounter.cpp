@@ -0,0 +1,103 @@
+#include "AllocationCounter.h"
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+
+#if defined(_DEBUG) || defined(FLUID_COUNT_ALLOCATIONS)
+#define ALLOCATION_COUNTER_ENABLED 1
+#endif
+
+namespace {
+    std::atomic<unsigned long long> allocations{ 0 };
+    unsigned long long frameStart = 0;
+    unsigned long long lastReported = 0;
+
+#ifdef ALLOCATION_COUNTER_ENABLED
+    void* Allocate(std::size_t size) {
+        allocations.fetch_add(1, std::memory_order_relaxed);
+        return std::malloc(size ? size : 1);
+    }
+
+    void* AllocateAligned(std::size_t size, std::align_val_t alignment) {
+        allocations.fetch_add(1, std::memory_order_relaxed);
+        std::size_t align = static_cast<std::size_t>(alignment);
+        if (align < sizeof(void*)) align = sizeof(void*);
+#if defined(_MSC_VER)
+        return _aligned_malloc(size ? size : 1, align);
+#else
+        void* p = nullptr;
+        return posix_memalign(&p, align, size ? size : 1) == 0 ? p : nullptr;
+#endif
+    }
+
+    void FreeAligned(void* p) {
+#if defined(_MSC_VER)
+        _aligned_free(p);
+#else
+        std::free(p);
+#endif
+    }
+#endif
+}
+
+#ifdef ALLOCATION_COUNTER_ENABLED
+void* operator new(std::size_t size) {
+    if (void* p = Allocate(size)) return p;
+    throw std::bad_alloc();
+}
+void* operator new[](std::size_t size) {
+    if (void* p = Allocate(size)) return p;
+    throw std::bad_alloc();
+}
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept { return Allocate(size); }
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept { return Allocate(size); }
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    if (void* p = AllocateAligned(size, alignment)) return p;
+    throw std::bad_alloc();
+}
+void* operator new[](std::size_t size, std::align_val_t alignment) {
+    if (void* p = AllocateAligned(size, alignment)) return p;
+    throw std::bad_alloc();
+}
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept { return AllocateAligned(size, alignment); }
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept { return AllocateAligned(size, alignment); }
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { FreeAligned(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { FreeAligned(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { FreeAligned(p); }
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept { FreeAligned(p); }
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept { FreeAligned(p); }
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept { FreeAligned(p); }
+#endif
+
+bool AllocationCounter::IsEnabled() {
+#ifdef ALLOCATION_COUNTER_ENABLED
+    return true;
+#else
+    return false;
+#endif
+}
+
+unsigned long long AllocationCounter::Count() {
+    return allocations.load(std::memory_order_relaxed);
+}
+
+void AllocationCounter::BeginFrame() {
+    frameStart = Count();
+}
+
+unsigned long long AllocationCounter::EndFrame(bool steady) {
+    unsigned long long frameAllocations = Count() - frameStart;
+    if (steady && frameAllocations > 0 && frameAllocations != lastReported) {
+        std::cerr << "WARNING: " << frameAllocations << " heap allocations in a steady-state frame" << std::endl;
+        lastReported = frameAllocations;
+    }
+    return frameAllocations;
+}
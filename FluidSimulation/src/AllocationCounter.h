@@ -0,0 +1,17 @@
+#pragma once
+
+// Counts calls to the global operator new, on every thread, to catch heap allocations in
+// steady-state frames. Counting replaces the global new and delete in AllocationCounter.cpp, so
+// it is compiled in only for Debug builds (_DEBUG) or with FLUID_COUNT_ALLOCATIONS defined;
+// elsewhere the counter reads zero. C allocations (malloc, which ImGui and GLFW use) are not seen.
+namespace AllocationCounter {
+    bool IsEnabled();
+    // Allocations since the program started
+    unsigned long long Count();
+
+    // Frame bookkeeping for the main loop: EndFrame returns the allocations since BeginFrame and,
+    // when the frame was steady (nothing changed that may legitimately allocate), reports a
+    // nonzero count on stderr, at most once per distinct count.
+    void BeginFrame();
+    unsigned long long EndFrame(bool steady);
+}
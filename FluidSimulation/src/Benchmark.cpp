@@ -0,0 +1,775 @@
+#include "Benchmark.h"
+#include "Kernels.h"
+#include "CpuSolver.h"
+#include "OutOfCoreSolver.h"
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <cmath>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <thread>
+
+namespace {
+    const float SIMULATED_SECONDS = 1.5f;
+    const float SPEED_LIMIT = 25.0f;  // anything faster than this in a 2x2 tank has exploded
+    const float BOUNDARY_LIMIT = 1.0f;
+    // Where the stable-dt scan stops. The solvers with position clamps (PBF) can stay bounded well
+    // past the explicit ones, so the scan has to reach that far.
+    const float MAX_STABLE_TIMESTEP = 0.25f;
+    // A stable-dt run takes SIMULATED_SECONDS or this many steps, whichever is more, so that a
+    // large dt cannot pass on a handful of steps
+    const int MIN_STABLE_STEPS = 200;
+    // Largest compression (density over that of the initial lattice, minus one) a stable PBF or
+    // DFSPH run may reach. PBF's correction cap keeps a too-large dt bounded, not incompressible.
+    const float MAX_COMPRESSION = 0.03f;
+
+    const Scene SCENES[] = { Scene::Block, Scene::DamBreak, Scene::Drop };
+    const char* SceneName(Scene scene) {
+        switch (scene) {
+        case Scene::Block: return "block";
+        case Scene::DamBreak: return "dam break";
+        case Scene::Drop: return "drop";
+        }
+        return "?";
+    }
+
+    // Largest compression of any particle against the density of the scene's initial lattice,
+    // both summed with poly6 on the host (blocking readback, O(n^2)).
+    float MaxCompression(const Simulation& sim) {
+        unsigned int count = sim.GetParticleCount();
+        std::vector<glm::vec2> positions, velocities;
+        sim.ReadParticles(positions, velocities);
+
+        float h2 = sim.smoothingRadius * sim.smoothingRadius;
+        float poly6 = sim.particleMass * Kernels::Scale(Kernels::Poly6, sim.smoothingRadius);
+        float maxDensity = 0.0f;
+        for (unsigned int i = 0; i < count; ++i) {
+            float density = 0.0f;
+            for (unsigned int j = 0; j < count; ++j) {
+                glm::vec2 d = positions[i] - positions[j];
+                float distSq = glm::dot(d, d);
+                if (distSq >= h2) continue;
+                float term = h2 - distSq;
+                density += poly6 * term * term;
+            }
+            maxDensity = std::max(maxDensity, density);
+        }
+        return maxDensity / sim.ComputeLatticeRestDensity(false) - 1.0f;
+    }
+
+    // A run is stable if no particle hit the NaN guard, nothing reached SPEED_LIMIT and, for the
+    // incompressible solvers, no particle was compressed past MAX_COMPRESSION. Weakly compressible
+    // SPH settles well above the lattice density at any dt, so it is held to the first two alone.
+    // compression gets the largest compression sampled.
+    bool RunIsStable(Simulation& sim, Scene scene, float dt, float& compression) {
+        sim.fixedTimestep = dt;
+        sim.ResetScene(scene);
+        compression = 0.0f;
+        bool densityLimited = sim.solver != Solver::SPH;
+
+        int steps = std::max(MIN_STABLE_STEPS, static_cast<int>(std::ceil(SIMULATED_SECONDS / dt)));
+        const int chunk = 25; // check between chunks so a blow-up ends the run early
+        for (int done = 0; done < steps; done += chunk) {
+            sim.Simulate(std::min(chunk, steps - done), BOUNDARY_LIMIT);
+            StepStats stats = sim.FetchStepStats();
+            if (stats.totalNanResets > 0 || !(stats.maxSpeed < SPEED_LIMIT)) return false;
+            compression = std::max(compression, MaxCompression(sim));
+            if (densityLimited && compression > MAX_COMPRESSION) return false;
+        }
+        return true;
+    }
+
+    // Centre of mass and kinetic energy per unit mass of the current state (blocking readback).
+    struct StateSample {
+        glm::vec2 centreOfMass = glm::vec2(0.0f);
+        float kineticEnergy = 0.0f;
+    };
+
+    StateSample SampleState(const Simulation& sim) {
+        unsigned int count = sim.GetParticleCount();
+        std::vector<glm::vec2> positions, velocities;
+        sim.ReadParticles(positions, velocities);
+
+        StateSample sample;
+        for (unsigned int i = 0; i < count; ++i) {
+            sample.centreOfMass += positions[i];
+            sample.kineticEnergy += 0.5f * glm::dot(velocities[i], velocities[i]);
+        }
+        sample.centreOfMass /= static_cast<float>(std::max(1u, count));
+        sample.kineticEnergy /= static_cast<float>(std::max(1u, count));
+        return sample;
+    }
+
+    // Runs SIMULATED_SECONDS of scene, sampling the state every SAMPLE_SECONDS; returns ms per step.
+    const float SAMPLE_SECONDS = 0.25f;
+    double TimedRun(Simulation& sim, Scene scene, std::vector<StateSample>& samples) {
+        sim.ResetScene(scene);
+        samples.clear();
+
+        int stepsPerSample = std::max(1, static_cast<int>(std::round(SAMPLE_SECONDS / sim.fixedTimestep)));
+        int steps = static_cast<int>(std::ceil(SIMULATED_SECONDS / sim.fixedTimestep));
+        double milliseconds = 0.0;
+        bool gpu = sim.GetBackend() == Backend::GPU;
+        for (int done = 0; done < steps; done += stepsPerSample) {
+            if (gpu) glFinish();
+            auto start = std::chrono::steady_clock::now();
+            sim.Simulate(std::min(stepsPerSample, steps - done), BOUNDARY_LIMIT);
+            if (gpu) glFinish();
+            milliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            samples.push_back(SampleState(sim));
+        }
+        return milliseconds / steps;
+    }
+
+    // Against a reference run sampled at the same times: the largest centre-of-mass offset and the
+    // mean kinetic energy difference in percent of the reference's mean kinetic energy
+    struct Deviation {
+        float comOffset = 0.0f;
+        float keDeviation = 0.0f;
+    };
+
+    Deviation CompareSamples(const std::vector<StateSample>& samples, const std::vector<StateSample>& reference) {
+        Deviation deviation;
+        float keDifference = 0.0f;
+        float keReference = 0.0f;
+        for (size_t i = 0; i < samples.size() && i < reference.size(); ++i) {
+            deviation.comOffset = std::max(deviation.comOffset, glm::length(samples[i].centreOfMass - reference[i].centreOfMass));
+            keDifference += std::abs(samples[i].kineticEnergy - reference[i].kineticEnergy);
+            keReference += reference[i].kineticEnergy;
+        }
+        deviation.keDeviation = 100.0f * keDifference / std::max(keReference, 1e-12f);
+        return deviation;
+    }
+
+    // FNV-1a over the bytes of every position and velocity (blocking readback)
+    unsigned long long StateHash(const Simulation& sim) {
+        std::vector<glm::vec2> positions, velocities;
+        sim.ReadParticles(positions, velocities);
+        unsigned long long hash = 1469598103934665603ull;
+        for (const std::vector<glm::vec2>* values : { &positions, &velocities }) {
+            const unsigned char* bytes = reinterpret_cast<const unsigned char*>(values->data());
+            for (size_t b = 0; b < values->size() * sizeof(glm::vec2); ++b) {
+                hash = (hash ^ bytes[b]) * 1099511628211ull;
+            }
+        }
+        return hash;
+    }
+
+    // Mean neighbours within h per particle, and the share of particles whose nearest neighbour
+    // is closer than half the mean nearest-neighbour distance, i.e. paired up (blocking readback).
+    struct NeighbourSample {
+        float meanNeighbours = 0.0f;
+        float pairedPercent = 0.0f;
+    };
+
+    NeighbourSample SampleNeighbours(const Simulation& sim) {
+        unsigned int count = sim.GetParticleCount();
+        std::vector<glm::vec2> positions, velocities;
+        sim.ReadParticles(positions, velocities);
+
+        float h2 = sim.smoothingRadius * sim.smoothingRadius;
+        std::vector<float> nearest(count);
+        unsigned int neighbours = 0;
+        float meanNearest = 0.0f;
+        for (unsigned int i = 0; i < count; ++i) {
+            float nearestSq = 1e30f;
+            for (unsigned int j = 0; j < count; ++j) {
+                if (j == i) continue;
+                glm::vec2 d = positions[i] - positions[j];
+                float distSq = glm::dot(d, d);
+                if (distSq < h2) ++neighbours;
+                nearestSq = std::min(nearestSq, distSq);
+            }
+            nearest[i] = std::sqrt(nearestSq);
+            meanNearest += nearest[i] / count;
+        }
+        unsigned int paired = static_cast<unsigned int>(std::count_if(nearest.begin(), nearest.end(),
+            [&](float distance) { return distance < 0.5f * meanNearest; }));
+
+        NeighbourSample sample;
+        sample.meanNeighbours = static_cast<float>(neighbours) / std::max(1u, count);
+        sample.pairedPercent = 100.0f * paired / std::max(1u, count);
+        return sample;
+    }
+
+    // The last dt before the first failure, 0 if none, and the largest compression of its run
+    struct StableTimestepResult {
+        float dt = 0.0f;
+        float compression = 0.0f;
+    };
+
+    // Walks dt up geometrically from 0.001 until a run fails or the scan reaches MAX_STABLE_TIMESTEP.
+    StableTimestepResult LargestStableTimestep(Simulation& sim, Scene scene) {
+        StableTimestepResult stable;
+        for (float dt = 0.001f; dt <= MAX_STABLE_TIMESTEP; dt *= 1.25f) {
+            float compression;
+            if (!RunIsStable(sim, scene, dt, compression)) break;
+            stable.dt = dt;
+            stable.compression = compression;
+        }
+        return stable;
+    }
+
+    // dt with 4 decimals, a "+" when the scan ran out before the run failed, and the compression
+    std::string StableTimestepLabel(const StableTimestepResult& stable) {
+        std::ostringstream label;
+        label << std::fixed << std::setprecision(4) << stable.dt << (stable.dt * 1.25f > MAX_STABLE_TIMESTEP ? "+" : "");
+        if (stable.dt > 0.0f) label << std::setprecision(1) << " (" << 100.0f * stable.compression << "%)";
+        return label.str();
+    }
+}
+
+void Benchmark::StableTimestep(Simulation& sim) {
+    Solver savedSolver = sim.solver;
+    Integrator savedIntegrator = sim.integrator;
+    float savedTimestep = sim.fixedTimestep;
+    bool savedAdaptive = sim.adaptiveTimestep;
+    BoundaryMode savedBoundary = sim.boundaryMode;
+    sim.adaptiveTimestep = false;
+
+    std::cout << "Largest stable dt (" << sim.GetParticleCount() << " particles, " << SIMULATED_SECONDS << " s or "
+              << MIN_STABLE_STEPS << " steps simulated, PBF and DFSPH compressed at most " << 100.0f * MAX_COMPRESSION
+              << "%, damping " << sim.globalDamping << "; largest compression in brackets)" << std::endl;
+    std::cout << std::left << std::setw(12) << "scene"
+              << std::setw(22) << "semi-implicit Euler" << std::setw(22) << "leapfrog (KDK)"
+              << std::setw(22) << "Euler, projection"
+              << std::setw(22) << ("PBF (" + std::to_string(sim.pbfIterations) + " iterations)")
+              << "DFSPH" << std::endl;
+
+    for (Scene scene : SCENES) {
+        sim.solver = Solver::SPH;
+        sim.integrator = Integrator::SemiImplicitEuler;
+        sim.boundaryMode = BoundaryMode::Penalty;
+        StableTimestepResult euler = LargestStableTimestep(sim, scene);
+        sim.integrator = Integrator::Leapfrog;
+        StableTimestepResult leapfrog = LargestStableTimestep(sim, scene);
+        sim.integrator = Integrator::SemiImplicitEuler;
+        sim.boundaryMode = BoundaryMode::Projection;
+        StableTimestepResult projection = LargestStableTimestep(sim, scene);
+        sim.solver = Solver::PBF;
+        StableTimestepResult pbf = LargestStableTimestep(sim, scene);
+        sim.solver = Solver::DFSPH;
+        StableTimestepResult dfsph = LargestStableTimestep(sim, scene);
+
+        std::cout << std::left << std::setw(12) << SceneName(scene) << std::setw(22) << StableTimestepLabel(euler)
+                  << std::setw(22) << StableTimestepLabel(leapfrog) << std::setw(22) << StableTimestepLabel(projection)
+                  << std::setw(22) << StableTimestepLabel(pbf) << StableTimestepLabel(dfsph) << std::endl;
+    }
+
+    sim.solver = savedSolver;
+    sim.integrator = savedIntegrator;
+    sim.fixedTimestep = savedTimestep;
+    sim.adaptiveTimestep = savedAdaptive;
+    sim.boundaryMode = savedBoundary;
+    sim.ResetScene(Scene::Block);
+}
+
+void Benchmark::MultiRateForces(Simulation& sim) {
+    Solver savedSolver = sim.solver;
+    bool savedAdaptive = sim.adaptiveTimestep;
+    int savedInterval = sim.slowForceInterval;
+    sim.solver = Solver::SPH;
+    sim.adaptiveTimestep = false;
+
+    // Deviations are measured against k = 1 at every sample
+    const int INTERVALS[] = { 1, 2, 4, 8 };
+    std::cout << "Multi-rate viscosity + surface tension (" << sim.GetParticleCount() << " particles, dt "
+              << sim.fixedTimestep << " s, " << SIMULATED_SECONDS << " s simulated)" << std::endl;
+    std::cout << std::left << std::setw(12) << "scene" << std::setw(6) << "k" << std::setw(12) << "ms/step"
+              << std::setw(10) << "speedup" << std::setw(16) << "max COM offset" << std::setw(14) << "KE deviation"
+              << "NaN resets" << std::endl;
+
+    for (Scene scene : SCENES) {
+        std::vector<StateSample> reference;
+        double referenceMs = 0.0;
+        for (int interval : INTERVALS) {
+            sim.slowForceInterval = interval;
+            std::vector<StateSample> samples;
+            double ms = TimedRun(sim, scene, samples);
+            if (interval == 1) {
+                reference = samples;
+                referenceMs = ms;
+            }
+
+            Deviation deviation = CompareSamples(samples, reference);
+            std::cout << std::left << std::setw(12) << SceneName(scene) << std::setw(6) << interval
+                      << std::fixed << std::setprecision(2) << std::setw(12) << ms
+                      << std::setw(10) << (referenceMs / ms) << std::setprecision(4) << std::setw(16) << deviation.comOffset
+                      << std::setprecision(1) << std::setw(14) << deviation.keDeviation
+                      << sim.FetchStepStats().totalNanResets << std::endl;
+            std::cout.unsetf(std::ios::fixed);
+        }
+    }
+
+    sim.solver = savedSolver;
+    sim.adaptiveTimestep = savedAdaptive;
+    sim.slowForceInterval = savedInterval;
+    sim.ResetScene(Scene::Block);
+}
+
+void Benchmark::KernelTable(Simulation& sim) {
+    Solver savedSolver = sim.solver;
+    bool savedAdaptive = sim.adaptiveTimestep;
+    bool savedTable = sim.kernelLookupTable;
+    sim.solver = Solver::SPH;
+    sim.adaptiveTimestep = false;
+
+    // Interpolation error of the table against Kernels::TableShapes, between the entries,
+    // relative to each shape's largest value
+    float tableError = 0.0f;
+    float largest[3] = {};
+    for (int i = 0; i < Kernels::TABLE_SIZE; ++i) {
+        float shapes[3];
+        Kernels::TableShapes(sim.kernelFamily, static_cast<float>(i) / (Kernels::TABLE_SIZE - 1), shapes);
+        for (int c = 0; c < 3; ++c) largest[c] = std::max(largest[c], std::abs(shapes[c]));
+    }
+    const int SAMPLES_PER_ENTRY = 16;
+    for (int i = 0; i + 1 < Kernels::TABLE_SIZE; ++i) {
+        float low[3], high[3], exact[3];
+        Kernels::TableShapes(sim.kernelFamily, static_cast<float>(i) / (Kernels::TABLE_SIZE - 1), low);
+        Kernels::TableShapes(sim.kernelFamily, static_cast<float>(i + 1) / (Kernels::TABLE_SIZE - 1), high);
+        for (int s = 1; s < SAMPLES_PER_ENTRY; ++s) {
+            float t = static_cast<float>(s) / SAMPLES_PER_ENTRY;
+            Kernels::TableShapes(sim.kernelFamily, (i + t) / (Kernels::TABLE_SIZE - 1), exact);
+            for (int c = 0; c < 3; ++c) {
+                tableError = std::max(tableError, std::abs(low[c] + t * (high[c] - low[c]) - exact[c]) / largest[c]);
+            }
+        }
+    }
+
+    // Deviations are measured against the analytic kernels at every sample
+    std::cout << "Kernel lookup table (" << sim.GetParticleCount() << " particles, " << Kernels::FamilyName(sim.kernelFamily)
+              << ", " << Kernels::TABLE_SIZE << " entries, max relative interpolation error " << tableError << ")" << std::endl;
+    std::cout << std::left << std::setw(12) << "scene" << std::setw(14) << "analytic ms" << std::setw(12) << "table ms"
+              << std::setw(10) << "speedup" << std::setw(16) << "max COM offset" << std::setw(14) << "KE deviation"
+              << "NaN resets" << std::endl;
+
+    for (Scene scene : SCENES) {
+        std::vector<StateSample> reference, samples;
+        sim.kernelLookupTable = false;
+        double analyticMs = TimedRun(sim, scene, reference);
+        sim.kernelLookupTable = true;
+        double tableMs = TimedRun(sim, scene, samples);
+
+        Deviation deviation = CompareSamples(samples, reference);
+        std::cout << std::left << std::setw(12) << SceneName(scene)
+                  << std::fixed << std::setprecision(2) << std::setw(14) << analyticMs << std::setw(12) << tableMs
+                  << std::setw(10) << (analyticMs / tableMs) << std::scientific << std::setprecision(1)
+                  << std::setw(16) << deviation.comOffset << std::setw(14) << deviation.keDeviation
+                  << sim.FetchStepStats().totalNanResets << std::endl;
+        std::cout.unsetf(std::ios::scientific);
+        std::cout.unsetf(std::ios::fixed);
+    }
+
+    sim.solver = savedSolver;
+    sim.adaptiveTimestep = savedAdaptive;
+    sim.kernelLookupTable = savedTable;
+    sim.ResetScene(Scene::Block);
+}
+
+void Benchmark::DoubleSums(Simulation& sim) {
+    Solver savedSolver = sim.solver;
+    bool savedAdaptive = sim.adaptiveTimestep;
+    bool savedDoubleSums = sim.doubleSums;
+    sim.solver = Solver::SPH;
+    sim.adaptiveTimestep = false;
+
+    // Deviations are measured against the double sums at every sample
+    std::cout << "Double sums (" << sim.GetParticleCount() << " particles, " << Kernels::FamilyName(sim.kernelFamily) << ")" << std::endl;
+    std::cout << std::left << std::setw(12) << "scene" << std::setw(12) << "float ms" << std::setw(12) << "double ms"
+              << std::setw(10) << "cost %" << std::setw(16) << "max COM offset" << std::setw(14) << "KE deviation"
+              << "NaN resets" << std::endl;
+
+    for (Scene scene : SCENES) {
+        std::vector<StateSample> reference, samples;
+        sim.doubleSums = true;
+        double doubleMs = TimedRun(sim, scene, reference);
+        sim.doubleSums = false;
+        double floatMs = TimedRun(sim, scene, samples);
+
+        Deviation deviation = CompareSamples(samples, reference);
+        std::cout << std::left << std::setw(12) << SceneName(scene)
+                  << std::fixed << std::setprecision(2) << std::setw(12) << floatMs << std::setw(12) << doubleMs
+                  << std::setprecision(1) << std::setw(10) << (100.0 * (doubleMs / floatMs - 1.0))
+                  << std::scientific << std::setprecision(1) << std::setw(16) << deviation.comOffset << std::setw(14)
+                  << deviation.keDeviation << sim.FetchStepStats().totalNanResets << std::endl;
+        std::cout.unsetf(std::ios::scientific);
+        std::cout.unsetf(std::ios::fixed);
+    }
+
+    sim.solver = savedSolver;
+    sim.adaptiveTimestep = savedAdaptive;
+    sim.doubleSums = savedDoubleSums;
+    sim.ResetScene(Scene::Block);
+}
+
+void Benchmark::KernelFamilies(Simulation& sim) {
+    Solver savedSolver = sim.solver;
+    bool savedAdaptive = sim.adaptiveTimestep;
+    KernelFamily savedFamily = sim.kernelFamily;
+    float savedRadius = sim.smoothingRadius;
+    float savedTimestep = sim.fixedTimestep;
+    sim.solver = Solver::SPH;
+    sim.adaptiveTimestep = false;
+
+    // h in particle spacings of the dam break lattice
+    const float RATIOS[] = { 4.0f, 3.0f, 2.5f, 2.0f };
+    sim.ResetScene(Scene::DamBreak);
+    float spacing = sim.GetSceneSpacing();
+
+    // Each row runs at its own largest stable dt, so ms per simulated second compares the
+    // families at the step each one can afford rather than at equal step counts
+    std::cout << "Kernel families (" << sim.GetParticleCount() << " particles, dam break, spacing " << spacing
+              << ", " << SIMULATED_SECONDS << " s simulated)" << std::endl;
+    std::cout << std::left << std::setw(14) << "family" << std::setw(8) << "h/dx" << std::setw(12) << "stable dt"
+              << std::setw(12) << "ms/step" << std::setw(16) << "ms/simulated s" << std::setw(12) << "neighbours"
+              << "paired %" << std::endl;
+
+    for (KernelFamily family : Kernels::FAMILIES) {
+        sim.kernelFamily = family;
+        for (float ratio : RATIOS) {
+            sim.smoothingRadius = ratio * spacing;
+            float dt = LargestStableTimestep(sim, Scene::DamBreak).dt;
+            std::cout << std::left << std::setw(14) << Kernels::FamilyName(family) << std::fixed << std::setprecision(1)
+                      << std::setw(8) << ratio << std::setprecision(4) << std::setw(12) << dt;
+            if (dt == 0.0f) {
+                std::cout << "unstable" << std::endl;
+                std::cout.unsetf(std::ios::fixed);
+                continue;
+            }
+
+            sim.fixedTimestep = dt;
+            std::vector<StateSample> samples;
+            double ms = TimedRun(sim, Scene::DamBreak, samples);
+            NeighbourSample neighbours = SampleNeighbours(sim);
+            std::cout << std::setprecision(2) << std::setw(12) << ms << std::setw(16) << (ms / dt)
+                      << std::setprecision(1) << std::setw(12) << neighbours.meanNeighbours
+                      << neighbours.pairedPercent << std::endl;
+            std::cout.unsetf(std::ios::fixed);
+        }
+    }
+
+    sim.solver = savedSolver;
+    sim.adaptiveTimestep = savedAdaptive;
+    sim.kernelFamily = savedFamily;
+    sim.smoothingRadius = savedRadius;
+    sim.fixedTimestep = savedTimestep;
+    sim.ResetScene(Scene::Block);
+}
+
+void Benchmark::CpuBackend(unsigned int particles) {
+    // 1, 2, 4, ... threads and every hardware thread
+    unsigned int hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<unsigned int> threadCounts;
+    for (unsigned int threads = 1; threads < hardwareThreads; threads *= 2) {
+        threadCounts.push_back(threads);
+    }
+    threadCounts.push_back(hardwareThreads);
+
+    // Each run is compared with the single-threaded one: the cell order within a cell depends on
+    // the thread schedule, so sums round differently and the runs drift apart slowly
+    std::cout << "CPU backend (" << particles << " particles, dam break, " << SIMULATED_SECONDS
+              << " s simulated, " << hardwareThreads << " hardware threads, "
+              << CpuKernels::Name(CpuKernels::Detect()) << ")" << std::endl;
+    std::cout << std::left << std::setw(10) << "threads" << std::setw(12) << "ms/step" << std::setw(12) << "steps/s"
+              << std::setw(16) << "steps/s/core" << std::setw(12) << "speed-up" << std::setw(14) << "efficiency %"
+              << std::setw(14) << "COM offset" << "KE dev %" << std::endl;
+
+    double singleThreadRate = 0.0;
+    std::vector<StateSample> reference;
+    for (unsigned int threads : threadCounts) {
+        Simulation sim;
+        sim.cpuThreads = threads;
+        sim.Init(particles, particles, Backend::CPU);
+
+        std::vector<StateSample> samples;
+        TimedRun(sim, Scene::DamBreak, samples);
+        CpuStats stats = sim.GetCpuStats();
+        if (reference.empty()) {
+            singleThreadRate = stats.stepsPerSecond;
+            reference = samples;
+        }
+        Deviation deviation = CompareSamples(samples, reference);
+        double speedUp = stats.stepsPerSecond / std::max(singleThreadRate, 1e-9);
+
+        std::cout << std::left << std::setw(10) << stats.threads << std::fixed << std::setprecision(3)
+                  << std::setw(12) << (1000.0 / std::max(stats.stepsPerSecond, 1e-9)) << std::setprecision(1)
+                  << std::setw(12) << stats.stepsPerSecond << std::setw(16) << stats.stepsPerSecondPerCore
+                  << std::setprecision(2) << std::setw(12) << speedUp << std::setprecision(1)
+                  << std::setw(14) << (100.0 * speedUp / stats.threads) << std::setprecision(4)
+                  << std::setw(14) << deviation.comOffset << std::setprecision(2) << deviation.keDeviation << std::endl;
+        std::cout.unsetf(std::ios::fixed);
+    }
+}
+
+void Benchmark::CpuInstructionSets(unsigned int particles) {
+    // One thread, so the columns compare the neighbour sums rather than the scheduling
+    std::cout << "CPU instruction sets (" << particles << " particles, dam break, " << SIMULATED_SECONDS
+              << " s simulated, 1 thread)" << std::endl;
+    std::cout << std::left << std::setw(10) << "ISA" << std::setw(12) << "ms/step" << std::setw(12) << "steps/s"
+              << std::setw(12) << "speed-up" << std::setw(14) << "COM offset" << "KE dev %" << std::endl;
+
+    double scalarRate = 0.0;
+    std::vector<StateSample> reference;
+    for (CpuIsa isa : { CpuIsa::Scalar, CpuIsa::AVX2, CpuIsa::AVX512 }) {
+        if (!CpuKernels::IsSupported(isa)) {
+            std::cout << std::left << std::setw(10) << CpuKernels::Name(isa) << "not supported by this CPU or build" << std::endl;
+            continue;
+        }
+        Simulation sim;
+        sim.cpuThreads = 1;
+        sim.cpuIsa = isa;
+        sim.Init(particles, particles, Backend::CPU);
+
+        std::vector<StateSample> samples;
+        double ms = TimedRun(sim, Scene::DamBreak, samples);
+        CpuStats stats = sim.GetCpuStats();
+        if (reference.empty()) {
+            scalarRate = stats.stepsPerSecond;
+            reference = samples;
+        }
+        Deviation deviation = CompareSamples(samples, reference);
+
+        std::cout << std::left << std::setw(10) << CpuKernels::Name(stats.isa) << std::fixed << std::setprecision(3)
+                  << std::setw(12) << ms << std::setprecision(1) << std::setw(12) << stats.stepsPerSecond
+                  << std::setprecision(2) << std::setw(12) << (stats.stepsPerSecond / std::max(scalarRate, 1e-9))
+                  << std::setprecision(4) << std::setw(14) << deviation.comOffset << std::setprecision(2)
+                  << deviation.keDeviation << std::endl;
+        std::cout.unsetf(std::ios::fixed);
+    }
+}
+
+void Benchmark::CpuPairTraversal(unsigned int particles) {
+    unsigned int hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+    std::cout << "CPU pair traversal (" << particles << " particles, dam break, " << SIMULATED_SECONDS
+              << " s simulated, " << CpuKernels::Name(CpuKernels::Detect()) << ")" << std::endl;
+    std::cout << std::left << std::setw(12) << "traversal" << std::setw(9) << "threads" << std::setw(12) << "ms/step"
+              << std::setw(12) << "steps/s" << std::setw(12) << "speed-up" << std::setw(14) << "COM offset"
+              << "KE dev %" << std::endl;
+
+    for (unsigned int threads : { 1u, hardwareThreads }) {
+        double gatherRate = 0.0;
+        std::vector<StateSample> reference;
+        for (bool halfShell : { false, true }) {
+            Simulation sim;
+            sim.cpuThreads = threads;
+            sim.cpuHalfShell = halfShell;
+            sim.Init(particles, particles, Backend::CPU);
+
+            std::vector<StateSample> samples;
+            double ms = TimedRun(sim, Scene::DamBreak, samples);
+            CpuStats stats = sim.GetCpuStats();
+            if (reference.empty()) {
+                gatherRate = stats.stepsPerSecond;
+                reference = samples;
+            }
+            Deviation deviation = CompareSamples(samples, reference);
+
+            std::cout << std::left << std::setw(12) << (halfShell ? "half shell" : "gather") << std::setw(9) << stats.threads
+                      << std::fixed << std::setprecision(3) << std::setw(12) << ms << std::setprecision(1) << std::setw(12)
+                      << stats.stepsPerSecond << std::setprecision(2) << std::setw(12)
+                      << (stats.stepsPerSecond / std::max(gatherRate, 1e-9)) << std::setprecision(4) << std::setw(14)
+                      << deviation.comOffset << std::setprecision(2) << deviation.keDeviation << std::endl;
+            std::cout.unsetf(std::ios::fixed);
+        }
+        if (hardwareThreads == 1) break;
+    }
+}
+
+void Benchmark::CpuNumaSlabs(unsigned int particles) {
+    unsigned int threads = std::max(2u, std::thread::hardware_concurrency());
+    unsigned int osNodes = static_cast<unsigned int>(Numa::OsNodes().size());
+    std::cout << "CPU NUMA slabs (" << particles << " particles, dam break, " << SIMULATED_SECONDS << " s simulated, "
+              << threads << " threads, " << osNodes << " OS nodes)" << std::endl;
+    std::cout << std::left << std::setw(12) << "slabs" << std::setw(8) << "huge" << std::setw(12) << "ms/step"
+              << std::setw(12) << "steps/s" << std::setw(12) << "speed-up" << std::setw(12) << "remote %"
+              << std::setw(14) << "off node %" << "COM offset" << std::endl;
+
+    // 1: no slabs; 0: the OS's nodes; 2: two slabs, split from one node on a single socket
+    std::vector<unsigned int> layouts = { 1 };
+    if (osNodes > 1) layouts.push_back(0);
+    if (osNodes != 2) layouts.push_back(2);
+
+    double baseRate = 0.0;
+    std::vector<StateSample> reference;
+    for (unsigned int layout : layouts) {
+        for (bool hugePages : { false, true }) {
+            Simulation sim;
+            sim.cpuThreads = threads;
+            sim.cpuNumaNodes = layout;
+            sim.cpuHugePages = hugePages;
+            sim.Init(particles, particles, Backend::CPU);
+
+            std::vector<StateSample> samples;
+            double ms = TimedRun(sim, Scene::DamBreak, samples);
+            CpuStats stats = sim.GetCpuStats();
+            if (reference.empty()) {
+                baseRate = stats.stepsPerSecond;
+                reference = samples;
+            }
+            Deviation deviation = CompareSamples(samples, reference);
+
+            std::string slabs = std::to_string(stats.numaNodes) + (layout == 0 ? " (OS)" : "");
+            std::cout << std::left << std::setw(12) << slabs << std::setw(8) << (stats.hugePages ? "yes" : "no")
+                      << std::fixed << std::setprecision(3) << std::setw(12) << ms << std::setprecision(1) << std::setw(12)
+                      << stats.stepsPerSecond << std::setprecision(2) << std::setw(12)
+                      << (stats.stepsPerSecond / std::max(baseRate, 1e-9)) << std::setprecision(1) << std::setw(12)
+                      << (100.0 * stats.remoteAccessRatio) << std::setw(14);
+            if (stats.misplacedPages < 0.0) std::cout << "n/a";
+            else std::cout << (100.0 * stats.misplacedPages);
+            std::cout << std::setprecision(4) << deviation.comOffset << std::endl;
+            std::cout.unsetf(std::ios::fixed);
+        }
+    }
+}
+
+void Benchmark::CpuDeterminism(unsigned int particles) {
+    unsigned int hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<unsigned int> threadCounts = { 1, 8, 64 };
+    if (std::find(threadCounts.begin(), threadCounts.end(), hardwareThreads) == threadCounts.end()) {
+        threadCounts.push_back(hardwareThreads);
+        std::sort(threadCounts.begin(), threadCounts.end());
+    }
+
+    std::cout << "CPU deterministic mode (" << particles << " particles, dam break, " << SIMULATED_SECONDS
+              << " s simulated, " << hardwareThreads << " hardware threads, "
+              << CpuKernels::Name(CpuKernels::Detect()) << ")" << std::endl;
+    std::cout << std::left << std::setw(10) << "threads" << std::setw(14) << "steps/s" << std::setw(12) << "same"
+              << std::setw(16) << "det. steps/s" << std::setw(12) << "det. same" << "cost %" << std::endl;
+
+    unsigned long long reference[2] = {};
+    for (unsigned int threads : threadCounts) {
+        double rate[2];
+        bool same[2];
+        for (int deterministic = 0; deterministic < 2; ++deterministic) {
+            Simulation sim;
+            sim.cpuThreads = threads;
+            sim.cpuDeterministic = deterministic == 1;
+            sim.Init(particles, particles, Backend::CPU);
+
+            std::vector<StateSample> samples;
+            TimedRun(sim, Scene::DamBreak, samples);
+            unsigned long long hash = StateHash(sim);
+            if (threads == threadCounts.front()) reference[deterministic] = hash;
+            rate[deterministic] = sim.GetCpuStats().stepsPerSecond;
+            same[deterministic] = hash == reference[deterministic];
+        }
+
+        std::cout << std::left << std::setw(10) << threads << std::fixed << std::setprecision(1) << std::setw(14) << rate[0]
+                  << std::setw(12) << (same[0] ? "yes" : "no") << std::setw(16) << rate[1] << std::setw(12)
+                  << (same[1] ? "yes" : "no") << (100.0 * (rate[0] / std::max(rate[1], 1e-9) - 1.0)) << std::endl;
+        std::cout.unsetf(std::ios::fixed);
+    }
+}
+
+void Benchmark::CpuPrecisions(unsigned int particles) {
+    unsigned int hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+    const CpuPrecision PRECISIONS[] = { CpuPrecision::Single, CpuPrecision::Mixed, CpuPrecision::Double };
+    std::cout << "CPU precision (" << particles << " particles, dam break, " << SIMULATED_SECONDS
+              << " s simulated, deterministic, " << CpuKernels::Name(CpuKernels::Detect()) << ")" << std::endl;
+    std::cout << std::left << std::setw(11) << "precision" << std::setw(9) << "threads" << std::setw(12) << "ms/step"
+              << std::setw(12) << "steps/s" << std::setw(10) << "cost %" << std::setw(14) << "COM offset"
+              << "KE dev %" << std::endl;
+
+    for (unsigned int threads : { 1u, hardwareThreads }) {
+        // Every precision runs before any is printed, as the drift is against the double run
+        struct Run {
+            double ms;
+            CpuStats stats;
+            std::vector<StateSample> samples;
+        };
+        std::vector<Run> runs;
+        for (CpuPrecision precision : PRECISIONS) {
+            Simulation sim;
+            sim.cpuThreads = threads;
+            sim.cpuDeterministic = true;
+            sim.cpuPrecision = precision;
+            sim.Init(particles, particles, Backend::CPU);
+
+            Run run;
+            run.ms = TimedRun(sim, Scene::DamBreak, run.samples);
+            run.stats = sim.GetCpuStats();
+            runs.push_back(run);
+        }
+
+        for (const Run& run : runs) {
+            Deviation deviation = CompareSamples(run.samples, runs.back().samples);
+            std::cout << std::left << std::setw(11) << CpuKernels::Name(run.stats.precision) << std::setw(9) << run.stats.threads
+                      << std::fixed << std::setprecision(3) << std::setw(12) << run.ms << std::setprecision(1) << std::setw(12)
+                      << run.stats.stepsPerSecond << std::setw(10)
+                      << (100.0 * (runs.front().stats.stepsPerSecond / std::max(run.stats.stepsPerSecond, 1e-9) - 1.0))
+                      << std::setprecision(6) << std::setw(14) << deviation.comOffset << std::setprecision(4)
+                      << deviation.keDeviation << std::endl;
+            std::cout.unsetf(std::ios::fixed);
+        }
+        if (hardwareThreads == 1) break;
+    }
+}
+
+void Benchmark::OutOfCore(unsigned int particles, const std::string& directory, unsigned int tileParticles, unsigned int threads) {
+    const int STEPS = 10;
+    const unsigned int IN_MEMORY_LIMIT = 1u << 20;  // largest run repeated on the in-memory backend
+    const float LAYOUT_SPACING = 0.05f;             // the spacing the default radius and mass are for
+    std::cout << "Out-of-core CPU solver (dam break, " << STEPS << " steps, tiles of " << tileParticles << " particles in "
+              << directory << ", " << (threads > 0 ? threads : std::max(1u, std::thread::hardware_concurrency()))
+              << " threads, " << CpuKernels::Name(CpuKernels::Detect()) << ")" << std::endl;
+    std::cout << std::left << std::setw(12) << "particles" << std::setw(7) << "tiles" << std::setw(11) << "ms/step"
+              << std::setw(13) << "ns/particle" << std::setw(11) << "files MB" << std::setw(11) << "window MB"
+              << std::setw(10) << "cached %" << std::setw(9) << "halo %" << std::setw(9) << "moved %" << "COM offset" << std::endl;
+
+    bool prefetched = true;
+    for (unsigned int divisor : { 64u, 16u, 4u, 1u }) {
+        unsigned int count = particles / divisor;
+        if (count < 1000 && divisor > 1) continue;
+
+        // h and the mass scale with the spacing, so every run has the default layout's neighbours
+        // and rest density. Accelerations grow as 1 / h, so the stable dt shrinks with h: the
+        // timestep bounds scale too.
+        Simulation sim;
+        sim.cpuThreads = threads;
+        float scale = Simulation::LayOutScene(Scene::DamBreak, count, [](unsigned int, glm::vec2) {}) / LAYOUT_SPACING;
+        sim.smoothingRadius *= scale;
+        sim.particleMass *= scale * scale;
+        sim.minTimestep *= scale;
+        sim.maxTimestep *= scale;
+        sim.adaptiveTimestep = true;
+
+        OutOfCoreSolver solver(directory, threads, tileParticles);
+        if (!solver.Reset(Scene::DamBreak, count, sim, BOUNDARY_LIMIT, sim.maxTimestep)) {
+            std::cout << "could not create the tile files in " << directory << std::endl;
+            return;
+        }
+        for (int step = 0; step < STEPS; ++step) {
+            if (!solver.Step(sim)) {
+                std::cout << "could not grow the tile files in " << directory << std::endl;
+                return;
+            }
+        }
+        OutOfCoreStats stats = solver.GetStats();
+        prefetched &= stats.prefetched;
+
+        // Centre of mass in double: a float sum stops moving long before 100M particles
+        glm::dvec2 centreOfMass(0.0);
+        solver.ForEachParticle([&](glm::vec2 position, glm::vec2) { centreOfMass += glm::dvec2(position); });
+        centreOfMass /= static_cast<double>(std::max<size_t>(1, solver.GetParticleCount()));
+        std::string cached = stats.residentFraction >= 0.0 ? std::to_string(static_cast<int>(std::round(100.0 * stats.residentFraction))) : "-";
+        std::string offset = "-";
+        if (count <= IN_MEMORY_LIMIT) {
+            sim.Init(count, count, Backend::CPU);
+            sim.ResetScene(Scene::DamBreak);
+            sim.Simulate(STEPS, BOUNDARY_LIMIT);
+            offset = std::to_string(glm::length(glm::vec2(centreOfMass) - SampleState(sim).centreOfMass));
+        }
+
+        std::cout << std::left << std::setw(12) << count << std::setw(7) << stats.tiles << std::fixed << std::setprecision(1)
+                  << std::setw(11) << (1000.0 / std::max(stats.stepsPerSecond, 1e-9)) << std::setw(13) << stats.nanosecondsPerParticle
+                  << std::setw(11) << stats.fileBytes / 1048576.0 << std::setw(11) << stats.windowBytes / 1048576.0 << std::setw(10)
+                  << cached << std::setw(9) << 100.0 * stats.haloFraction
+                  << std::setprecision(2) << std::setw(9) << 100.0 * stats.migratedFraction << offset << std::endl;
+        std::cout.unsetf(std::ios::fixed);
+    }
+    if (!prefetched) std::cout << "The OS refused the read-ahead advice" << std::endl;
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <string>
+#include "Simulation.h"
+
+// Offline measurements, run from the command line: FluidSimulation --benchmark [particles]
+// (GPU) or FluidSimulation --cpu-benchmark [particles] (CPU backend, headless).
+// Each benchmark resets the simulation it is given, prints a table to stdout and
+// restores the parameters it touched.
+namespace Benchmark {
+    // Largest fixed timestep each integrator and solver survives, per scene, with PBF and DFSPH
+    // also held to a density error, and the largest compression at that timestep.
+    void StableTimestep(Simulation& sim);
+    // Cost and accuracy of refreshing viscosity and surface tension every k steps, per scene.
+    void MultiRateForces(Simulation& sim);
+    // Cost and accuracy of the kernel lookup table against the analytic kernels, per scene.
+    void KernelTable(Simulation& sim);
+    // Cost of summing the density and forces in double on the GPU, and the float sums' drift
+    // from the double ones, per scene.
+    void DoubleSums(Simulation& sim);
+    // Stability, cost, neighbour count and particle pairing of each kernel family on the dam
+    // break, for smoothing radii from four down to two particle spacings.
+    void KernelFamilies(Simulation& sim);
+    // Steps per second of the CPU backend on the dam break for 1, 2, 4, ... threads, and how
+    // far each run drifts from the single-threaded one. Needs no GL context.
+    void CpuBackend(unsigned int particles);
+    // Single-threaded steps per second of the CPU backend's neighbour sums on each instruction
+    // set this CPU supports, and each one's drift from the scalar run. Needs no GL context.
+    void CpuInstructionSets(unsigned int particles);
+    // Steps per second of the CPU backend's gather and half-shell pair traversals on the best
+    // instruction set, with one thread and with every hardware thread, and the half shell's drift
+    // from the gather. Needs no GL context.
+    void CpuPairTraversal(unsigned int particles);
+    // Steps per second of the CPU backend on every hardware thread (at least two) without NUMA
+    // slabs, with one slab per OS node and with two slabs, each with and without huge pages,
+    // plus the estimated remote read share, the pages found off their slab's node and the drift
+    // from the run without slabs. Needs no GL context.
+    void CpuNumaSlabs(unsigned int particles);
+    // Steps per second of the CPU backend with and without the deterministic mode for 1, 8, 64
+    // and every hardware thread, and whether each run's final state matches the single-threaded
+    // run of its mode bit for bit. Needs no GL context.
+    void CpuDeterminism(unsigned int particles);
+    // Steps per second of the CPU backend in single, mixed and double precision with one thread
+    // and with every hardware thread, each one's cost against single precision and its drift from
+    // the double precision run. Deterministic, so the drift is the precision's alone. Needs no GL
+    // context.
+    void CpuPrecisions(unsigned int particles);
+    // Milliseconds per step and nanoseconds per particle step of the out-of-core solver on the dam
+    // break for particles / 64, / 16, / 4 and particles, with tile files in directory, plus the
+    // share of the files in the page cache, the halo and migration shares and, for runs small
+    // enough, the drift from the in-memory CPU backend. The smoothing radius, mass and timestep
+    // bounds follow the spacing. Needs no GL context.
+    void OutOfCore(unsigned int particles, const std::string& directory, unsigned int tileParticles, unsigned int threads);
+}
@@ -0,0 +1,178 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include "glm.hpp"
+#include "Simulation.h"
+#include "CpuKernels.h"
+
+// The per-particle remainder of physics.comp's force pass on the CPU: surface tension, mouse,
+// walls, integration and the NaN guard, from a particle's CpuForceSums; and the parameters the
+// neighbour sums read. Shared by the in-memory solver (CpuSolver.h) and the out-of-core one
+// (OutOfCoreSolver.h), so both step alike.
+namespace CpuIntegration {
+    // hashBits() and random() of physics.comp, for the NaN guard: bit for bit the GPU's values
+    inline uint32_t HashBits(uint32_t v) {
+        uint32_t state = v * 747796405u + 2891336453u;
+        uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+        return (word >> 22u) ^ word;
+    }
+
+    inline float HashRandom(float x, float y) {
+        uint32_t bitsX, bitsY;
+        std::memcpy(&bitsX, &x, sizeof(x));
+        std::memcpy(&bitsY, &y, sizeof(y));
+        return static_cast<float>(HashBits(bitsX ^ HashBits(bitsY)) >> 8u) * (1.0f / 16777216.0f);
+    }
+
+    template <typename T>
+    bool IsFinite(T x, T y) {
+        return std::isfinite(x) && std::isfinite(y);
+    }
+
+    const float MAX_SURFACE_FORCE = 5000.0f;
+    const float MOUSE_RADIUS = 0.19f;
+    const float MOUSE_FORCE = 150.0f;
+
+    // sim's parameters of the neighbour sums into data; the arrays are the caller's
+    template <typename Storage, typename Accum>
+    void SetParameters(CpuNeighbourData<Storage, Accum>& data, const Simulation& sim) {
+        float h = sim.smoothingRadius;
+        data.smoothingRadius = h;
+        data.particleMass = sim.particleMass;
+        Kernels::WithFamily(sim.kernelFamily, [&](auto kernels) {
+            using Sph = decltype(kernels);
+            data.densityScale = Kernels::Scale(Sph::Density, h);
+            data.gradientScale = Kernels::Scale(Sph::Gradient, h);
+            data.laplacianScale = Kernels::Scale(Sph::Laplacian, h);
+        });
+        data.surfaceScale = Kernels::Scale(Kernels::SurfaceColor, h);
+        data.viscosityConstant = sim.viscosityConstant;
+        data.pressureMultiplier = sim.pressureMultiplier;
+    }
+
+    // Per-thread max |v|, max |a| and NaN resets of the force pass
+    struct alignas(64) Reduction {  // one cache line each
+        float maxSpeed;
+        float maxAccel;
+        unsigned int nanResets;
+    };
+
+    // One force pass's parameters in the accumulation type, converted once, and the step of
+    // each particle
+    template <typename Accum>
+    class ParticleStep {
+    public:
+        using Vec2 = glm::vec<2, Accum>;
+
+        ParticleStep(const Simulation& sim, Accum dt, Accum previousDt, bool mouseDown, glm::vec2 mouse, float boundaryLimit)
+            : dt(dt), previousDt(previousDt), leapfrog(sim.integrator == Integrator::Leapfrog),
+              projection(sim.boundaryMode == BoundaryMode::Projection), mouseDown(mouseDown), mouseAt(mouse),
+              limit(boundaryLimit), boundaryRadius(Accum(sim.smoothingRadius) * Accum(0.000005f)),
+              damping(std::clamp(Accum(1) - Accum(sim.globalDamping) * dt, Accum(0), Accum(1))),
+              surfaceThreshold(sim.surfaceThreshold), surfaceTension(sim.surfaceTension),
+              boundaryStiffness(sim.boundaryStiffness), boundaryRestitution(sim.boundaryRestitution),
+              gravity(sim.gravityStrength) {}
+
+        // Advances one particle by dt from its neighbour sums, folding its speed and
+        // acceleration into reduction. A position that is not finite restarts at rest at the
+        // origin; a velocity that turns non-finite restarts at a hashed position, as on the GPU.
+        void Advance(Vec2& pos_i, Vec2& vel_i, const CpuForceSums<Accum>& sums, Reduction& reduction) const {
+            if (!IsFinite(pos_i.x, pos_i.y)) {
+                pos_i = Vec2(0);
+                vel_i = Vec2(0);
+            }
+            Vec2 forcePressure(sums.pressureX, sums.pressureY);
+            Vec2 forceViscosity(sums.viscosityX, sums.viscosityY);
+            Vec2 colorFieldGrad(sums.colorGradX, sums.colorGradY);
+            Accum colorFieldLaplacian = sums.colorLaplacian;
+
+            Vec2 forceSurface(0);
+            Accum gradLength = glm::length(colorFieldGrad);
+            if (gradLength > Accum(0) && gradLength > surfaceThreshold) {
+                Accum curvature = colorFieldLaplacian / (gradLength + Accum(1e-2f));
+                forceSurface = surfaceTension * curvature * colorFieldGrad;
+                Accum surfaceLength = glm::length(forceSurface);
+                if (surfaceLength > Accum(MAX_SURFACE_FORCE)) {
+                    forceSurface *= Accum(MAX_SURFACE_FORCE) / surfaceLength;
+                }
+            }
+
+            Vec2 forceMouse(0);
+            if (mouseDown) {
+                Vec2 fromMouse = pos_i - mouseAt;
+                Accum distToMouse = glm::length(fromMouse);
+                if (distToMouse < Accum(MOUSE_RADIUS) && distToMouse > Accum(0)) {
+                    forceMouse = fromMouse / distToMouse * (Accum(MOUSE_FORCE) * (Accum(1) - distToMouse / Accum(MOUSE_RADIUS)));
+                }
+            }
+
+            Vec2 forceBoundary(0);
+            if (!projection) {
+                Accum penetrationLeft = boundaryRadius - (pos_i.x + limit);
+                Accum penetrationRight = boundaryRadius - (limit - pos_i.x);
+                Accum penetrationBottom = boundaryRadius - (pos_i.y + limit);
+                Accum penetrationTop = boundaryRadius - (limit - pos_i.y);
+                if (penetrationLeft > Accum(0)) forceBoundary.x += boundaryStiffness * penetrationLeft;
+                if (penetrationRight > Accum(0)) forceBoundary.x -= boundaryStiffness * penetrationRight;
+                if (penetrationBottom > Accum(0)) forceBoundary.y += boundaryStiffness * penetrationBottom;
+                if (penetrationTop > Accum(0)) forceBoundary.y -= boundaryStiffness * penetrationTop;
+            }
+
+            Vec2 acceleration = forcePressure + forceViscosity + forceSurface + forceMouse + forceBoundary
+                              + Vec2(Accum(0), -gravity);
+
+            Accum speed;
+            if (leapfrog) {
+                vel_i += acceleration * (Accum(0.5f) * previousDt);
+                vel_i *= damping;
+                speed = glm::length(vel_i);
+                vel_i += acceleration * (Accum(0.5f) * dt);
+                pos_i += vel_i * dt;
+            }
+            else {
+                vel_i *= damping;
+                vel_i += acceleration * dt;
+                pos_i += vel_i * dt;
+                speed = glm::length(vel_i);
+            }
+
+            if (projection) {
+                Vec2 clamped = glm::clamp(pos_i, Vec2(-limit), Vec2(limit));
+                Vec2 outward = pos_i - clamped;
+                if (outward.x * vel_i.x > Accum(0)) vel_i.x *= -boundaryRestitution;
+                if (outward.y * vel_i.y > Accum(0)) vel_i.y *= -boundaryRestitution;
+                pos_i = clamped;
+            }
+
+            if (!IsFinite(vel_i.x, vel_i.y)) {
+                // The hash reads float bits, as on the GPU
+                float x = static_cast<float>(pos_i.x), y = static_cast<float>(pos_i.y);
+                vel_i = Vec2(0);
+                pos_i = Vec2(HashRandom(x, y), HashRandom(x + 0.5f, y + 0.5f));
+                ++reduction.nanResets;
+            }
+
+            float accelMag = static_cast<float>(glm::length(acceleration));
+            if (std::isfinite(speed)) reduction.maxSpeed = std::max(reduction.maxSpeed, static_cast<float>(speed));
+            if (std::isfinite(accelMag)) reduction.maxAccel = std::max(reduction.maxAccel, accelMag);
+        }
+
+    private:
+        Accum dt;
+        Accum previousDt;
+        bool leapfrog;
+        bool projection;
+        bool mouseDown;
+        Vec2 mouseAt;
+        Accum limit;
+        Accum boundaryRadius;
+        Accum damping;
+        Accum surfaceThreshold;
+        Accum surfaceTension;
+        Accum boundaryStiffness;
+        Accum boundaryRestitution;
+        Accum gravity;
+    };
+}
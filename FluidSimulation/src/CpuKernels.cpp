@@ -0,0 +1,149 @@
+#include "CpuKernels.h"
+#include "CpuNeighbourSums.h"
+#include <cmath>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define CPU_KERNELS_X86 1
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+namespace {
+    // One value at a time, for CPUs without AVX2 and as the reference for the vector kernels. The
+    // operators are friends so that literals convert to T at the call.
+    template <typename T>
+    struct ScalarLane {
+        static constexpr unsigned int WIDTH = 1;
+        using Element = T;
+        using Mask = bool;
+
+        T v;
+        ScalarLane(T x) : v(x) {}
+
+        template <typename S>
+        static ScalarLane Load(const S* p, unsigned int) { return static_cast<T>(*p); }
+        static void Store(T* p, ScalarLane x, unsigned int) { *p = x.v; }
+        static Mask LanesBelow(unsigned int lanes) { return lanes > 0; }
+
+        ScalarLane& operator+=(ScalarLane b) { v += b.v; return *this; }
+        ScalarLane& operator-=(ScalarLane b) { v -= b.v; return *this; }
+
+        friend ScalarLane operator+(ScalarLane a, ScalarLane b) { return a.v + b.v; }
+        friend ScalarLane operator-(ScalarLane a, ScalarLane b) { return a.v - b.v; }
+        friend ScalarLane operator*(ScalarLane a, ScalarLane b) { return a.v * b.v; }
+        friend ScalarLane operator/(ScalarLane a, ScalarLane b) { return a.v / b.v; }
+        friend bool operator<(ScalarLane a, ScalarLane b) { return a.v < b.v; }
+        friend bool operator>(ScalarLane a, ScalarLane b) { return a.v > b.v; }
+        friend ScalarLane Sqrt(ScalarLane a) { return std::sqrt(a.v); }
+        friend ScalarLane Min(ScalarLane a, ScalarLane b) { return a.v < b.v ? a.v : b.v; }
+        friend ScalarLane Select(bool mask, ScalarLane a, ScalarLane b) { return mask ? a : b; }
+        friend T ReduceAdd(ScalarLane a) { return a.v; }
+    };
+
+    struct CpuFeatures {
+        bool avx2 = false;    // AVX2 + FMA, with the OS saving the YMM registers
+        bool avx512 = false;  // AVX-512F, with the OS saving the ZMM and mask registers
+    };
+
+    CpuFeatures QueryCpuFeatures() {
+        CpuFeatures features;
+#ifdef CPU_KERNELS_X86
+        auto cpuid = [](unsigned int leaf, unsigned int subleaf, unsigned int registers[4]) {
+#if defined(_MSC_VER)
+            int values[4];
+            __cpuidex(values, static_cast<int>(leaf), static_cast<int>(subleaf));
+            for (int r = 0; r < 4; ++r) registers[r] = static_cast<unsigned int>(values[r]);
+#else
+            __cpuid_count(leaf, subleaf, registers[0], registers[1], registers[2], registers[3]);
+#endif
+        };
+
+        unsigned int leaf0[4], leaf1[4], leaf7[4] = { 0, 0, 0, 0 };
+        cpuid(0, 0, leaf0);
+        cpuid(1, 0, leaf1);
+        if (leaf0[0] >= 7) cpuid(7, 0, leaf7);
+
+        bool osxsave = (leaf1[2] & (1u << 27)) != 0;
+        bool avx = (leaf1[2] & (1u << 28)) != 0;
+        bool fma = (leaf1[2] & (1u << 12)) != 0;
+        unsigned long long xcr0 = 0;
+        if (osxsave) {
+#if defined(_MSC_VER)
+            xcr0 = _xgetbv(0);
+#else
+            unsigned int eax, edx;
+            __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+            xcr0 = (static_cast<unsigned long long>(edx) << 32) | eax;
+#endif
+        }
+        bool ymmState = (xcr0 & 0x6) == 0x6;    // SSE and AVX state
+        bool zmmState = (xcr0 & 0xE6) == 0xE6;  // ... plus opmask and both ZMM halves
+
+        features.avx2 = avx && fma && ymmState && (leaf7[1] & (1u << 5)) != 0;
+        features.avx512 = zmmState && (leaf7[1] & (1u << 16)) != 0;
+#endif
+        return features;
+    }
+
+    const CpuFeatures& GetCpuFeatures() {
+        static const CpuFeatures features = QueryCpuFeatures();
+        return features;
+    }
+}
+
+bool CpuKernels::IsSupported(CpuIsa isa) {
+    switch (isa) {
+    case CpuIsa::Scalar: return true;
+    case CpuIsa::AVX2: return GetCpuFeatures().avx2 && GetAvx2<float, float>(KernelFamily::Poly6Spiky).density != nullptr;
+    case CpuIsa::AVX512: return GetCpuFeatures().avx512 && GetAvx512<float, float>(KernelFamily::Poly6Spiky).density != nullptr;
+    default: return false;
+    }
+}
+
+CpuIsa CpuKernels::Detect() {
+    if (IsSupported(CpuIsa::AVX512)) return CpuIsa::AVX512;
+    if (IsSupported(CpuIsa::AVX2)) return CpuIsa::AVX2;
+    return CpuIsa::Scalar;
+}
+
+CpuIsa CpuKernels::Resolve(CpuIsa isa) {
+    return isa != CpuIsa::Auto && IsSupported(isa) ? isa : Detect();
+}
+
+const char* CpuKernels::Name(CpuIsa isa) {
+    switch (isa) {
+    case CpuIsa::Scalar: return "scalar";
+    case CpuIsa::AVX2: return "AVX2";
+    case CpuIsa::AVX512: return "AVX-512";
+    default: return "auto";
+    }
+}
+
+const char* CpuKernels::Name(CpuPrecision precision) {
+    switch (precision) {
+    case CpuPrecision::Mixed: return "mixed";
+    case CpuPrecision::Double: return "double";
+    default: return "single";
+    }
+}
+
+template <typename Storage, typename Accum>
+CpuKernelSet<Storage, Accum> CpuKernels::Get(CpuIsa isa, KernelFamily family) {
+    switch (Resolve(isa)) {
+    case CpuIsa::AVX512: return GetAvx512<Storage, Accum>(family);
+    case CpuIsa::AVX2: return GetAvx2<Storage, Accum>(family);
+    default: return GetScalar<Storage, Accum>(family);
+    }
+}
+
+template <typename Storage, typename Accum>
+CpuKernelSet<Storage, Accum> CpuKernels::GetScalar(KernelFamily family) {
+    return CpuNeighbourSums::KernelSet<ScalarLane<Accum>, Storage>(CpuIsa::Scalar, family);
+}
+
+template CpuKernelSet<float, float> CpuKernels::Get<float, float>(CpuIsa, KernelFamily);
+template CpuKernelSet<float, double> CpuKernels::Get<float, double>(CpuIsa, KernelFamily);
+template CpuKernelSet<double, double> CpuKernels::Get<double, double>(CpuIsa, KernelFamily);
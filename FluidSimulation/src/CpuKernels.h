@@ -0,0 +1,110 @@
+#pragma once
+#include "Kernels.h"
+
+// Instruction sets of the CPU backend's neighbour sums. Auto picks the widest one the CPU (and
+// the OS, for the AVX register state) supports.
+enum class CpuIsa {
+    Auto = 0,
+    Scalar = 1,
+    AVX2 = 2,   // 8 neighbours per instruction (4 in double); with FMA
+    AVX512 = 3  // 16 neighbours per instruction (8 in double); AVX-512F only
+};
+
+// Scalar types of the CPU backend, chosen at Init. Storage is the type of the particle arrays,
+// accumulation the type the neighbour sums and the integration compute in.
+enum class CpuPrecision {
+    Single = 0,  // float storage and sums
+    Mixed = 1,   // float storage, double sums and integration
+    Double = 2   // double storage and sums
+};
+
+// The cell-ordered particle arrays and the parameters the neighbour sums read. Every particle's
+// neighbours lie in three contiguous runs of the arrays, one per row of the 3x3 cells around it.
+// The arrays hold Storage values; the parameters, like the sums, are in Accum.
+template <typename Storage, typename Accum>
+struct CpuNeighbourData {
+    const Storage* posX;
+    const Storage* posY;
+    const Storage* velX;
+    const Storage* velY;
+    const Storage* densities;
+    const Storage* pressures;
+    const unsigned int* particleCells;
+    const unsigned int* cellStart;
+    unsigned int gridDim;
+
+    Accum smoothingRadius;
+    Accum particleMass;
+    Accum densityScale;
+    Accum gradientScale;
+    Accum laplacianScale;
+    Accum surfaceScale;
+    Accum viscosityConstant;
+    Accum pressureMultiplier;
+};
+
+// The neighbour terms of physics.comp for one particle; the rest of the force pass is per particle
+template <typename Accum>
+struct CpuForceSums {
+    Accum pressureX, pressureY;
+    Accum viscosityX, viscosityY;
+    Accum colorGradX, colorGradY;
+    Accum colorLaplacian;
+};
+
+// Per-particle arrays of the CpuForceSums terms, summed into by the half-shell force pass
+template <typename Accum>
+struct CpuForceArrays {
+    Accum* pressureX;
+    Accum* pressureY;
+    Accum* viscosityX;
+    Accum* viscosityY;
+    Accum* colorGradX;
+    Accum* colorGradY;
+    Accum* colorLaplacian;
+};
+
+// Neighbour sums of one kernel family on one instruction set. Instantiated for the three
+// CpuPrecision pairs: <float, float>, <float, double> and <double, double>.
+template <typename Storage, typename Accum>
+struct CpuKernelSet {
+    using Data = CpuNeighbourData<Storage, Accum>;
+
+    CpuIsa isa;
+    // Gather: density of particle i, its own contribution included
+    Accum (*density)(const Data& data, unsigned int i);
+    void (*forces)(const Data& data, unsigned int i, CpuForceSums<Accum>& sums);
+
+    // Half-shell: evaluates each pair of i with its later neighbours once and adds the result to
+    // both particles' entries, so a pass over every particle visits every pair once. The later
+    // neighbours are the rest of i's cell and the next cell of its row, and the three cells of
+    // the row above. Rows two apart never share an entry.
+    // densityHalf adds kernel values before the mass and scale (and i's own contribution).
+    void (*densityHalf)(const Data& data, unsigned int i, Accum* kernelSums);
+    void (*forcesHalf)(const Data& data, unsigned int i, const CpuForceArrays<Accum>& sums);
+};
+
+namespace CpuKernels {
+    // Whether this build has the instruction set's kernels and the CPU can run them
+    bool IsSupported(CpuIsa isa);
+    // The widest supported instruction set, from CPUID
+    CpuIsa Detect();
+    // isa if supported, else (and for Auto) Detect()
+    CpuIsa Resolve(CpuIsa isa);
+    const char* Name(CpuIsa isa);
+    const char* Name(CpuPrecision precision);
+    // The kernels of family on Resolve(isa)
+    template <typename Storage, typename Accum>
+    CpuKernelSet<Storage, Accum> Get(CpuIsa isa, KernelFamily family);
+
+    // Each instruction set's kernels; density is null when the build lacks the instruction set.
+    // The AVX translation units are compiled with their instruction set enabled (see the project
+    // file), and only the dispatch above calls into them. Each one instantiates the three
+    // precisions, with double lanes (half as many per instruction) when Accum is double.
+    template <typename Storage, typename Accum>
+    CpuKernelSet<Storage, Accum> GetScalar(KernelFamily family);
+    template <typename Storage, typename Accum>
+    CpuKernelSet<Storage, Accum> GetAvx2(KernelFamily family);
+    template <typename Storage, typename Accum>
+    CpuKernelSet<Storage, Accum> GetAvx512(KernelFamily family);
+}
@@ -0,0 +1,126 @@
+// Compiled with AVX2 enabled (/arch:AVX2); only called once CPUID has reported AVX2 and FMA.
+#include "CpuKernels.h"
+#include <type_traits>
+
+#if defined(__AVX2__)
+#include "CpuNeighbourSums.h"
+#include <immintrin.h>
+
+namespace {
+    struct Avx2Mask {
+        __m256 m;
+    };
+
+    struct Avx2Float {
+        static constexpr unsigned int WIDTH = 8;
+        using Element = float;
+        using Mask = Avx2Mask;
+
+        __m256 v;
+        Avx2Float(__m256 x) : v(x) {}
+        Avx2Float(float x) : v(_mm256_set1_ps(x)) {}
+
+        static Mask LanesBelow(unsigned int lanes) {
+            __m256i index = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+            return { _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32(static_cast<int>(lanes)), index)) };
+        }
+        // The masked load leaves the lanes past the run unread, so no padding is needed
+        static Avx2Float Load(const float* p, unsigned int lanes) {
+            if (lanes == WIDTH) return _mm256_loadu_ps(p);
+            return _mm256_maskload_ps(p, _mm256_castps_si256(LanesBelow(lanes).m));
+        }
+        static void Store(float* p, Avx2Float x, unsigned int lanes) {
+            if (lanes == WIDTH) _mm256_storeu_ps(p, x.v);
+            else _mm256_maskstore_ps(p, _mm256_castps_si256(LanesBelow(lanes).m), x.v);
+        }
+
+        Avx2Float& operator+=(Avx2Float b) { v = _mm256_add_ps(v, b.v); return *this; }
+        Avx2Float& operator-=(Avx2Float b) { v = _mm256_sub_ps(v, b.v); return *this; }
+    };
+
+    inline Avx2Mask operator&(Avx2Mask a, Avx2Mask b) { return { _mm256_and_ps(a.m, b.m) }; }
+    inline Avx2Float operator+(Avx2Float a, Avx2Float b) { return _mm256_add_ps(a.v, b.v); }
+    inline Avx2Float operator-(Avx2Float a, Avx2Float b) { return _mm256_sub_ps(a.v, b.v); }
+    inline Avx2Float operator*(Avx2Float a, Avx2Float b) { return _mm256_mul_ps(a.v, b.v); }
+    inline Avx2Float operator/(Avx2Float a, Avx2Float b) { return _mm256_div_ps(a.v, b.v); }
+    inline Avx2Mask operator<(Avx2Float a, Avx2Float b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ) }; }
+    inline Avx2Mask operator>(Avx2Float a, Avx2Float b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ) }; }
+    inline Avx2Float Sqrt(Avx2Float a) { return _mm256_sqrt_ps(a.v); }
+    inline Avx2Float Min(Avx2Float a, Avx2Float b) { return _mm256_min_ps(a.v, b.v); }
+    inline Avx2Float Select(Avx2Mask mask, Avx2Float a, Avx2Float b) { return _mm256_blendv_ps(b.v, a.v, mask.m); }
+    inline float ReduceAdd(Avx2Float a) {
+        __m128 sum = _mm_add_ps(_mm256_castps256_ps128(a.v), _mm256_extractf128_ps(a.v, 1));
+        sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+        sum = _mm_add_ss(sum, _mm_movehdup_ps(sum));
+        return _mm_cvtss_f32(sum);
+    }
+
+    // Four doubles, for the mixed and double precisions
+    struct Avx2DoubleMask {
+        __m256d m;
+    };
+
+    struct Avx2Double {
+        static constexpr unsigned int WIDTH = 4;
+        using Element = double;
+        using Mask = Avx2DoubleMask;
+
+        __m256d v;
+        Avx2Double(__m256d x) : v(x) {}
+        Avx2Double(double x) : v(_mm256_set1_pd(x)) {}
+
+        static Mask LanesBelow(unsigned int lanes) {
+            __m256i index = _mm256_setr_epi64x(0, 1, 2, 3);
+            return { _mm256_castsi256_pd(_mm256_cmpgt_epi64(_mm256_set1_epi64x(lanes), index)) };
+        }
+        static Avx2Double Load(const double* p, unsigned int lanes) {
+            if (lanes == WIDTH) return _mm256_loadu_pd(p);
+            return _mm256_maskload_pd(p, _mm256_castpd_si256(LanesBelow(lanes).m));
+        }
+        // Float arrays widen as they load
+        static Avx2Double Load(const float* p, unsigned int lanes) {
+            if (lanes == WIDTH) return _mm256_cvtps_pd(_mm_loadu_ps(p));
+            __m128i mask = _mm_cmpgt_epi32(_mm_set1_epi32(static_cast<int>(lanes)), _mm_setr_epi32(0, 1, 2, 3));
+            return _mm256_cvtps_pd(_mm_maskload_ps(p, mask));
+        }
+        static void Store(double* p, Avx2Double x, unsigned int lanes) {
+            if (lanes == WIDTH) _mm256_storeu_pd(p, x.v);
+            else _mm256_maskstore_pd(p, _mm256_castpd_si256(LanesBelow(lanes).m), x.v);
+        }
+
+        Avx2Double& operator+=(Avx2Double b) { v = _mm256_add_pd(v, b.v); return *this; }
+        Avx2Double& operator-=(Avx2Double b) { v = _mm256_sub_pd(v, b.v); return *this; }
+    };
+
+    inline Avx2DoubleMask operator&(Avx2DoubleMask a, Avx2DoubleMask b) { return { _mm256_and_pd(a.m, b.m) }; }
+    inline Avx2Double operator+(Avx2Double a, Avx2Double b) { return _mm256_add_pd(a.v, b.v); }
+    inline Avx2Double operator-(Avx2Double a, Avx2Double b) { return _mm256_sub_pd(a.v, b.v); }
+    inline Avx2Double operator*(Avx2Double a, Avx2Double b) { return _mm256_mul_pd(a.v, b.v); }
+    inline Avx2Double operator/(Avx2Double a, Avx2Double b) { return _mm256_div_pd(a.v, b.v); }
+    inline Avx2DoubleMask operator<(Avx2Double a, Avx2Double b) { return { _mm256_cmp_pd(a.v, b.v, _CMP_LT_OQ) }; }
+    inline Avx2DoubleMask operator>(Avx2Double a, Avx2Double b) { return { _mm256_cmp_pd(a.v, b.v, _CMP_GT_OQ) }; }
+    inline Avx2Double Sqrt(Avx2Double a) { return _mm256_sqrt_pd(a.v); }
+    inline Avx2Double Min(Avx2Double a, Avx2Double b) { return _mm256_min_pd(a.v, b.v); }
+    inline Avx2Double Select(Avx2DoubleMask mask, Avx2Double a, Avx2Double b) { return _mm256_blendv_pd(b.v, a.v, mask.m); }
+    inline double ReduceAdd(Avx2Double a) {
+        __m128d sum = _mm_add_pd(_mm256_castpd256_pd128(a.v), _mm256_extractf128_pd(a.v, 1));
+        sum = _mm_add_sd(sum, _mm_unpackhi_pd(sum, sum));
+        return _mm_cvtsd_f64(sum);
+    }
+}
+
+template <typename Storage, typename Accum>
+CpuKernelSet<Storage, Accum> CpuKernels::GetAvx2(KernelFamily family) {
+    using V = std::conditional_t<std::is_same_v<Accum, double>, Avx2Double, Avx2Float>;
+    return CpuNeighbourSums::KernelSet<V, Storage>(CpuIsa::AVX2, family);
+}
+#else
+template <typename Storage, typename Accum>
+CpuKernelSet<Storage, Accum> CpuKernels::GetAvx2(KernelFamily) {
+    return CpuKernelSet<Storage, Accum>{ CpuIsa::AVX2, nullptr, nullptr, nullptr, nullptr };
+}
+#endif
+
+template CpuKernelSet<float, float> CpuKernels::GetAvx2<float, float>(KernelFamily);
+template CpuKernelSet<float, double> CpuKernels::GetAvx2<float, double>(KernelFamily);
+template CpuKernelSet<double, double> CpuKernels::GetAvx2<double, double>(KernelFamily);
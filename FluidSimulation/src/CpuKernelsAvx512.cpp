@@ -0,0 +1,110 @@
+// Compiled with AVX-512 enabled (/arch:AVX512); only called once CPUID has reported AVX-512F.
+#include "CpuKernels.h"
+#include <type_traits>
+
+#if defined(__AVX512F__)
+#include "CpuNeighbourSums.h"
+#include <immintrin.h>
+
+namespace {
+    struct Avx512Mask {
+        __mmask16 m;
+    };
+
+    struct Avx512Float {
+        static constexpr unsigned int WIDTH = 16;
+        using Element = float;
+        using Mask = Avx512Mask;
+
+        __m512 v;
+        Avx512Float(__m512 x) : v(x) {}
+        Avx512Float(float x) : v(_mm512_set1_ps(x)) {}
+
+        static Mask LanesBelow(unsigned int lanes) { return { static_cast<__mmask16>((1u << lanes) - 1u) }; }
+        // The masked load leaves the lanes past the run unread, so no padding is needed
+        static Avx512Float Load(const float* p, unsigned int lanes) {
+            if (lanes == WIDTH) return _mm512_loadu_ps(p);
+            return _mm512_maskz_loadu_ps(LanesBelow(lanes).m, p);
+        }
+        static void Store(float* p, Avx512Float x, unsigned int lanes) {
+            if (lanes == WIDTH) _mm512_storeu_ps(p, x.v);
+            else _mm512_mask_storeu_ps(p, LanesBelow(lanes).m, x.v);
+        }
+
+        Avx512Float& operator+=(Avx512Float b) { v = _mm512_add_ps(v, b.v); return *this; }
+        Avx512Float& operator-=(Avx512Float b) { v = _mm512_sub_ps(v, b.v); return *this; }
+    };
+
+    inline Avx512Mask operator&(Avx512Mask a, Avx512Mask b) { return { static_cast<__mmask16>(a.m & b.m) }; }
+    inline Avx512Float operator+(Avx512Float a, Avx512Float b) { return _mm512_add_ps(a.v, b.v); }
+    inline Avx512Float operator-(Avx512Float a, Avx512Float b) { return _mm512_sub_ps(a.v, b.v); }
+    inline Avx512Float operator*(Avx512Float a, Avx512Float b) { return _mm512_mul_ps(a.v, b.v); }
+    inline Avx512Float operator/(Avx512Float a, Avx512Float b) { return _mm512_div_ps(a.v, b.v); }
+    inline Avx512Mask operator<(Avx512Float a, Avx512Float b) { return { _mm512_cmp_ps_mask(a.v, b.v, _CMP_LT_OQ) }; }
+    inline Avx512Mask operator>(Avx512Float a, Avx512Float b) { return { _mm512_cmp_ps_mask(a.v, b.v, _CMP_GT_OQ) }; }
+    inline Avx512Float Sqrt(Avx512Float a) { return _mm512_sqrt_ps(a.v); }
+    inline Avx512Float Min(Avx512Float a, Avx512Float b) { return _mm512_min_ps(a.v, b.v); }
+    inline Avx512Float Select(Avx512Mask mask, Avx512Float a, Avx512Float b) { return _mm512_mask_blend_ps(mask.m, b.v, a.v); }
+    inline float ReduceAdd(Avx512Float a) { return _mm512_reduce_add_ps(a.v); }
+
+    // Eight doubles, for the mixed and double precisions
+    struct Avx512DoubleMask {
+        __mmask8 m;
+    };
+
+    struct Avx512Double {
+        static constexpr unsigned int WIDTH = 8;
+        using Element = double;
+        using Mask = Avx512DoubleMask;
+
+        __m512d v;
+        Avx512Double(__m512d x) : v(x) {}
+        Avx512Double(double x) : v(_mm512_set1_pd(x)) {}
+
+        static Mask LanesBelow(unsigned int lanes) { return { static_cast<__mmask8>((1u << lanes) - 1u) }; }
+        static Avx512Double Load(const double* p, unsigned int lanes) {
+            if (lanes == WIDTH) return _mm512_loadu_pd(p);
+            return _mm512_maskz_loadu_pd(LanesBelow(lanes).m, p);
+        }
+        // Float arrays widen as they load; the 512-bit masked load keeps to AVX-512F
+        static Avx512Double Load(const float* p, unsigned int lanes) {
+            __m512 floats = _mm512_maskz_loadu_ps(static_cast<__mmask16>((1u << lanes) - 1u), p);
+            return _mm512_cvtps_pd(_mm512_castps512_ps256(floats));
+        }
+        static void Store(double* p, Avx512Double x, unsigned int lanes) {
+            if (lanes == WIDTH) _mm512_storeu_pd(p, x.v);
+            else _mm512_mask_storeu_pd(p, LanesBelow(lanes).m, x.v);
+        }
+
+        Avx512Double& operator+=(Avx512Double b) { v = _mm512_add_pd(v, b.v); return *this; }
+        Avx512Double& operator-=(Avx512Double b) { v = _mm512_sub_pd(v, b.v); return *this; }
+    };
+
+    inline Avx512DoubleMask operator&(Avx512DoubleMask a, Avx512DoubleMask b) { return { static_cast<__mmask8>(a.m & b.m) }; }
+    inline Avx512Double operator+(Avx512Double a, Avx512Double b) { return _mm512_add_pd(a.v, b.v); }
+    inline Avx512Double operator-(Avx512Double a, Avx512Double b) { return _mm512_sub_pd(a.v, b.v); }
+    inline Avx512Double operator*(Avx512Double a, Avx512Double b) { return _mm512_mul_pd(a.v, b.v); }
+    inline Avx512Double operator/(Avx512Double a, Avx512Double b) { return _mm512_div_pd(a.v, b.v); }
+    inline Avx512DoubleMask operator<(Avx512Double a, Avx512Double b) { return { _mm512_cmp_pd_mask(a.v, b.v, _CMP_LT_OQ) }; }
+    inline Avx512DoubleMask operator>(Avx512Double a, Avx512Double b) { return { _mm512_cmp_pd_mask(a.v, b.v, _CMP_GT_OQ) }; }
+    inline Avx512Double Sqrt(Avx512Double a) { return _mm512_sqrt_pd(a.v); }
+    inline Avx512Double Min(Avx512Double a, Avx512Double b) { return _mm512_min_pd(a.v, b.v); }
+    inline Avx512Double Select(Avx512DoubleMask mask, Avx512Double a, Avx512Double b) { return _mm512_mask_blend_pd(mask.m, b.v, a.v); }
+    inline double ReduceAdd(Avx512Double a) { return _mm512_reduce_add_pd(a.v); }
+}
+
+template <typename Storage, typename Accum>
+CpuKernelSet<Storage, Accum> CpuKernels::GetAvx512(KernelFamily family) {
+    using V = std::conditional_t<std::is_same_v<Accum, double>, Avx512Double, Avx512Float>;
+    return CpuNeighbourSums::KernelSet<V, Storage>(CpuIsa::AVX512, family);
+}
+#else
+template <typename Storage, typename Accum>
+CpuKernelSet<Storage, Accum> CpuKernels::GetAvx512(KernelFamily) {
+    return CpuKernelSet<Storage, Accum>{ CpuIsa::AVX512, nullptr, nullptr, nullptr, nullptr };
+}
+#endif
+
+template CpuKernelSet<float, float> CpuKernels::GetAvx512<float, float>(KernelFamily);
+template CpuKernelSet<float, double> CpuKernels::GetAvx512<float, double>(KernelFamily);
+template CpuKernelSet<double, double> CpuKernels::GetAvx512<double, double>(KernelFamily);
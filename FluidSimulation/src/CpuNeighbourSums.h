@@ -0,0 +1,264 @@
+#pragma once
+#include "CpuKernels.h"
+
+// The CPU backend's neighbour sums, written once over a vector type V of V::WIDTH lanes of
+// V::Element and instantiated by each instruction set's translation unit with its own V.
+// Neighbours are visited V::WIDTH at a time straight from the cell-ordered arrays; the support
+// test and the tail of each run are lane masks, and masked-out lanes add zero instead of
+// branching. The sums compute in V::Element (the accumulation type) whatever the arrays hold.
+//
+// V provides: WIDTH; Element; a Mask type with &; construction from Element; + - * / and < >
+// giving a Mask; Load(pointer, lanes) from float and from Element arrays, converting, with the
+// lanes past `lanes` zeroed and not read; Store(pointer, v, lanes) to an Element array, writing
+// only the first `lanes`; LanesBelow(lanes);
+// and the free functions Sqrt, Min, Select(mask, a, b) and ReduceAdd.
+//
+// Every instruction set's unit must keep its own copy of everything here: if the units shared an
+// inline function (say, the float shapes of Kernels.h), the linker could keep an AVX-512 unit's
+// copy for the scalar unit, which would fault on CPUs without it. So the namespace is anonymous,
+// each unit declares its V in an anonymous namespace as well, and the sums reach the kernel
+// shapes only through Shapes, which takes V alone: a scalar argument converts to V instead of
+// instantiating the shared shapes.
+namespace {
+namespace CpuNeighbourSums {
+    template <typename V, typename Sph>
+    struct Shapes {
+        static V DensityShape(V q) { return Sph::DensityShape(q); }
+        static V GradientShape(V q) { return Sph::GradientShape(q); }
+        static V LaplacianShape(V q) { return Sph::LaplacianShape(q); }
+    };
+
+    // Calls block(first, lanes) over the neighbour candidates of particle i: the three rows of
+    // the 3x3 cells around it, each a contiguous run cut into blocks of V::WIDTH
+    template <typename V, typename Data, typename Block>
+    inline void ForEachBlock(const Data& data, unsigned int i, Block&& block) {
+        int dim = static_cast<int>(data.gridDim);
+        int cx = static_cast<int>(data.particleCells[i] % data.gridDim);
+        int cy = static_cast<int>(data.particleCells[i] / data.gridDim);
+        int left = cx > 0 ? cx - 1 : 0;
+        int right = cx + 1 < dim ? cx + 1 : dim - 1;
+        int bottom = cy > 0 ? cy - 1 : 0;
+        int top = cy + 1 < dim ? cy + 1 : dim - 1;
+        for (int row = bottom; row <= top; ++row) {
+            unsigned int first = data.cellStart[row * dim + left];
+            unsigned int last = data.cellStart[row * dim + right + 1];
+            for (unsigned int j = first; j < last; j += V::WIDTH) {
+                unsigned int lanes = last - j < V::WIDTH ? last - j : V::WIDTH;
+                block(j, lanes);
+            }
+        }
+    }
+
+    // Calls block(first, lanes) over the half shell of particle i: the later particles of its
+    // cell and the next cell of its row (contiguous in cell order), then the three cells above.
+    // Every neighbouring pair is in exactly one of its two particles' half shells.
+    template <typename V, typename Data, typename Block>
+    inline void ForEachHalfShellBlock(const Data& data, unsigned int i, Block&& block) {
+        int dim = static_cast<int>(data.gridDim);
+        int cx = static_cast<int>(data.particleCells[i] % data.gridDim);
+        int cy = static_cast<int>(data.particleCells[i] / data.gridDim);
+        int left = cx > 0 ? cx - 1 : 0;
+        int right = cx + 1 < dim ? cx + 1 : dim - 1;
+        auto run = [&](unsigned int first, unsigned int last) {
+            for (unsigned int j = first; j < last; j += V::WIDTH) {
+                unsigned int lanes = last - j < V::WIDTH ? last - j : V::WIDTH;
+                block(j, lanes);
+            }
+        };
+        run(i + 1, data.cellStart[cy * dim + right + 1]);
+        if (cy + 1 < dim) {
+            run(data.cellStart[(cy + 1) * dim + left], data.cellStart[(cy + 1) * dim + right + 1]);
+        }
+    }
+
+    // Adds v to the `lanes` entries of target starting at j
+    template <typename V>
+    inline void AddTo(typename V::Element* target, unsigned int j, unsigned int lanes, V v) {
+        V::Store(target + j, V::Load(target + j, lanes) + v, lanes);
+    }
+
+    // density.comp's sum, the particle itself included
+    template <typename V, typename Sph, typename Storage, typename Accum = typename V::Element>
+    Accum Density(const CpuNeighbourData<Storage, Accum>& data, unsigned int i) {
+        V xi(data.posX[i]);
+        V yi(data.posY[i]);
+        Accum h2 = data.smoothingRadius * data.smoothingRadius;
+        V inverseH2(Accum(1) / h2);
+        V sum(0.0f);
+        ForEachBlock<V>(data, i, [&](unsigned int j, unsigned int lanes) {
+            V rx = xi - V::Load(data.posX + j, lanes);
+            V ry = yi - V::Load(data.posY + j, lanes);
+            V distSq = rx * rx + ry * ry;
+            typename V::Mask inside = V::LanesBelow(lanes) & (distSq < h2);
+            sum += Select(inside, Sph::DensityShape(Sqrt(distSq * inverseH2)), 0.0f);
+        });
+        return data.particleMass * data.densityScale * ReduceAdd(sum);
+    }
+
+    // physics.comp's neighbour loop: pressure, viscosity and the colour field's gradient and
+    // Laplacian, over the neighbours with 0 < r < h
+    template <typename V, typename Sph, typename Storage, typename Accum = typename V::Element>
+    void Forces(const CpuNeighbourData<Storage, Accum>& data, unsigned int i, CpuForceSums<Accum>& sums) {
+        Accum pressure_i = data.pressures[i];
+        if (pressure_i != pressure_i) pressure_i = Accum(0);  // NaN check, as in physics.comp
+
+        V xi(data.posX[i]);
+        V yi(data.posY[i]);
+        V vxi(data.velX[i]);
+        V vyi(data.velY[i]);
+        V pi(pressure_i);
+        V h(data.smoothingRadius);
+        V inverseH(Accum(1) / data.smoothingRadius);
+        Accum mass = data.particleMass;
+        Accum viscosityFactor = data.viscosityConstant * mass * data.laplacianScale;
+        Accum pressureFactor = mass * data.gradientScale * data.pressureMultiplier;
+
+        V pressureX(0.0f), pressureY(0.0f), viscosityX(0.0f), viscosityY(0.0f);
+        V colorGradX(0.0f), colorGradY(0.0f), colorLaplacian(0.0f);
+        ForEachBlock<V>(data, i, [&](unsigned int j, unsigned int lanes) {
+            V rx = xi - V::Load(data.posX + j, lanes);
+            V ry = yi - V::Load(data.posY + j, lanes);
+            V dist = Sqrt(rx * rx + ry * ry);
+            typename V::Mask inRange = V::LanesBelow(lanes) & (dist > 0.0f) & (dist < h);
+            // Divisions dominate the pair cost, so each pair pays for three
+            V inverseDist = 1.0f / dist;
+            V dirX = rx * inverseDist;
+            V dirY = ry * inverseDist;
+            V density_j = V::Load(data.densities + j, lanes);
+            V inverseDensity = 1.0f / (density_j + 1e-6f);
+            V q = Min(dist * inverseH, 1.0f);
+
+            V sharedPressure = 0.5f * (pi + V::Load(data.pressures + j, lanes));
+            V pressureTerm = pressureFactor * sharedPressure * inverseDensity * Sph::GradientShape(q);
+            pressureX -= Select(inRange, dirX * pressureTerm, 0.0f);
+            pressureY -= Select(inRange, dirY * pressureTerm, 0.0f);
+
+            V viscosityTerm = viscosityFactor * inverseDensity * Sph::LaplacianShape(q);
+            viscosityX += Select(inRange, (V::Load(data.velX + j, lanes) - vxi) * viscosityTerm, 0.0f);
+            viscosityY += Select(inRange, (V::Load(data.velY + j, lanes) - vyi) * viscosityTerm, 0.0f);
+
+            V t = h - dist;
+            V volume = mass / density_j;
+            V colorGrad = volume * (-3.0f * data.surfaceScale) * t * t;
+            colorGradX += Select(inRange, dirX * colorGrad, 0.0f);
+            colorGradY += Select(inRange, dirY * colorGrad, 0.0f);
+            colorLaplacian += Select(inRange, volume * (6.0f * data.surfaceScale) * t, 0.0f);
+        });
+
+        sums.pressureX = ReduceAdd(pressureX);
+        sums.pressureY = ReduceAdd(pressureY);
+        sums.viscosityX = ReduceAdd(viscosityX);
+        sums.viscosityY = ReduceAdd(viscosityY);
+        sums.colorGradX = ReduceAdd(colorGradX);
+        sums.colorGradY = ReduceAdd(colorGradY);
+        sums.colorLaplacian = ReduceAdd(colorLaplacian);
+    }
+
+    // Density's kernel values over i's half shell, added to both particles of each pair, plus
+    // i's own contribution
+    template <typename V, typename Sph, typename Storage, typename Accum = typename V::Element>
+    void DensityHalf(const CpuNeighbourData<Storage, Accum>& data, unsigned int i, Accum* kernelSums) {
+        V xi(data.posX[i]);
+        V yi(data.posY[i]);
+        Accum h2 = data.smoothingRadius * data.smoothingRadius;
+        V inverseH2(Accum(1) / h2);
+        V sum(0.0f);
+        ForEachHalfShellBlock<V>(data, i, [&](unsigned int j, unsigned int lanes) {
+            V rx = xi - V::Load(data.posX + j, lanes);
+            V ry = yi - V::Load(data.posY + j, lanes);
+            V distSq = rx * rx + ry * ry;
+            typename V::Mask inside = V::LanesBelow(lanes) & (distSq < h2);
+            V w = Select(inside, Sph::DensityShape(Sqrt(distSq * inverseH2)), 0.0f);
+            sum += w;
+            AddTo(kernelSums, j, lanes, w);
+        });
+        // The self term goes through V as well (see above)
+        kernelSums[i] += ReduceAdd(sum) + ReduceAdd(Select(V::LanesBelow(1), Sph::DensityShape(V(Accum(0))), 0.0f));
+    }
+
+    // Forces' pair terms over i's half shell. The shape functions, direction and distance are
+    // evaluated once per pair; each side then takes the other particle's density, so both
+    // particles get exactly what their gather would give them (up to summation order).
+    template <typename V, typename Sph, typename Storage, typename Accum = typename V::Element>
+    void ForcesHalf(const CpuNeighbourData<Storage, Accum>& data, unsigned int i, const CpuForceArrays<Accum>& sums) {
+        Accum pressure_i = data.pressures[i];
+        if (pressure_i != pressure_i) pressure_i = Accum(0);  // NaN check, as in physics.comp
+
+        V xi(data.posX[i]);
+        V yi(data.posY[i]);
+        V vxi(data.velX[i]);
+        V vyi(data.velY[i]);
+        V pi(pressure_i);
+        V h(data.smoothingRadius);
+        V inverseH(Accum(1) / data.smoothingRadius);
+        Accum mass = data.particleMass;
+        Accum viscosityFactor = data.viscosityConstant * mass * data.laplacianScale;
+        Accum pressureFactor = mass * data.gradientScale * data.pressureMultiplier;
+        V inverseDensity_i(Accum(1) / (Accum(data.densities[i]) + Accum(1e-6f)));
+        V volume_i(mass / Accum(data.densities[i]));
+
+        V pressureX(0.0f), pressureY(0.0f), viscosityX(0.0f), viscosityY(0.0f);
+        V colorGradX(0.0f), colorGradY(0.0f), colorLaplacian(0.0f);
+        ForEachHalfShellBlock<V>(data, i, [&](unsigned int j, unsigned int lanes) {
+            V rx = xi - V::Load(data.posX + j, lanes);
+            V ry = yi - V::Load(data.posY + j, lanes);
+            V dist = Sqrt(rx * rx + ry * ry);
+            typename V::Mask inRange = V::LanesBelow(lanes) & (dist > 0.0f) & (dist < h);
+            // Two divisions per pair here against three per pair per side in the gather. Zeroing
+            // the reciprocals outside the support keeps 0 * inf out of the masked lanes.
+            V inverseDist = Select(inRange, 1.0f / dist, 0.0f);
+            V dirX = rx * inverseDist;
+            V dirY = ry * inverseDist;
+            V density_j = V::Load(data.densities + j, lanes);
+            V inverseDensity_j = 1.0f / (density_j + 1e-6f);
+            V q = Min(dist * inverseH, 1.0f);
+
+            // r_ji = -r_ij, so j's pressure and colour gradient terms change sign
+            V sharedPressure = 0.5f * (pi + V::Load(data.pressures + j, lanes));
+            V pressureTerm = Select(inRange, pressureFactor * sharedPressure * Sph::GradientShape(q), 0.0f);
+            V pressure_iX = dirX * pressureTerm;
+            V pressure_iY = dirY * pressureTerm;
+            pressureX -= pressure_iX * inverseDensity_j;
+            pressureY -= pressure_iY * inverseDensity_j;
+            AddTo(sums.pressureX, j, lanes, pressure_iX * inverseDensity_i);
+            AddTo(sums.pressureY, j, lanes, pressure_iY * inverseDensity_i);
+
+            V viscosityTerm = Select(inRange, viscosityFactor * Sph::LaplacianShape(q), 0.0f);
+            V dvx = (V::Load(data.velX + j, lanes) - vxi) * viscosityTerm;
+            V dvy = (V::Load(data.velY + j, lanes) - vyi) * viscosityTerm;
+            viscosityX += dvx * inverseDensity_j;
+            viscosityY += dvy * inverseDensity_j;
+            AddTo(sums.viscosityX, j, lanes, 0.0f - dvx * inverseDensity_i);
+            AddTo(sums.viscosityY, j, lanes, 0.0f - dvy * inverseDensity_i);
+
+            V t = h - dist;
+            V colorGrad = Select(inRange, (-3.0f * data.surfaceScale) * t * t, 0.0f);
+            V colorLap = Select(inRange, (6.0f * data.surfaceScale) * t, 0.0f);
+            V volume_j = Select(inRange, mass / density_j, 0.0f);
+            colorGradX += dirX * colorGrad * volume_j;
+            colorGradY += dirY * colorGrad * volume_j;
+            colorLaplacian += colorLap * volume_j;
+            AddTo(sums.colorGradX, j, lanes, 0.0f - dirX * colorGrad * volume_i);
+            AddTo(sums.colorGradY, j, lanes, 0.0f - dirY * colorGrad * volume_i);
+            AddTo(sums.colorLaplacian, j, lanes, colorLap * volume_i);
+        });
+
+        sums.pressureX[i] += ReduceAdd(pressureX);
+        sums.pressureY[i] += ReduceAdd(pressureY);
+        sums.viscosityX[i] += ReduceAdd(viscosityX);
+        sums.viscosityY[i] += ReduceAdd(viscosityY);
+        sums.colorGradX[i] += ReduceAdd(colorGradX);
+        sums.colorGradY[i] += ReduceAdd(colorGradY);
+        sums.colorLaplacian[i] += ReduceAdd(colorLaplacian);
+    }
+
+    template <typename V, typename Storage>
+    CpuKernelSet<Storage, typename V::Element> KernelSet(CpuIsa isa, KernelFamily family) {
+        return Kernels::WithFamily(family, [isa](auto kernels) {
+            using Sph = Shapes<V, decltype(kernels)>;
+            return CpuKernelSet<Storage, typename V::Element>{ isa, &Density<V, Sph, Storage>, &Forces<V, Sph, Storage>,
+                                                               &DensityHalf<V, Sph, Storage>, &ForcesHalf<V, Sph, Storage> };
+        });
+    }
+}
+}
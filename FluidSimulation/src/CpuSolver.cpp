@@ -0,0 +1,474 @@
+#include "CpuSolver.h"
+#include "Kernels.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+namespace {
+    template <typename Storage, typename Accum>
+    constexpr CpuPrecision PrecisionOf() {
+        if (std::is_same_v<Storage, double>) return CpuPrecision::Double;
+        return std::is_same_v<Accum, double> ? CpuPrecision::Mixed : CpuPrecision::Single;
+    }
+}
+
+std::unique_ptr<CpuSolver> CpuSolver::Create(CpuPrecision precision, unsigned int maxParticles, unsigned int threads,
+                                             unsigned int numaNodes, bool hugePages) {
+    switch (precision) {
+    case CpuPrecision::Mixed: return std::make_unique<TypedCpuSolver<float, double>>(maxParticles, threads, numaNodes, hugePages);
+    case CpuPrecision::Double: return std::make_unique<TypedCpuSolver<double, double>>(maxParticles, threads, numaNodes, hugePages);
+    default: return std::make_unique<TypedCpuSolver<float, float>>(maxParticles, threads, numaNodes, hugePages);
+    }
+}
+
+template <typename Storage, typename Accum>
+TypedCpuSolver<Storage, Accum>::TypedCpuSolver(unsigned int maxParticles, unsigned int threads, unsigned int numaNodes, bool hugePages)
+    : maxParticles(maxParticles), gridDim(0), cellCapacity(0), cellSize(1.0f), gridOrigin(-1.0f),
+      hugePages(hugePages), boundaryReadFraction(0.0), slabItems(0), remoteSlabItems(0),
+      mouseDown(false), mouse(0.0f), boundaryLimit(1.0f), totalMilliseconds(0.0), pool(threads)
+{
+    reductions.resize(pool.GetThreadCount());
+    cpuStats.threads = pool.GetThreadCount();
+
+    if (numaNodes != 1 && pool.GetThreadCount() > 1) {
+        std::vector<NumaNode> layout = Numa::Layout(numaNodes);
+        if (layout.size() > 1) {
+            cpuStats.pinned = pool.PinToNodes(layout);
+            nodes.assign(layout.begin(), layout.begin() + pool.GetNodeCount());
+        }
+    }
+    slotSlabEnds.assign(std::max<size_t>(1, nodes.size()), 0);
+    rowSlabEnds.assign(slotSlabEnds.size(), 0);
+    cpuStats.numaNodes = static_cast<unsigned int>(slotSlabEnds.size());
+}
+
+template <typename Storage, typename Accum>
+template <typename Body>
+void TypedCpuSolver<Storage, Accum>::ForEachSlot(Body&& body) {
+    pool.ParallelForSlabs(slotSlabEnds, pool.DefaultGrain(particles.Size()), body);
+}
+
+template <typename Storage, typename Accum>
+void TypedCpuSolver<Storage, Accum>::Resize(unsigned int newCount) {
+    newCount = std::min(newCount, maxParticles);
+    particles.Resize(newCount);
+    particleCells.resize(newCount);
+    sortedOrder.resize(newCount);
+    Place();
+}
+
+template <typename Storage, typename Accum>
+void TypedCpuSolver<Storage, Accum>::Place() {
+    unsigned int count = particles.Size();
+    size_t slabs = slotSlabEnds.size();
+    for (size_t k = 0; k < slabs; ++k) {
+        slotSlabEnds[k] = count * (k + 1) / slabs;
+    }
+    pairSums.Resize(count);
+    if (nodes.empty() && !hugePages) return;
+
+    auto forRanges = [this](auto&& copyRange) {
+        ForEachSlot([&](size_t begin, size_t end, unsigned int) { copyRange(begin, end); });
+    };
+    // Arrays under 2 MB have no huge page to give
+    bool advised = false, refused = false;
+    auto advise = [&](void* data, size_t bytes) {
+        if (!hugePages || bytes < (size_t(2) << 20)) return;
+        if (Numa::AdviseHugePages(data, bytes)) advised = true;
+        else refused = true;
+    };
+    particles.FirstTouch(forRanges, advise);
+    pairSums.FirstTouch(forRanges, advise);
+    cpuStats.hugePages = advised && !refused;
+}
+
+template <typename Storage, typename Accum>
+void TypedCpuSolver<Storage, Accum>::Reset(const ParticleData& source, float initialTimestep) {
+    Resize(0);
+    Append(source, 0);
+
+    stepStats = StepStats();
+    stepStats.deltaTime = initialTimestep;
+    stepStats.previousDeltaTime = 0.0f;
+    bool pinned = cpuStats.pinned, advised = cpuStats.hugePages;
+    cpuStats = CpuStats();
+    cpuStats.threads = pool.GetThreadCount();
+    cpuStats.numaNodes = static_cast<unsigned int>(slotSlabEnds.size());
+    cpuStats.pinned = pinned;
+    cpuStats.hugePages = advised;
+    totalMilliseconds = 0.0;
+}
+
+template <typename Storage, typename Accum>
+void TypedCpuSolver<Storage, Accum>::Append(const ParticleData& source, unsigned int first) {
+    const glm::vec2* positions = source.Data<PositionField>();
+    const glm::vec2* velocities = source.Data<VelocityField>();
+    unsigned int last = std::min(source.Size(), first + maxParticles - particles.Size());
+    for (unsigned int i = first; i < last; ++i) {
+        particles.Append(Storage(positions[i].x), Storage(positions[i].y), Storage(velocities[i].x), Storage(velocities[i].y),
+                         Storage(0), Storage(0));
+    }
+    particleCells.resize(particles.Size());
+    sortedOrder.resize(particles.Size());
+    Place();
+}
+
+template <typename Storage, typename Accum>
+void TypedCpuSolver<Storage, Accum>::Truncate(unsigned int newCount) {
+    if (newCount < particles.Size()) Resize(newCount);
+}
+
+template <typename Storage, typename Accum>
+void TypedCpuSolver<Storage, Accum>::SetFrameInput(bool mouseDown, glm::vec2 mouse, float boundaryLimit) {
+    this->mouseDown = mouseDown;
+    this->mouse = mouse;
+    this->boundaryLimit = boundaryLimit;
+}
+
+template <typename Storage, typename Accum>
+CpuStats TypedCpuSolver<Storage, Accum>::GetCpuStats() const {
+    return cpuStats;
+}
+
+template <typename Storage, typename Accum>
+void TypedCpuSolver<Storage, Accum>::CopyState(ParticleData& state) const {
+    unsigned int count = particles.Size();
+    state.Resize(count);
+    const Storage* posX = particles.template Data<CpuPositionX<Storage>>();
+    const Storage* posY = particles.template Data<CpuPositionY<Storage>>();
+    const Storage* velX = particles.template Data<CpuVelocityX<Storage>>();
+    const Storage* velY = particles.template Data<CpuVelocityY<Storage>>();
+    glm::vec2* positions = state.Data<PositionField>();
+    glm::vec2* velocities = state.Data<VelocityField>();
+    for (unsigned int i = 0; i < count; ++i) {
+        positions[i] = glm::vec2(static_cast<float>(posX[i]), static_cast<float>(posY[i]));
+        velocities[i] = glm::vec2(static_cast<float>(velX[i]), static_cast<float>(velY[i]));
+    }
+    std::transform(particles.template Data<CpuDensity<Storage>>(), particles.template Data<CpuDensity<Storage>>() + count,
+                   state.Data<DensityField>(), [](Storage density) { return static_cast<float>(density); });
+    std::transform(particles.template Data<CpuPressure<Storage>>(), particles.template Data<CpuPressure<Storage>>() + count,
+                   state.Data<PressureField>(), [](Storage pressure) { return static_cast<float>(pressure); });
+}
+
+template <typename Storage, typename Accum>
+void TypedCpuSolver<Storage, Accum>::CopyKinematics(std::vector<glm::vec2>& positions, std::vector<glm::vec2>& velocities) const {
+    unsigned int count = particles.Size();
+    positions.resize(count);
+    velocities.resize(count);
+    const Storage* posX = particles.template Data<CpuPositionX<Storage>>();
+    const Storage* posY = particles.template Data<CpuPositionY<Storage>>();
+    const Storage* velX = particles.template Data<CpuVelocityX<Storage>>();
+    const Storage* velY = particles.template Data<CpuVelocityY<Storage>>();
+    for (unsigned int i = 0; i < count; ++i) {
+        positions[i] = glm::vec2(static_cast<float>(posX[i]), static_cast<float>(posY[i]));
+        velocities[i] = glm::vec2(static_cast<float>(velX[i]), static_cast<float>(velY[i]));
+    }
+}
+
+template <typename Storage, typename Accum>
+unsigned int TypedCpuSolver<Storage, Accum>::CellOf(Storage x, Storage y) const {
+    // Same clamping as grid_count.comp: anything past the walls (or NaN) joins the edge cells
+    Storage fx = (x - Storage(gridOrigin)) / Storage(cellSize);
+    Storage fy = (y - Storage(gridOrigin)) / Storage(cellSize);
+    Storage last = static_cast<Storage>(gridDim - 1);
+    fx = fx >= Storage(0) ? std::min(fx, last) : Storage(0);
+    fy = fy >= Storage(0) ? std::min(fy, last) : Storage(0);
+    return static_cast<unsigned int>(fy) * gridDim + static_cast<unsigned int>(fx);
+}
+
+template <typename Storage, typename Accum>
+void TypedCpuSolver<Storage, Accum>::BuildCellList(float h, bool stableOrder) {
+    // Square cells of at least h over the domain [-boundaryLimit, boundaryLimit]; capping the
+    // count only widens them
+    float domain = 2.0f * boundaryLimit;
+    gridDim = std::clamp(static_cast<unsigned int>(domain / h), 1u, 1024u);
+    cellSize = domain / gridDim;
+    gridOrigin = -boundaryLimit;
+    unsigned int cells = gridDim * gridDim;
+    if (cells > cellCapacity) {
+        cellCapacity = cells;
+        cellCounts.reset(new std::atomic<unsigned int>[cellCapacity]);
+    }
+    cellStart.resize(cells + 1);
+
+    // 1. CLEAR
+    for (unsigned int c = 0; c < cells; ++c) {
+        cellCounts[c].store(0, std::memory_order_relaxed);
+    }
+
+    // 2. COUNT, with an atomic per cell as in grid_count.comp
+    const Storage* posX = particles.template Data<CpuPositionX<Storage>>();
+    const Storage* posY = particles.template Data<CpuPositionY<Storage>>();
+    ForEachSlot([&](size_t begin, size_t end, unsigned int) {
+        for (size_t i = begin; i < end; ++i) {
+            unsigned int cell = CellOf(posX[i], posY[i]);
+            particleCells[i] = cell;
+            cellCounts[cell].fetch_add(1, std::memory_order_relaxed);
+        }
+    });
+
+    // Exclusive scan into each cell's first slot; the counts then serve as fill cursors
+    unsigned int offset = 0;
+    for (unsigned int c = 0; c < cells; ++c) {
+        cellStart[c] = offset;
+        offset += cellCounts[c].load(std::memory_order_relaxed);
+        cellCounts[c].store(cellStart[c], std::memory_order_relaxed);
+    }
+    cellStart[cells] = offset;
+
+    ForEachSlot([&](size_t begin, size_t end, unsigned int) {
+        for (size_t i = begin; i < end; ++i) {
+            unsigned int slot = cellCounts[particleCells[i]].fetch_add(1, std::memory_order_relaxed);
+            sortedOrder[slot] = static_cast<unsigned int>(i);
+        }
+    });
+    if (stableOrder) {
+        // The threads claim slots within a cell in whatever order they get there; sorting each
+        // cell's slots by the particles' previous slot makes the order independent of the schedule
+        pool.ParallelFor(cells, pool.DefaultGrain(cells), [&](size_t begin, size_t end, unsigned int) {
+            for (size_t c = begin; c < end; ++c) {
+                std::sort(sortedOrder.begin() + cellStart[c], sortedOrder.begin() + cellStart[c + 1]);
+            }
+        });
+    }
+
+    // Permute every field into cell order, then the cells through sortedOrder; each node gathers
+    // its new slab
+    ComputeSlabs();
+    particles.BeginPermutation();
+    ForEachSlot([&](size_t begin, size_t end, unsigned int) {
+        particles.Permute(sortedOrder.data(), begin, end);
+    });
+    particles.CommitPermutation();
+    ForEachSlot([&](size_t begin, size_t end, unsigned int) {
+        for (size_t slot = begin; slot < end; ++slot) {
+            sortedOrder[slot] = particleCells[sortedOrder[slot]];
+        }
+    });
+    particleCells.swap(sortedOrder);
+}
+
+template <typename Storage, typename Accum>
+void TypedCpuSolver<Storage, Accum>::ComputeSlabs() {
+    size_t slabs = slotSlabEnds.size();
+    unsigned int count = particles.Size();
+    auto rowStart = [this](size_t row) { return static_cast<size_t>(cellStart[row * gridDim]); };
+    size_t row = 0;
+    for (size_t k = 0; k < slabs; ++k) {
+        size_t target = static_cast<size_t>(count) * (k + 1) / slabs;
+        while (row < gridDim && rowStart(row) < target) ++row;
+        rowSlabEnds[k] = k + 1 == slabs ? gridDim : row;
+        slotSlabEnds[k] = rowStart(rowSlabEnds[k]);
+    }
+    if (slabs == 1) return;
+
+    // Neighbour reads between rows, taking the particles as spread evenly along each row: row
+    // y reads rows y - 1 to y + 1, and the reads into another slab's rows are remote
+    double total = 0.0, remote = 0.0;
+    size_t owner = 0;
+    for (size_t y = 0; y < gridDim; ++y) {
+        while (y >= rowSlabEnds[owner]) ++owner;
+        size_t slabBegin = owner > 0 ? rowSlabEnds[owner - 1] : 0;
+        double particlesInRow = static_cast<double>(rowStart(y + 1) - rowStart(y));
+        for (size_t r = y > 0 ? y - 1 : 0; r <= y + 1 && r < gridDim; ++r) {
+            double reads = particlesInRow * static_cast<double>(rowStart(r + 1) - rowStart(r));
+            total += reads;
+            if (r < slabBegin || r >= rowSlabEnds[owner]) remote += reads;
+        }
+    }
+    boundaryReadFraction = total > 0.0 ? remote / total : 0.0;
+}
+
+template <typename Storage, typename Accum>
+double TypedCpuSolver<Storage, Accum>::MeasurePlacement() const {
+    size_t onNode = 0, total = 0;
+    bool known = true;
+    for (size_t k = 0; k < slotSlabEnds.size() && known; ++k) {
+        size_t begin = k > 0 ? slotSlabEnds[k - 1] : 0;
+        size_t end = slotSlabEnds[k];
+        unsigned int osNode = nodes[k].osNode;
+        auto count = [&](const void* data, size_t elementBytes) {
+            const char* bytes = static_cast<const char*>(data);
+            known &= Numa::CountPages(bytes + begin * elementBytes, (end - begin) * elementBytes, osNode, onNode, total);
+        };
+        particles.ForEachHostArray(count);
+        pairSums.ForEachHostArray(count);
+    }
+    if (!known || total == 0) return -1.0;
+    return 1.0 - static_cast<double>(onNode) / total;
+}
+
+template <typename Storage, typename Accum>
+CpuNeighbourData<Storage, Accum> TypedCpuSolver<Storage, Accum>::NeighbourData(const Simulation& sim) const {
+    CpuNeighbourData<Storage, Accum> data;
+    data.posX = particles.template Data<CpuPositionX<Storage>>();
+    data.posY = particles.template Data<CpuPositionY<Storage>>();
+    data.velX = particles.template Data<CpuVelocityX<Storage>>();
+    data.velY = particles.template Data<CpuVelocityY<Storage>>();
+    data.densities = particles.template Data<CpuDensity<Storage>>();
+    data.pressures = particles.template Data<CpuPressure<Storage>>();
+    data.particleCells = particleCells.data();
+    data.cellStart = cellStart.data();
+    data.gridDim = gridDim;
+    CpuIntegration::SetParameters(data, sim);
+    return data;
+}
+
+template <typename Storage, typename Accum>
+template <typename Body>
+void TypedCpuSolver<Storage, Accum>::ForEachParticleByRowColour(Body&& body) {
+    size_t* colourSlabEnds = arena.Allocate<size_t>(rowSlabEnds.size());
+    for (unsigned int colour = 0; colour < 2; ++colour) {
+        // Rows of this colour in each node's slab; row 2r + colour is item r
+        for (size_t k = 0; k < rowSlabEnds.size(); ++k) {
+            colourSlabEnds[k] = rowSlabEnds[k] > colour ? (rowSlabEnds[k] - colour + 1) / 2 : 0;
+        }
+        pool.ParallelForSlabs(colourSlabEnds, rowSlabEnds.size(), 1, [&](size_t begin, size_t end, unsigned int) {
+            for (size_t r = begin; r < end; ++r) {
+                size_t row = 2 * r + colour;
+                unsigned int first = cellStart[row * gridDim];
+                unsigned int last = cellStart[(row + 1) * gridDim];
+                for (unsigned int i = first; i < last; ++i) {
+                    body(i);
+                }
+            }
+        });
+    }
+}
+
+template <typename Storage, typename Accum>
+void TypedCpuSolver<Storage, Accum>::ComputeDensity(const Simulation& sim, const KernelSet& kernels) {
+    CpuNeighbourData<Storage, Accum> data = NeighbourData(sim);
+
+    // 3. DENSITY, as density.comp over the 3x3 cells around each particle
+    Storage* densities = particles.template Data<CpuDensity<Storage>>();
+    Storage* pressures = particles.template Data<CpuPressure<Storage>>();
+    Accum* kernelSums = pairSums.template Data<CpuKernelSum<Accum>>();
+    if (sim.cpuHalfShell) {
+        // Kernel sums from both ends of each pair, scaled below
+        ForEachSlot([&](size_t begin, size_t end, unsigned int) { std::fill(kernelSums + begin, kernelSums + end, Accum(0)); });
+        ForEachParticleByRowColour([&](unsigned int i) { kernels.densityHalf(data, i, kernelSums); });
+    }
+    Accum massScale = data.particleMass * data.densityScale;
+    Accum gasConstant = sim.gasConstant;
+    Accum restDensity = sim.restDensity;
+    ForEachSlot([&](size_t begin, size_t end, unsigned int) {
+        for (size_t i = begin; i < end; ++i) {
+            Accum sum = sim.cpuHalfShell ? massScale * kernelSums[i] : kernels.density(data, static_cast<unsigned int>(i));
+            Accum density = std::max(sum, Accum(1e-4f));
+            densities[i] = static_cast<Storage>(density);
+            pressures[i] = static_cast<Storage>(std::max(gasConstant * (density - restDensity), Accum(0)));
+        }
+    });
+}
+
+template <typename Storage, typename Accum>
+void TypedCpuSolver<Storage, Accum>::ComputeForces(const Simulation& sim, Accum dt, const KernelSet& kernels) {
+    CpuNeighbourData<Storage, Accum> data = NeighbourData(sim);
+    CpuIntegration::ParticleStep<Accum> step(sim, dt, stepStats.previousDeltaTime, mouseDown, mouse, boundaryLimit);
+
+    for (CpuIntegration::Reduction& reduction : reductions) {
+        reduction = CpuIntegration::Reduction{ 0.0f, 0.0f, 0 };
+    }
+
+    // 4. FORCES + INTEGRATION, as physics.comp, into copy 1 of the pairs
+    CpuForceArrays<Accum> pairArrays{};
+    if (sim.cpuHalfShell) {
+        ForEachSlot([&](size_t begin, size_t end, unsigned int) { pairSums.Zero(begin, end); });
+        pairArrays = CpuForceArrays<Accum>{ pairSums.template Data<CpuPressureSumX<Accum>>(), pairSums.template Data<CpuPressureSumY<Accum>>(),
+                                            pairSums.template Data<CpuViscositySumX<Accum>>(), pairSums.template Data<CpuViscositySumY<Accum>>(),
+                                            pairSums.template Data<CpuColorGradX<Accum>>(), pairSums.template Data<CpuColorGradY<Accum>>(),
+                                            pairSums.template Data<CpuColorLaplacian<Accum>>() };
+        ForEachParticleByRowColour([&](unsigned int i) { kernels.forcesHalf(data, i, pairArrays); });
+    }
+    const Storage* posX = particles.template Data<CpuPositionX<Storage>>();
+    const Storage* posY = particles.template Data<CpuPositionY<Storage>>();
+    const Storage* velX = particles.template Data<CpuVelocityX<Storage>>();
+    const Storage* velY = particles.template Data<CpuVelocityY<Storage>>();
+    Storage* posXOut = particles.template Data<CpuPositionX<Storage>>(1);
+    Storage* posYOut = particles.template Data<CpuPositionY<Storage>>(1);
+    Storage* velXOut = particles.template Data<CpuVelocityX<Storage>>(1);
+    Storage* velYOut = particles.template Data<CpuVelocityY<Storage>>(1);
+    ForEachSlot([&](size_t begin, size_t end, unsigned int thread) {
+        CpuIntegration::Reduction& reduction = reductions[thread];
+        for (size_t i = begin; i < end; ++i) {
+            CpuForceSums<Accum> sums;
+            if (sim.cpuHalfShell) {
+                sums = CpuForceSums<Accum>{ pairArrays.pressureX[i], pairArrays.pressureY[i], pairArrays.viscosityX[i],
+                                            pairArrays.viscosityY[i], pairArrays.colorGradX[i], pairArrays.colorGradY[i],
+                                            pairArrays.colorLaplacian[i] };
+            }
+            else {
+                kernels.forces(data, static_cast<unsigned int>(i), sums);
+            }
+            Vec2 pos_i(posX[i], posY[i]);
+            Vec2 vel_i(velX[i], velY[i]);
+            step.Advance(pos_i, vel_i, sums, reduction);
+            posXOut[i] = static_cast<Storage>(pos_i.x);
+            posYOut[i] = static_cast<Storage>(pos_i.y);
+            velXOut[i] = static_cast<Storage>(vel_i.x);
+            velYOut[i] = static_cast<Storage>(vel_i.y);
+        }
+    });
+}
+
+template <typename Storage, typename Accum>
+void TypedCpuSolver<Storage, Accum>::Step(const Simulation& sim) {
+    auto start = std::chrono::steady_clock::now();
+    float dt = sim.adaptiveTimestep ? stepStats.deltaTime : sim.fixedTimestep;
+    arena.Reset();
+
+    KernelSet kernels = CpuKernels::Get<Storage, Accum>(sim.cpuIsa, sim.kernelFamily);
+    BuildCellList(sim.smoothingRadius, sim.cpuDeterministic);
+    ComputeDensity(sim, kernels);
+    ComputeForces(sim, Accum(dt), kernels);
+    particles.SwapCopies();
+
+    // 5. TIMESTEP, as timestep.comp
+    float maxSpeed = 0.0f, maxAccel = 0.0f;
+    unsigned int nanResets = 0;
+    for (const CpuIntegration::Reduction& reduction : reductions) {
+        maxSpeed = std::max(maxSpeed, reduction.maxSpeed);
+        maxAccel = std::max(maxAccel, reduction.maxAccel);
+        nanResets += reduction.nanResets;
+    }
+    float dtVelocity = sim.cflNumber * sim.smoothingRadius / std::max(maxSpeed, 1e-6f);
+    float dtForce = sim.forceFactor * std::sqrt(sim.smoothingRadius / std::max(maxAccel, 1e-6f));
+    stepStats.previousDeltaTime = dt;
+    stepStats.deltaTime = std::clamp(std::min(dtVelocity, dtForce), sim.minTimestep, sim.maxTimestep);
+    stepStats.maxSpeed = maxSpeed;
+    stepStats.maxAccel = maxAccel;
+    stepStats.nanResets = nanResets;
+    stepStats.totalNanResets += nanResets;
+
+    double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    totalMilliseconds += milliseconds;
+    cpuStats.steps++;
+    cpuStats.lastStepMilliseconds = milliseconds;
+    cpuStats.stepsPerSecond = totalMilliseconds > 0.0 ? 1000.0 * cpuStats.steps / totalMilliseconds : 0.0;
+    cpuStats.stepsPerSecondPerCore = cpuStats.stepsPerSecond / cpuStats.threads;
+    cpuStats.precision = PrecisionOf<Storage, Accum>();
+    cpuStats.isa = kernels.isa;
+    cpuStats.halfShell = sim.cpuHalfShell;
+    cpuStats.deterministic = sim.cpuDeterministic;
+    cpuStats.scratchBytes = arena.PeakBytes();
+
+    if (!nodes.empty()) {
+        // Work stolen across nodes reads its slab remotely; the rest only across slab bounds
+        size_t items, remoteItems;
+        pool.GetSlabCounters(items, remoteItems);
+        double stolen = items > slabItems ? static_cast<double>(remoteItems - remoteSlabItems) / (items - slabItems) : 0.0;
+        slabItems = items;
+        remoteSlabItems = remoteItems;
+        cpuStats.remoteAccessRatio = stolen + (1.0 - stolen) * boundaryReadFraction;
+        // Page queries cost a system call per thousand pages
+        if (cpuStats.steps % 64 == 1) cpuStats.misplacedPages = MeasurePlacement();
+    }
+}
+
+template class TypedCpuSolver<float, float>;
+template class TypedCpuSolver<float, double>;
+template class TypedCpuSolver<double, double>;
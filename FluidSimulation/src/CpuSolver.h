@@ -0,0 +1,211 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <atomic>
+#include "glm.hpp"
+#include "Simulation.h"
+#include "ThreadPool.h"
+#include "Numa.h"
+#include "CpuKernels.h"
+#include "CpuIntegration.h"
+#include "ParticleStore.h"
+#include "StepArena.h"
+
+// Throughput of the CPU backend since the last Reset.
+struct CpuStats {
+    unsigned int threads = 0;
+    CpuPrecision precision = CpuPrecision::Single;
+    CpuIsa isa = CpuIsa::Scalar;         // instruction set of the last step's neighbour sums
+    bool halfShell = false;              // the last step visited each pair once
+    bool deterministic = false;          // the last step's cell order did not depend on the threads
+    unsigned int numaNodes = 1;          // slabs, each on the threads of one node
+    bool pinned = false;                 // the OS accepted every thread's node affinity
+    bool hugePages = false;              // the OS accepted the huge page advice
+    double remoteAccessRatio = 0.0;      // estimated share of the last step's particle reads from another node
+    double misplacedPages = -1.0;        // share of particle pages off their slab's node; -1: not measured
+    size_t scratchBytes = 0;             // most step arena memory a step has used
+    unsigned long long steps = 0;
+    double lastStepMilliseconds = 0.0;
+    double stepsPerSecond = 0.0;         // over all steps since the last Reset
+    double stepsPerSecondPerCore = 0.0;  // stepsPerSecond / threads
+};
+
+// The CPU backend's particle state in the storage type T, x and y in separate arrays for the
+// vector kernels. Positions and velocities are pairs: the force pass writes copy 1, which the
+// step then swaps in.
+template <typename T> struct CpuPositionX : ParticleField<T, 2> {};
+template <typename T> struct CpuPositionY : ParticleField<T, 2> {};
+template <typename T> struct CpuVelocityX : ParticleField<T, 2> {};
+template <typename T> struct CpuVelocityY : ParticleField<T, 2> {};
+template <typename T> struct CpuDensity : ParticleField<T> {};
+template <typename T> struct CpuPressure : ParticleField<T> {};
+template <typename T>
+using CpuParticles = ParticleStore<CpuPositionX<T>, CpuPositionY<T>, CpuVelocityX<T>, CpuVelocityY<T>, CpuDensity<T>, CpuPressure<T>>;
+
+// The half-shell passes' per-particle sums in the accumulation type T: the density's kernel sums
+// and the CpuForceSums terms, filled from both ends of every pair before the pass reads them
+template <typename T> struct CpuKernelSum : ParticleField<T> {};
+template <typename T> struct CpuPressureSumX : ParticleField<T> {};
+template <typename T> struct CpuPressureSumY : ParticleField<T> {};
+template <typename T> struct CpuViscositySumX : ParticleField<T> {};
+template <typename T> struct CpuViscositySumY : ParticleField<T> {};
+template <typename T> struct CpuColorGradX : ParticleField<T> {};
+template <typename T> struct CpuColorGradY : ParticleField<T> {};
+template <typename T> struct CpuColorLaplacian : ParticleField<T> {};
+template <typename T>
+using CpuPairSums = ParticleStore<CpuKernelSum<T>, CpuPressureSumX<T>, CpuPressureSumY<T>, CpuViscositySumX<T>,
+                                  CpuViscositySumY<T>, CpuColorGradX<T>, CpuColorGradY<T>, CpuColorLaplacian<T>>;
+
+// The weakly compressible SPH solver on the CPU, for machines without a GPU: the grid clear,
+// count, density and force passes of the GPU path, with the same Simulation parameters. Covers
+// plain SPH with either integrator, kernel family and wall mode, the mouse and the adaptive
+// timestep; sleeping, local time stepping, adaptive resolution, the fused step, multi-rate
+// forces, implicit viscosity and the lookup table are GPU-only, as are PBF and DFSPH.
+//
+// Particles live in SoA arrays. Each step counting-sorts them by grid cell and permutes every
+// array into cell order, so the particles of a row of three neighbouring cells are contiguous
+// and the neighbour loops read straight runs. Cells are at least h wide, so 3x3 cells hold
+// every neighbour. The neighbour sums run on the instruction set chosen by Simulation::cpuIsa
+// (see CpuKernels.h); the per-particle remainder of each pass is scalar.
+//
+// On NUMA machines (Simulation::cpuNumaNodes) the threads are pinned in one group per node and
+// the cell-ordered slots are cut into one slab per node: whole cell rows, balanced by particle
+// count, so the slab bounds barely move between steps. Every pass runs a slab on its node's
+// threads, and after each resize the arrays are copied to fresh memory slab by slab by those
+// threads (first touch), so each node mostly reads its own memory; only the neighbour reads
+// across a slab boundary and work stolen across nodes go remote.
+//
+// With Simulation::cpuHalfShell the density and force sums visit each pair once instead of once
+// from each end, adding the result to both particles. Threads then write to other particles'
+// sums, so the cell rows run in two colours: a particle's half shell lies in its own row and the
+// one above, and all even rows run in parallel before all odd ones.
+//
+// With Simulation::cpuDeterministic the results are bitwise identical for any thread count, NUMA
+// layout and schedule. The only order the threads decide is that of the particles within a cell
+// after the sort, and this mode fixes it. Everything else already runs in a fixed order. Every
+// particle sums its neighbours in slot order. In the half shell a row is one work item, and a
+// row's only writers are itself and the row below, which run in different colours. The step's
+// reductions are maxima and integer counts, which are exact in any order. The neighbour sums
+// still depend on the instruction set, whose vector width groups the terms, so runs compare
+// bitwise only with the same Simulation::cpuIsa.
+//
+// The scalar types are chosen at Init by Simulation::cpuPrecision, which picks one instantiation
+// of TypedCpuSolver<Storage, Accum>: Storage for the particle arrays, Accum for the neighbour
+// sums, the half-shell sums and the per-particle integration. Mixed precision keeps the float
+// arrays, and with them the memory traffic, but adds up each particle's neighbour terms and
+// integrates in double. Double precision stores the state in double as well, so that the small
+// steps of slow particles are not rounded away over a long run.
+class CpuSolver {
+public:
+    // 0 threads: one per hardware thread. numaNodes as Simulation::cpuNumaNodes.
+    static std::unique_ptr<CpuSolver> Create(CpuPrecision precision, unsigned int maxParticles, unsigned int threads,
+                                             unsigned int numaNodes = 1, bool hugePages = false);
+    virtual ~CpuSolver() = default;
+
+    // Restarts from the positions and velocities of these particles, at rest in the timestep
+    // controller like Simulation::ResetScene
+    virtual void Reset(const ParticleData& particles, float initialTimestep) = 0;
+    // Appends particles [first, particles.Size()) (new count up to maxParticles) or drops the last ones
+    virtual void Append(const ParticleData& particles, unsigned int first) = 0;
+    virtual void Truncate(unsigned int count) = 0;
+
+    // Mouse and domain of the following steps, as Simulation::SetStepUniforms gives the shaders
+    virtual void SetFrameInput(bool mouseDown, glm::vec2 mouse, float boundaryLimit) = 0;
+    // One step with sim's parameters
+    virtual void Step(const Simulation& sim) = 0;
+
+    virtual unsigned int GetParticleCount() const = 0;
+    virtual const StepStats& GetStepStats() const = 0;
+    virtual CpuStats GetCpuStats() const = 0;
+    // State in the solver's current (cell) order, resized to the particle count and rounded to
+    // float; densities and pressures are those the last step's forces used
+    virtual void CopyState(ParticleData& state) const = 0;
+    // Positions and velocities alone, in the same order; reuses the arrays' capacity
+    virtual void CopyKinematics(std::vector<glm::vec2>& positions, std::vector<glm::vec2>& velocities) const = 0;
+};
+
+// The solver with particle arrays of Storage, summing and integrating in Accum. Instantiated in
+// CpuSolver.cpp for the three CpuPrecision pairs, as the kernels are.
+template <typename Storage, typename Accum>
+class TypedCpuSolver final : public CpuSolver {
+public:
+    TypedCpuSolver(unsigned int maxParticles, unsigned int threads, unsigned int numaNodes, bool hugePages);
+
+    void Reset(const ParticleData& particles, float initialTimestep) override;
+    void Append(const ParticleData& particles, unsigned int first) override;
+    void Truncate(unsigned int count) override;
+    void SetFrameInput(bool mouseDown, glm::vec2 mouse, float boundaryLimit) override;
+    void Step(const Simulation& sim) override;
+
+    unsigned int GetParticleCount() const override { return particles.Size(); }
+    const StepStats& GetStepStats() const override { return stepStats; }
+    CpuStats GetCpuStats() const override;
+    void CopyState(ParticleData& state) const override;
+    void CopyKinematics(std::vector<glm::vec2>& positions, std::vector<glm::vec2>& velocities) const override;
+
+private:
+    using Vec2 = glm::vec<2, Accum>;
+    using KernelSet = CpuKernelSet<Storage, Accum>;
+
+    CpuParticles<Storage> particles;
+    CpuPairSums<Accum> pairSums;
+    unsigned int maxParticles;
+
+    // Cell list: each particle's cell, particles per cell, and the first slot of every cell in
+    // the sorted arrays (cellStart[cells] = count)
+    std::vector<unsigned int> particleCells;
+    std::vector<unsigned int> sortedOrder;   // slot -> particle index before the sort
+    std::unique_ptr<std::atomic<unsigned int>[]> cellCounts;
+    std::vector<unsigned int> cellStart;
+    unsigned int gridDim;
+    unsigned int cellCapacity;
+    float cellSize;
+    float gridOrigin;
+
+    // NUMA slabs: node k owns slots [slotSlabEnds[k - 1], slotSlabEnds[k]) and cell rows
+    // [rowSlabEnds[k - 1], rowSlabEnds[k]); one slab of everything without NUMA
+    std::vector<NumaNode> nodes;
+    std::vector<size_t> slotSlabEnds;
+    std::vector<size_t> rowSlabEnds;
+    bool hugePages;
+    double boundaryReadFraction;  // of the last cell list's neighbour reads, across a slab boundary
+    size_t slabItems;             // the pool's slab counters at the last step
+    size_t remoteSlabItems;
+
+    // Per-thread max |v|, max |a| and NaN resets of the force pass
+    std::vector<CpuIntegration::Reduction> reductions;
+
+    // Scratch of the current step, taken back at the start of the next
+    StepArena arena;
+
+    bool mouseDown;
+    glm::vec2 mouse;
+    float boundaryLimit;
+
+    StepStats stepStats;
+    CpuStats cpuStats;
+    double totalMilliseconds;
+
+    ThreadPool pool;
+
+    void Resize(unsigned int newCount);
+    // After a resize: even slabs, the pair sums sized, and the arrays first-touched by their nodes
+    void Place();
+    // Slabs of whole rows balanced by particle count, from the fresh cell list
+    void ComputeSlabs();
+    // Share of the particle array pages not on their slab's node, or -1 if the OS cannot say
+    double MeasurePlacement() const;
+    // body(begin, end, thread) over the particle slots, slab by slab on the owning nodes
+    template <typename Body>
+    void ForEachSlot(Body&& body);
+    // Passes 1-2 and the sort: clear, count, scan and permute every field into cell order. With
+    // stableOrder, each cell keeps its particles in their previous order.
+    void BuildCellList(float h, bool stableOrder);
+    unsigned int CellOf(Storage x, Storage y) const;
+    CpuNeighbourData<Storage, Accum> NeighbourData(const Simulation& sim) const;
+    // body(i) for every particle, row by row in the two colours of the half-shell passes
+    template <typename Body>
+    void ForEachParticleByRowColour(Body&& body);
+    void ComputeDensity(const Simulation& sim, const KernelSet& kernels);
+    void ComputeForces(const Simulation& sim, Accum dt, const KernelSet& kernels);
+};
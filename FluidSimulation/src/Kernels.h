@@ -0,0 +1,191 @@
+#pragma once
+#include <sstream>
+#include <iomanip>
+#include <string>
+
+// SPH kernels shared by the host and the compute shaders. Every kernel in the shaders is
+// coefficient / h^hPower times a polynomial shape in (h - r), (h^2 - r^2) or q = r / h; the host
+// folds the coefficient and the power of h into one scale per parameter change (see
+// Kernels::Scale), and the shaders receive the descriptors as #defines (see Kernels::GlslDefines).
+struct KernelDescriptor {
+    const char* name;   // prefix of the generated GLSL defines
+    float coefficient;
+    int hPower;
+};
+
+// Kernel family of the SPH solver's density, pressure and viscosity terms. PBF and DFSPH keep
+// the poly6 / spiky kernels of their own formulations.
+enum class KernelFamily {
+    Poly6Spiky,   // the original poly6 density, spiky pressure and viscosity Laplacian kernels
+    CubicSpline,  // M4 B-spline
+    WendlandC2,
+    WendlandC4
+};
+
+namespace Kernels {
+    constexpr float PI = 3.14159265359f;
+
+    // (h^2 - r^2)^2: density in PBF; XSPH in PBF
+    constexpr KernelDescriptor Poly6{ "POLY6", 4.0f / PI, 8 };
+    // (h - r)^3: density in DFSPH; XSPH in DFSPH
+    constexpr KernelDescriptor Spiky{ "SPIKY", 10.0f / PI, 5 };
+    // (h - r)^2 r_hat: gradient of Spiky, for the PBF constraint and the DFSPH solves
+    constexpr KernelDescriptor SpikyGradient{ "SPIKY_GRAD", -30.0f / PI, 5 };
+    // (h - r)^3, -3 (h - r)^2 and 6 (h - r): the colour field of the surface tension in physics.comp
+    constexpr KernelDescriptor SurfaceColor{ "SURFACE", 1.0f, 3 };
+
+    // Entries of the optional lookup table, indexed by q = r / h over [0, 1]. Indexing by q^2
+    // would save the shaders a sqrt but puts a sqrt singularity at q = 0 into the (1 - q) shapes.
+    constexpr int TABLE_SIZE = 1024;
+
+    constexpr const KernelDescriptor* ALL[] = { &Poly6, &Spiky, &SpikyGradient, &SurfaceColor };
+
+    // coefficient / h^hPower
+    constexpr float Scale(const KernelDescriptor& kernel, float h) {
+        float scale = kernel.coefficient;
+        for (int i = 0; i < kernel.hPower; ++i) scale /= h;
+        return scale;
+    }
+
+    // condition ? a : b without the branch. The shapes below are templates on their number type so
+    // the CPU backend can evaluate them on SIMD vectors, whose Select overloads ADL finds.
+    inline float Select(bool condition, float a, float b) { return condition ? a : b; }
+    inline double Select(bool condition, double a, double b) { return condition ? a : b; }
+}
+
+// The SPH solver's kernels for one family, all as functions of q = r / h with support q < 1:
+// Density (W), Gradient (dW/dr) and Laplacian (the weight of the viscosity term). Each shape
+// exists twice, as a C++ function for the host (float, double or a SIMD vector of either) and
+// as a GLSL expression in q that Kernels::GlslDefines turns into a function-like macro, side by
+// side so they cannot drift.
+template <KernelFamily Family> struct SphKernels;
+
+template <> struct SphKernels<KernelFamily::Poly6Spiky> {
+    static constexpr const char* NAME = "POLY6_SPIKY";
+    static constexpr KernelDescriptor Density{ "SPH_DENSITY", 4.0f / Kernels::PI, 4 };
+    static constexpr KernelDescriptor Gradient{ "SPH_GRADIENT", -45.0f / Kernels::PI, 4 };
+    static constexpr KernelDescriptor Laplacian{ "SPH_LAPLACIAN", 45.0f / Kernels::PI, 5 };
+
+    template <typename T> static T DensityShape(T q) { return (1.0f - q * q) * (1.0f - q * q); }
+    template <typename T> static T GradientShape(T q) { return (1.0f - q) * (1.0f - q); }
+    template <typename T> static T LaplacianShape(T q) { return 1.0f - q; }
+    static constexpr const char* DENSITY_GLSL = "((1.0 - (q) * (q)) * (1.0 - (q) * (q)))";
+    static constexpr const char* GRADIENT_GLSL = "((1.0 - (q)) * (1.0 - (q)))";
+    static constexpr const char* LAPLACIAN_GLSL = "(1.0 - (q))";
+};
+
+// A normalised 2D kernel sigma / h^2 f(q), scaled by 4 / (3 h^2), the integral of the poly6
+// kernel above, so that densities, restDensity and gasConstant stay on the original scale.
+// The gradient is f'(q) / h and the viscosity weight -2 f'(q) / (q h^2), i.e. the
+// Laplacian of a pair estimated from the first derivative, which stays finite at q = 0.
+template <typename Shape> struct NormalisedSphKernels {
+    static constexpr const char* NAME = Shape::NAME;
+    static constexpr KernelDescriptor Density{ "SPH_DENSITY", 4.0f / 3.0f * Shape::SIGMA, 4 };
+    static constexpr KernelDescriptor Gradient{ "SPH_GRADIENT", 4.0f / 3.0f * Shape::SIGMA, 5 };
+    static constexpr KernelDescriptor Laplacian{ "SPH_LAPLACIAN", -8.0f / 3.0f * Shape::SIGMA, 6 };
+
+    template <typename T> static T DensityShape(T q) { return Shape::F(q); }
+    template <typename T> static T GradientShape(T q) { return Shape::DF(q); }
+    template <typename T> static T LaplacianShape(T q) { return Shape::DFOverQ(q); }
+    static constexpr const char* DENSITY_GLSL = Shape::F_GLSL;
+    static constexpr const char* GRADIENT_GLSL = Shape::DF_GLSL;
+    static constexpr const char* LAPLACIAN_GLSL = Shape::DF_OVER_Q_GLSL;
+};
+
+namespace Kernels {
+    // f(q), f'(q) and f'(q) / q of each normalised family, with sigma normalising f over the unit disk
+    struct CubicSplineShape {
+        static constexpr const char* NAME = "CUBIC_SPLINE";
+        static constexpr float SIGMA = 40.0f / (7.0f * PI);
+        template <typename T> static T F(T q) { return Select(q < 0.5f, 6.0f * (q * q * q - q * q) + 1.0f, 2.0f * (1.0f - q) * (1.0f - q) * (1.0f - q)); }
+        template <typename T> static T DF(T q) { return Select(q < 0.5f, 6.0f * q * (3.0f * q - 2.0f), -6.0f * (1.0f - q) * (1.0f - q)); }
+        template <typename T> static T DFOverQ(T q) { return Select(q < 0.5f, 6.0f * (3.0f * q - 2.0f), -6.0f * (1.0f - q) * (1.0f - q) / q); }
+        static constexpr const char* F_GLSL = "((q) < 0.5 ? 6.0 * ((q) * (q) * (q) - (q) * (q)) + 1.0 : 2.0 * (1.0 - (q)) * (1.0 - (q)) * (1.0 - (q)))";
+        static constexpr const char* DF_GLSL = "((q) < 0.5 ? 6.0 * (q) * (3.0 * (q) - 2.0) : -6.0 * (1.0 - (q)) * (1.0 - (q)))";
+        static constexpr const char* DF_OVER_Q_GLSL = "((q) < 0.5 ? 6.0 * (3.0 * (q) - 2.0) : -6.0 * (1.0 - (q)) * (1.0 - (q)) / (q))";
+    };
+
+    struct WendlandC2Shape {
+        static constexpr const char* NAME = "WENDLAND_C2";
+        static constexpr float SIGMA = 7.0f / PI;
+        template <typename T> static T F(T q) { T t = 1.0f - q; return t * t * t * t * (1.0f + 4.0f * q); }
+        template <typename T> static T DF(T q) { T t = 1.0f - q; return -20.0f * q * t * t * t; }
+        template <typename T> static T DFOverQ(T q) { T t = 1.0f - q; return -20.0f * t * t * t; }
+        static constexpr const char* F_GLSL = "((1.0 - (q)) * (1.0 - (q)) * (1.0 - (q)) * (1.0 - (q)) * (1.0 + 4.0 * (q)))";
+        static constexpr const char* DF_GLSL = "(-20.0 * (q) * (1.0 - (q)) * (1.0 - (q)) * (1.0 - (q)))";
+        static constexpr const char* DF_OVER_Q_GLSL = "(-20.0 * (1.0 - (q)) * (1.0 - (q)) * (1.0 - (q)))";
+    };
+
+    struct WendlandC4Shape {
+        static constexpr const char* NAME = "WENDLAND_C4";
+        static constexpr float SIGMA = 9.0f / PI;
+        template <typename T> static T F(T q) { T t = 1.0f - q; T t2 = t * t; return t2 * t2 * t2 * (1.0f + 6.0f * q + 35.0f / 3.0f * q * q); }
+        template <typename T> static T DF(T q) { T t = 1.0f - q; T t2 = t * t; return -56.0f / 3.0f * q * (1.0f + 5.0f * q) * t2 * t2 * t; }
+        template <typename T> static T DFOverQ(T q) { T t = 1.0f - q; T t2 = t * t; return -56.0f / 3.0f * (1.0f + 5.0f * q) * t2 * t2 * t; }
+        static constexpr const char* F_GLSL = "(pow(1.0 - (q), 6.0) * (1.0 + 6.0 * (q) + 35.0 / 3.0 * (q) * (q)))";
+        static constexpr const char* DF_GLSL = "(-56.0 / 3.0 * (q) * (1.0 + 5.0 * (q)) * pow(1.0 - (q), 5.0))";
+        static constexpr const char* DF_OVER_Q_GLSL = "(-56.0 / 3.0 * (1.0 + 5.0 * (q)) * pow(1.0 - (q), 5.0))";
+    };
+}
+
+template <> struct SphKernels<KernelFamily::CubicSpline> : NormalisedSphKernels<Kernels::CubicSplineShape> {};
+template <> struct SphKernels<KernelFamily::WendlandC2> : NormalisedSphKernels<Kernels::WendlandC2Shape> {};
+template <> struct SphKernels<KernelFamily::WendlandC4> : NormalisedSphKernels<Kernels::WendlandC4Shape> {};
+
+namespace Kernels {
+    constexpr KernelFamily FAMILIES[] = { KernelFamily::Poly6Spiky, KernelFamily::CubicSpline, KernelFamily::WendlandC2, KernelFamily::WendlandC4 };
+
+    // Calls visit(SphKernels<family>{}) for a family chosen at run time
+    template <typename Visitor>
+    auto WithFamily(KernelFamily family, Visitor&& visit) {
+        switch (family) {
+        case KernelFamily::CubicSpline: return visit(SphKernels<KernelFamily::CubicSpline>{});
+        case KernelFamily::WendlandC2: return visit(SphKernels<KernelFamily::WendlandC2>{});
+        case KernelFamily::WendlandC4: return visit(SphKernels<KernelFamily::WendlandC4>{});
+        default: return visit(SphKernels<KernelFamily::Poly6Spiky>{});
+        }
+    }
+
+    inline const char* FamilyName(KernelFamily family) {
+        return WithFamily(family, [](auto kernels) { return decltype(kernels)::NAME; });
+    }
+
+    // Shapes at q stored in the lookup table's three channels: density, gradient and Laplacian.
+    // The shaders multiply them by the same scales as the analytic shapes.
+    template <typename Sph>
+    void TableShapes(float q, float shapes[3]) {
+        shapes[0] = Sph::DensityShape(q);
+        shapes[1] = Sph::GradientShape(q);
+        shapes[2] = Sph::LaplacianShape(q);
+    }
+
+    inline void TableShapes(KernelFamily family, float q, float shapes[3]) {
+        WithFamily(family, [&](auto kernels) { TableShapes<decltype(kernels)>(q, shapes); });
+    }
+
+    // "#define POLY6_COEFF ..." and "#define POLY6_H_POWER ..." for every kernel and the SPH
+    // family's descriptors, the family's shapes as SPH_DENSITY_SHAPE(q) etc., and the table size
+    inline std::string GlslDefines(KernelFamily family) {
+        std::ostringstream defines;
+        defines << std::setprecision(9) << std::showpoint;
+        auto define = [&defines](const KernelDescriptor& kernel) {
+            defines << "#define " << kernel.name << "_COEFF " << kernel.coefficient << "\n";
+            defines << "#define " << kernel.name << "_H_POWER " << kernel.hPower << "\n";
+        };
+        for (const KernelDescriptor* kernel : ALL) {
+            define(*kernel);
+        }
+        WithFamily(family, [&](auto kernels) {
+            using Sph = decltype(kernels);
+            defines << "#define KERNEL_FAMILY_" << Sph::NAME << "\n";
+            define(Sph::Density);
+            define(Sph::Gradient);
+            define(Sph::Laplacian);
+            defines << "#define SPH_DENSITY_SHAPE(q) " << Sph::DENSITY_GLSL << "\n";
+            defines << "#define SPH_GRADIENT_SHAPE(q) " << Sph::GRADIENT_GLSL << "\n";
+            defines << "#define SPH_LAPLACIAN_SHAPE(q) " << Sph::LAPLACIAN_GLSL << "\n";
+        });
+        defines << "#define KERNEL_TABLE_SIZE " << TABLE_SIZE << "\n";
+        return defines.str();
+    }
+}
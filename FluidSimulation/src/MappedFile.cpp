@@ -0,0 +1,211 @@
+#include "MappedFile.h"
+#include <algorithm>
+#include <utility>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <vector>
+#endif
+
+namespace {
+    std::size_t PageSize() {
+#if defined(_WIN32)
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        return info.dwPageSize;
+#else
+        static const std::size_t pageSize = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+        return pageSize;
+#endif
+    }
+
+    // [offset, offset + bytes) clipped to size and widened (outward) or narrowed (inward) to whole
+    // pages; false if nothing is left
+    bool PageRange(std::size_t offset, std::size_t bytes, std::size_t size, bool outward, std::size_t& first, std::size_t& last) {
+        std::size_t page = PageSize();
+        std::size_t end = offset < size ? std::min(size, offset + bytes) : offset;
+        first = outward ? offset / page * page : (offset + page - 1) / page * page;
+        last = outward ? std::min((end + page - 1) / page * page, (size + page - 1) / page * page) : end / page * page;
+        return first < last;
+    }
+}
+
+#if defined(_WIN32)
+MappedFile::MappedFile() : data(nullptr), size(0), file(INVALID_HANDLE_VALUE), mapping(nullptr) {}
+#else
+MappedFile::MappedFile() : data(nullptr), size(0), file(-1) {}
+#endif
+
+MappedFile::~MappedFile() {
+    Close();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept : MappedFile() {
+    *this = std::move(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+    std::swap(data, other.data);
+    std::swap(size, other.size);
+    std::swap(file, other.file);
+#if defined(_WIN32)
+    std::swap(mapping, other.mapping);
+#endif
+    return *this;
+}
+
+bool MappedFile::Open(const std::string& path) {
+    Close();
+#if defined(_WIN32)
+    // Deleted by the OS once the handle closes; the temporary attribute keeps it in the cache
+    // while memory allows
+    file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+                       FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, nullptr);
+    return file != INVALID_HANDLE_VALUE;
+#else
+    // Unlinked at once: the open descriptor keeps the data, and nothing is left behind on exit
+    file = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (file < 0) return false;
+    unlink(path.c_str());
+    return true;
+#endif
+}
+
+void MappedFile::Close() {
+    Unmap();
+#if defined(_WIN32)
+    if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+    file = INVALID_HANDLE_VALUE;
+#else
+    if (file >= 0) close(file);
+    file = -1;
+#endif
+    size = 0;
+}
+
+bool MappedFile::IsOpen() const {
+#if defined(_WIN32)
+    return file != INVALID_HANDLE_VALUE;
+#else
+    return file >= 0;
+#endif
+}
+
+bool MappedFile::Resize(std::size_t bytes) {
+    if (!IsOpen()) return false;
+    Unmap();
+#if defined(_WIN32)
+    LARGE_INTEGER end;
+    end.QuadPart = static_cast<LONGLONG>(bytes);
+    if (!SetFilePointerEx(file, end, nullptr, FILE_BEGIN) || !SetEndOfFile(file)) return false;
+#else
+    if (ftruncate(file, static_cast<off_t>(bytes)) != 0) return false;
+#endif
+    size = bytes;
+    return Map();
+}
+
+bool MappedFile::Map() {
+    if (size == 0) return true;
+#if defined(_WIN32)
+    mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE, static_cast<DWORD>(static_cast<unsigned long long>(size) >> 32),
+                                 static_cast<DWORD>(size), nullptr);
+    if (!mapping) return false;
+    data = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+#else
+    void* view = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+    data = view != MAP_FAILED ? view : nullptr;
+#endif
+    if (!data) size = 0;
+    return data != nullptr;
+}
+
+void MappedFile::Unmap() {
+#if defined(_WIN32)
+    if (data) UnmapViewOfFile(data);
+    if (mapping) CloseHandle(mapping);
+    mapping = nullptr;
+#else
+    if (data) munmap(data, size);
+#endif
+    data = nullptr;
+}
+
+bool MappedFile::Prefetch(std::size_t offset, std::size_t bytes) const {
+    std::size_t first, last;
+    if (!data || !PageRange(offset, bytes, size, true, first, last)) return false;
+    char* begin = static_cast<char*>(data) + first;
+#if defined(_WIN32)
+#if _WIN32_WINNT >= 0x0602
+    WIN32_MEMORY_RANGE_ENTRY range = { begin, last - first };
+    return PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0) != 0;
+#else
+    return false;
+#endif
+#else
+    return madvise(begin, last - first, MADV_WILLNEED) == 0;
+#endif
+}
+
+bool MappedFile::WriteBack(std::size_t offset, std::size_t bytes, bool wait) const {
+    std::size_t first, last;
+    if (!data || !PageRange(offset, bytes, size, true, first, last)) return false;
+#if defined(_WIN32)
+    return FlushViewOfFile(static_cast<char*>(data) + first, last - first) != 0 && (!wait || FlushFileBuffers(file) != 0);
+#elif defined(__linux__)
+    // msync(MS_ASYNC) does nothing on Linux; this queues the writes, and waits only if asked
+    unsigned int flags = wait ? SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER : SYNC_FILE_RANGE_WRITE;
+    return sync_file_range(file, static_cast<off_t>(first), static_cast<off_t>(last - first), flags) == 0;
+#else
+    return msync(static_cast<char*>(data) + first, last - first, wait ? MS_SYNC : MS_ASYNC) == 0;
+#endif
+}
+
+bool MappedFile::Discard(std::size_t offset, std::size_t bytes) {
+    std::size_t first, last;
+    if (!data || !PageRange(offset, bytes, size, false, first, last)) return false;
+    char* begin = static_cast<char*>(data) + first;
+#if defined(_WIN32)
+    // Unlocking pages that are not locked takes them out of the working set
+    VirtualUnlock(begin, last - first);
+    return true;
+#else
+#if defined(MADV_REMOVE)
+    if (madvise(begin, last - first, MADV_REMOVE) == 0) return true;
+#endif
+    return madvise(begin, last - first, MADV_DONTNEED) == 0;
+#endif
+}
+
+bool MappedFile::CountResident(std::size_t& bytes) const {
+    bytes = 0;
+    if (!data) return IsOpen();
+#if defined(_WIN32)
+    return false;
+#else
+    std::size_t page = PageSize();
+    std::size_t pages = (size + page - 1) / page;
+    const std::size_t BATCH = 1 << 16;
+#if defined(__APPLE__)
+    std::vector<char> resident(std::min(pages, BATCH));
+#else
+    std::vector<unsigned char> resident(std::min(pages, BATCH));
+#endif
+    for (std::size_t done = 0; done < pages; done += BATCH) {
+        std::size_t count = std::min(BATCH, pages - done);
+        if (mincore(static_cast<char*>(data) + done * page, count * page, resident.data()) != 0) {
+            return false;
+        }
+        for (std::size_t p = 0; p < count; ++p) {
+            if (resident[p] & 1) bytes += page;
+        }
+    }
+    return true;
+#endif
+}
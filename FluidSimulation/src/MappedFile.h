@@ -0,0 +1,53 @@
+#pragma once
+#include <cstddef>
+#include <string>
+
+// A scratch file mapped into memory, shared with the page cache, through the OS directly (mmap
+// and madvise on POSIX, file mappings on Windows). The OS pages it in on first touch and writes
+// it back on its own, so it can hold more than fits in RAM; the advice calls tell it which
+// ranges to read ahead and which to drop. The file is deleted when the object goes; on POSIX
+// its name is gone as soon as it is open.
+class MappedFile {
+public:
+    MappedFile();
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+
+    // Creates (or empties) the file at path; false if the OS refused
+    bool Open(const std::string& path);
+    void Close();
+    bool IsOpen() const;
+
+    // Sets the file size and remaps it; the content up to the smaller size stays. Invalidates Data().
+    bool Resize(std::size_t bytes);
+    void* Data() const { return data; }
+    std::size_t Size() const { return size; }
+
+    // Starts reading [offset, offset + bytes) in the background, for a pass that will soon need it
+    bool Prefetch(std::size_t offset, std::size_t bytes) const;
+    // Starts writing the dirty pages of the range back, so they can be dropped without waiting;
+    // with wait, returns once they are written. A writer that waits on what it wrote a while ago
+    // keeps its dirty pages bounded instead of leaving the OS to stall it when memory runs out.
+    bool WriteBack(std::size_t offset, std::size_t bytes, bool wait = false) const;
+    // The range's content is no longer needed: where the file system punches holes its pages and
+    // disk blocks are freed and it reads as zeros after, elsewhere its pages only leave this
+    // mapping. Only whole pages inside the range are touched.
+    bool Discard(std::size_t offset, std::size_t bytes);
+    // Bytes of the file in the page cache; false if the OS cannot say
+    bool CountResident(std::size_t& bytes) const;
+
+private:
+    void* data;
+    std::size_t size;
+#if defined(_WIN32)
+    void* file;
+    void* mapping;
+#else
+    int file;
+#endif
+    bool Map();
+    void Unmap();
+};
@@ -0,0 +1,237 @@
+#include "Numa.h"
+#include <algorithm>
+#include <cstdint>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <psapi.h>
+#elif defined(__linux__)
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#endif
+
+namespace {
+    // Pages per placement query
+    const std::size_t PAGE_BATCH = 1024;
+
+#if defined(__linux__)
+    // "0-3,8-11" -> 0 1 2 3 8 9 10 11
+    std::vector<unsigned int> ParseCpuList(const char* list) {
+        std::vector<unsigned int> cpus;
+        const char* c = list;
+        while (*c) {
+            char* end;
+            unsigned long first = std::strtoul(c, &end, 10);
+            if (end == c) break;
+            unsigned long last = first;
+            c = end;
+            if (*c == '-') {
+                last = std::strtoul(c + 1, &end, 10);
+                c = end;
+            }
+            for (unsigned long cpu = first; cpu <= last; ++cpu) {
+                cpus.push_back(static_cast<unsigned int>(cpu));
+            }
+            if (*c == ',') ++c;
+            else break;
+        }
+        return cpus;
+    }
+
+    bool Pin(pthread_t thread, const NumaNode& node) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        bool any = false;
+        for (unsigned int cpu : node.cpus) {
+            if (cpu < CPU_SETSIZE) {
+                CPU_SET(cpu, &set);
+                any = true;
+            }
+        }
+        return any && pthread_setaffinity_np(thread, sizeof(set), &set) == 0;
+    }
+#elif defined(_WIN32)
+    // The node's CPUs in the processor group of its first one
+    bool Pin(HANDLE thread, const NumaNode& node) {
+        if (node.cpus.empty()) return false;
+        GROUP_AFFINITY affinity = {};
+        affinity.Group = static_cast<WORD>(node.cpus[0] / 64);
+        for (unsigned int cpu : node.cpus) {
+            if (cpu / 64 == affinity.Group) affinity.Mask |= KAFFINITY(1) << (cpu % 64);
+        }
+        return SetThreadGroupAffinity(thread, &affinity, nullptr) != 0;
+    }
+#endif
+}
+
+std::vector<NumaNode> Numa::OsNodes() {
+    std::vector<NumaNode> nodes;
+#if defined(__linux__)
+    if (DIR* directory = opendir("/sys/devices/system/node")) {
+        while (dirent* entry = readdir(directory)) {
+            unsigned int osNode;
+            char rest;
+            if (std::sscanf(entry->d_name, "node%u%c", &osNode, &rest) != 1) continue;
+            std::string path = std::string("/sys/devices/system/node/") + entry->d_name + "/cpulist";
+            if (FILE* file = std::fopen(path.c_str(), "r")) {
+                char list[4096] = {};
+                if (std::fgets(list, sizeof(list), file)) {
+                    NumaNode node{ osNode, ParseCpuList(list) };
+                    if (!node.cpus.empty()) nodes.push_back(node);
+                }
+                std::fclose(file);
+            }
+        }
+        closedir(directory);
+    }
+    std::sort(nodes.begin(), nodes.end(), [](const NumaNode& a, const NumaNode& b) { return a.osNode < b.osNode; });
+#elif defined(_WIN32)
+    ULONG highest = 0;
+    if (GetNumaHighestNodeNumber(&highest)) {
+        for (ULONG osNode = 0; osNode <= highest; ++osNode) {
+            GROUP_AFFINITY affinity = {};
+            if (!GetNumaNodeProcessorMaskEx(static_cast<USHORT>(osNode), &affinity)) continue;
+            NumaNode node{ static_cast<unsigned int>(osNode), {} };
+            for (unsigned int bit = 0; bit < 64; ++bit) {
+                if (affinity.Mask & (KAFFINITY(1) << bit)) node.cpus.push_back(64 * affinity.Group + bit);
+            }
+            if (!node.cpus.empty()) nodes.push_back(node);
+        }
+    }
+#endif
+    if (nodes.empty()) {
+        NumaNode node{ 0, {} };
+        unsigned int cpus = std::max(1u, std::thread::hardware_concurrency());
+        for (unsigned int cpu = 0; cpu < cpus; ++cpu) node.cpus.push_back(cpu);
+        nodes.push_back(node);
+    }
+    return nodes;
+}
+
+std::vector<NumaNode> Numa::Layout(unsigned int count) {
+    std::vector<NumaNode> os = OsNodes();
+    if (count == 0 || count == os.size()) return os;
+
+    std::vector<NumaNode> nodes(count);
+    size_t osCount = os.size();
+    if (count < osCount) {
+        // Node k takes OS nodes [k * os / count, (k + 1) * os / count); its memory is counted
+        // against the first of them
+        for (unsigned int k = 0; k < count; ++k) {
+            size_t first = k * osCount / count, last = (k + 1) * osCount / count;
+            nodes[k].osNode = os[first].osNode;
+            for (size_t n = first; n < last; ++n) {
+                nodes[k].cpus.insert(nodes[k].cpus.end(), os[n].cpus.begin(), os[n].cpus.end());
+            }
+        }
+        return nodes;
+    }
+
+    // Node k splits OS node k * os / count with the others that map there, CPU by CPU
+    for (unsigned int k = 0; k < count; ++k) {
+        size_t n = k * osCount / count;
+        size_t firstPart = (n * count + osCount - 1) / osCount;
+        size_t parts = ((n + 1) * count + osCount - 1) / osCount - firstPart;
+        size_t part = k - firstPart;
+        const std::vector<unsigned int>& cpus = os[n].cpus;
+        size_t begin = part * cpus.size() / parts, end = (part + 1) * cpus.size() / parts;
+        nodes[k].osNode = os[n].osNode;
+        if (begin == end) nodes[k].cpus = cpus;  // fewer CPUs than parts: share them all
+        else nodes[k].cpus.assign(cpus.begin() + begin, cpus.begin() + end);
+    }
+    return nodes;
+}
+
+bool Numa::PinThread(std::thread& thread, const NumaNode& node) {
+#if defined(__linux__)
+    return Pin(thread.native_handle(), node);
+#elif defined(_WIN32)
+    return Pin(static_cast<HANDLE>(thread.native_handle()), node);
+#else
+    (void)thread; (void)node;
+    return false;
+#endif
+}
+
+bool Numa::PinCurrentThread(const NumaNode& node) {
+#if defined(__linux__)
+    return Pin(pthread_self(), node);
+#elif defined(_WIN32)
+    return Pin(GetCurrentThread(), node);
+#else
+    (void)node;
+    return false;
+#endif
+}
+
+bool Numa::AdviseHugePages(void* data, std::size_t bytes) {
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+    const std::uintptr_t HUGE_PAGE = std::uintptr_t(2) << 20;
+    std::uintptr_t begin = (reinterpret_cast<std::uintptr_t>(data) + HUGE_PAGE - 1) & ~(HUGE_PAGE - 1);
+    std::uintptr_t end = (reinterpret_cast<std::uintptr_t>(data) + bytes) & ~(HUGE_PAGE - 1);
+    if (end <= begin) return false;
+    return madvise(reinterpret_cast<void*>(begin), end - begin, MADV_HUGEPAGE) == 0;
+#else
+    (void)data; (void)bytes;
+    return false;
+#endif
+}
+
+bool Numa::CountPages(const void* data, std::size_t bytes, unsigned int osNode, std::size_t& onNode, std::size_t& total) {
+    if (bytes == 0) return true;
+#if defined(__linux__) && defined(SYS_move_pages)
+    std::uintptr_t pageSize = static_cast<std::uintptr_t>(sysconf(_SC_PAGESIZE));
+    std::uintptr_t first = reinterpret_cast<std::uintptr_t>(data) & ~(pageSize - 1);
+    std::uintptr_t last = reinterpret_cast<std::uintptr_t>(data) + bytes;
+    void* pages[PAGE_BATCH];
+    int status[PAGE_BATCH];
+    for (std::uintptr_t page = first; page < last;) {
+        unsigned long n = 0;
+        for (; n < PAGE_BATCH && page < last; ++n, page += pageSize) {
+            pages[n] = reinterpret_cast<void*>(page);
+        }
+        // With no target nodes, move_pages only reports where each page is
+        if (syscall(SYS_move_pages, 0, n, pages, nullptr, status, 0) != 0) return false;
+        for (unsigned long p = 0; p < n; ++p) {
+            if (status[p] < 0) continue;  // not resident
+            ++total;
+            if (static_cast<unsigned int>(status[p]) == osNode) ++onNode;
+        }
+    }
+    return true;
+#elif defined(_WIN32)
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    std::uintptr_t pageSize = info.dwPageSize;
+    std::uintptr_t first = reinterpret_cast<std::uintptr_t>(data) & ~(pageSize - 1);
+    std::uintptr_t last = reinterpret_cast<std::uintptr_t>(data) + bytes;
+    PSAPI_WORKING_SET_EX_INFORMATION pages[PAGE_BATCH];
+    for (std::uintptr_t page = first; page < last;) {
+        DWORD n = 0;
+        for (; n < PAGE_BATCH && page < last; ++n, page += pageSize) {
+            pages[n] = {};
+            pages[n].VirtualAddress = reinterpret_cast<void*>(page);
+        }
+        if (!QueryWorkingSetEx(GetCurrentProcess(), pages, sizeof(pages[0]) * n)) return false;
+        for (DWORD p = 0; p < n; ++p) {
+            if (!pages[p].VirtualAttributes.Valid) continue;
+            ++total;
+            if (pages[p].VirtualAttributes.Node == osNode) ++onNode;
+        }
+    }
+    return true;
+#else
+    (void)data; (void)osNode; (void)onNode; (void)total;
+    return false;
+#endif
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+// One memory node as the CPU backend partitions work over it: the logical CPUs its threads are
+// pinned to and the OS node whose memory they touch first
+struct NumaNode {
+    unsigned int osNode;
+    std::vector<unsigned int> cpus;  // Windows: 64 * processor group + bit
+};
+
+// NUMA topology, thread pinning and page placement queries, through the OS directly (sysfs and
+// the affinity and move_pages calls on Linux, the NUMA and working set API on Windows), so the
+// build needs no NUMA library. Elsewhere the machine is one node and pinning does nothing.
+namespace Numa {
+    // Nodes the OS reports that have CPUs; one node with every CPU when it reports none
+    std::vector<NumaNode> OsNodes();
+
+    // `count` nodes for the CPU backend's slabs: the OS nodes for 0, the OS nodes merged down to
+    // `count` when it has more, or split by CPU into `count` when it has fewer. A split layout
+    // keeps every part on its OS node's memory; it exercises the slab partitioning on one
+    // socket but cannot gain from it.
+    std::vector<NumaNode> Layout(unsigned int count);
+
+    // Restrict a thread to the node's CPUs; false if the OS refused or cannot pin
+    bool PinThread(std::thread& thread, const NumaNode& node);
+    bool PinCurrentThread(const NumaNode& node);
+
+    // Asks for transparent huge pages over the 2 MB pages that lie wholly inside [data,
+    // data + bytes); call before the memory is touched. False where unsupported (Windows large
+    // pages need a privilege and their own allocation, so they are not used).
+    bool AdviseHugePages(void* data, std::size_t bytes);
+
+    // Adds the resident pages of [data, data + bytes) to `total`, and those on osNode to
+    // `onNode`; pages never touched are not counted. False if the OS cannot say.
+    bool CountPages(const void* data, std::size_t bytes, unsigned int osNode, std::size_t& onNode, std::size_t& total);
+}
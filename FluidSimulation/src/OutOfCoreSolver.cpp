@@ -0,0 +1,387 @@
+#include "OutOfCoreSolver.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace {
+    // A tile's window reaches two rows into each neighbour, so tiles of at least two rows keep
+    // every window within the tiles next to its own
+    const unsigned int MIN_TILE_ROWS = 2;
+    const unsigned int MAX_GRID_DIM = 1u << 16;
+
+    // Spare records when a tile file grows, so that particles arriving step by step do not
+    // remap it every time
+    size_t WithHeadroom(size_t count) {
+        return count + count / 4 + 1024;
+    }
+}
+
+OutOfCoreSolver::OutOfCoreSolver(const std::string& directory, unsigned int threads, size_t tileParticles)
+    : directory(directory), tileParticles(std::max<size_t>(1, tileParticles)), current(0), particleCount(0), gridDim(1),
+      cellSize(2.0f), boundaryLimit(1.0f), windowFirstRow(0), windowRows(0), prefetched(false), windowBytes(0),
+      largestWindow(0), haloParticles(0), windowParticles(0), migrated(0), residentFraction(-1.0), steps(0),
+      lastStepMilliseconds(0.0), totalMilliseconds(0.0), pool(threads)
+{
+    reductions.resize(pool.GetThreadCount());
+}
+
+unsigned int OutOfCoreSolver::CellCoordinate(float v) const {
+    // CpuSolver's clamping: anything past the walls (or NaN) joins the edge cells
+    float f = (v + boundaryLimit) / cellSize;
+    float last = static_cast<float>(gridDim - 1);
+    return static_cast<unsigned int>(f >= 0.0f ? std::min(f, last) : 0.0f);
+}
+
+bool OutOfCoreSolver::Reserve(Tile& tile, unsigned int copy, size_t count) {
+    if (count <= tile.Capacity(copy)) return true;
+    return tile.files[copy].Resize(WithHeadroom(count) * sizeof(Record));
+}
+
+bool OutOfCoreSolver::Reset(Scene scene, unsigned int count, const Simulation& sim, float limit, float initialTimestep) {
+    tiles.clear();
+    boundaryLimit = limit;
+    float domain = 2.0f * boundaryLimit;
+    gridDim = std::clamp(static_cast<unsigned int>(domain / sim.smoothingRadius), 1u, MAX_GRID_DIM);
+    cellSize = domain / gridDim;
+
+    // Rows of the layout, then bands of whole rows holding about tileParticles each; the rows
+    // left over above the last full band join it
+    std::vector<size_t> rowCounts(gridDim, 0);
+    Simulation::LayOutScene(scene, count, [&](unsigned int, glm::vec2 position) { ++rowCounts[CellCoordinate(position.y)]; });
+    unsigned int firstRow = 0;
+    size_t fill = 0;
+    for (unsigned int row = 0; row < gridDim; ++row) {
+        fill += rowCounts[row];
+        unsigned int rows = row + 1 - firstRow;
+        if (fill >= tileParticles && rows >= MIN_TILE_ROWS && gridDim - (row + 1) >= MIN_TILE_ROWS) {
+            tiles.emplace_back();
+            tiles.back().firstRow = firstRow;
+            tiles.back().rows = rows;
+            firstRow = row + 1;
+            fill = 0;
+        }
+    }
+    tiles.emplace_back();
+    tiles.back().firstRow = firstRow;
+    tiles.back().rows = gridDim - firstRow;
+
+    // Every tile's rows sorted in copy 0 from the start: each particle goes straight to its
+    // row's next slot
+    rowTiles.resize(gridDim);
+    rowFill.resize(gridDim);
+    particleCount = 0;
+    for (size_t k = 0; k < tiles.size(); ++k) {
+        Tile& tile = tiles[k];
+        std::vector<size_t>& rowStart = tile.rowStart[0];
+        rowStart.assign(tile.rows + 1, 0);
+        for (unsigned int row = 0; row < tile.rows; ++row) {
+            rowTiles[tile.firstRow + row] = static_cast<unsigned int>(k);
+            rowFill[tile.firstRow + row] = rowStart[row];
+            rowStart[row + 1] = rowStart[row] + rowCounts[tile.firstRow + row];
+        }
+        for (unsigned int copy = 0; copy < 2; ++copy) {
+            std::string path = directory + "/tile" + std::to_string(k) + "_" + std::to_string(copy) + ".bin";
+            if (!tile.files[copy].Open(path) || !Reserve(tile, copy, rowStart[tile.rows])) {
+                tiles.clear();
+                return false;
+            }
+            tile.count[copy] = 0;
+            tile.sorted[copy] = 0;
+        }
+        tile.count[0] = tile.sorted[0] = rowStart[tile.rows];
+        particleCount += tile.count[0];
+    }
+
+    // Each tile is written back once it is full, and the tile filled two before it waited for,
+    // which keeps the dirty pages to a few tiles
+    std::vector<size_t> placed(tiles.size(), 0);
+    std::vector<size_t> filled;
+    Simulation::LayOutScene(scene, count, [&](unsigned int, glm::vec2 position) {
+        unsigned int row = CellCoordinate(position.y);
+        size_t k = rowTiles[row];
+        Tile& tile = tiles[k];
+        tile.Records(0)[rowFill[row]++] = Record{ position.x, position.y, 0.0f, 0.0f };
+        if (++placed[k] < tile.count[0]) return;
+        tile.files[0].WriteBack(0, tile.count[0] * sizeof(Record));
+        filled.push_back(k);
+        if (filled.size() > 2) {
+            const Tile& written = tiles[filled[filled.size() - 3]];
+            written.files[0].WriteBack(0, written.count[0] * sizeof(Record), true);
+        }
+    });
+    current = 0;
+
+    stepStats = StepStats();
+    stepStats.deltaTime = initialTimestep;
+    stepStats.previousDeltaTime = 0.0f;
+    prefetched = false;
+    windowBytes = 0;
+    largestWindow = 0;
+    haloParticles = 0;
+    windowParticles = 0;
+    migrated = 0;
+    residentFraction = MeasureResidency();
+    steps = 0;
+    lastStepMilliseconds = 0.0;
+    totalMilliseconds = 0.0;
+    return true;
+}
+
+template <typename Body>
+void OutOfCoreSolver::ForEachInRows(const Tile& tile, unsigned int firstRow, unsigned int lastRow, Body&& body) const {
+    firstRow = std::max(firstRow, tile.firstRow);
+    lastRow = std::min(lastRow, tile.firstRow + tile.rows);
+    if (firstRow >= lastRow) return;
+    const Record* records = tile.Records(current);
+    const std::vector<size_t>& rowStart = tile.rowStart[current];
+    for (size_t i = rowStart[firstRow - tile.firstRow]; i < rowStart[lastRow - tile.firstRow]; ++i) {
+        body(records[i]);
+    }
+    for (size_t i = tile.sorted[current]; i < tile.count[current]; ++i) {
+        unsigned int row = CellCoordinate(records[i].y);
+        if (row >= firstRow && row < lastRow) body(records[i]);
+    }
+}
+
+void OutOfCoreSolver::BuildWindow(size_t k) {
+    const Tile& tile = tiles[k];
+    unsigned int tileEnd = tile.firstRow + tile.rows;
+    windowFirstRow = tile.firstRow >= 2 ? tile.firstRow - 2 : 0;
+    windowRows = std::min(gridDim, tileEnd + 2) - windowFirstRow;
+
+    // The tile, and the halo rows of the tiles on either side
+    auto gather = [&](auto&& body) {
+        if (k > 0) ForEachInRows(tiles[k - 1], windowFirstRow, tile.firstRow, body);
+        ForEachInRows(tile, tile.firstRow, tileEnd, body);
+        if (k + 1 < tiles.size()) ForEachInRows(tiles[k + 1], tileEnd, windowFirstRow + windowRows, body);
+    };
+
+    // Counting sort into cell order, as CpuSolver's, over the window's rows and the empty one above
+    size_t cells = static_cast<size_t>(windowRows + 1) * gridDim;
+    cellStart.assign(cells + 1, 0);
+    gatheredCells.clear();
+    gather([&](const Record& record) {
+        unsigned int cell = (CellCoordinate(record.y) - windowFirstRow) * gridDim + CellCoordinate(record.x);
+        gatheredCells.push_back(cell);
+        ++cellStart[cell];
+    });
+    unsigned int sum = 0;
+    for (size_t cell = 0; cell <= cells; ++cell) {
+        unsigned int cellCount = cellStart[cell];
+        cellStart[cell] = sum;
+        sum += cellCount;
+    }
+
+    size_t count = gatheredCells.size();
+    for (std::vector<float>* field : { &posX, &posY, &velX, &velY, &densities, &pressures }) {
+        field->resize(count);
+    }
+    particleCells.resize(count);
+    cellFill.assign(cellStart.begin(), cellStart.end() - 1);
+    size_t gathered = 0;
+    gather([&](const Record& record) {
+        unsigned int cell = gatheredCells[gathered++];
+        unsigned int slot = cellFill[cell]++;
+        posX[slot] = record.x;
+        posY[slot] = record.y;
+        velX[slot] = record.vx;
+        velY[slot] = record.vy;
+        particleCells[slot] = cell;
+    });
+
+    windowParticles += count;
+    haloParticles += count - tile.count[current];
+    largestWindow = std::max(largestWindow, count);
+    size_t bytes = count * (6 * sizeof(float) + 2 * sizeof(unsigned int) + sizeof(Record) + sizeof(unsigned int))
+                 + (2 * cells + 1) * sizeof(unsigned int);
+    windowBytes = std::max(windowBytes, bytes);
+}
+
+bool OutOfCoreSolver::StoreTile(size_t k) {
+    Tile& tile = tiles[k];
+    unsigned int other = 1 - current;
+
+    // Rows of the particles that stay, then the particles themselves in row order
+    std::vector<size_t>& rowStart = tile.rowStart[other];
+    rowStart.assign(tile.rows + 1, 0);
+    for (unsigned int row : advancedRows) {
+        if (row >= tile.firstRow && row < tile.firstRow + tile.rows) ++rowStart[row - tile.firstRow + 1];
+    }
+    for (unsigned int row = 0; row < tile.rows; ++row) {
+        rowStart[row + 1] += rowStart[row];
+    }
+    size_t stay = rowStart[tile.rows];
+    if (!Reserve(tile, other, stay)) return false;
+
+    rowFill.assign(rowStart.begin(), rowStart.end() - 1);
+    Record* records = tile.Records(other);
+    for (size_t j = 0; j < advanced.size(); ++j) {
+        unsigned int row = advancedRows[j];
+        if (row >= tile.firstRow && row < tile.firstRow + tile.rows) {
+            records[rowFill[row - tile.firstRow]++] = advanced[j];
+        }
+        else {
+            tiles[rowTiles[row]].arrivals.push_back(advanced[j]);
+            ++migrated;
+        }
+    }
+    tile.count[other] = stay;
+    tile.sorted[other] = stay;
+    tile.files[other].WriteBack(0, stay * sizeof(Record));
+    return true;
+}
+
+bool OutOfCoreSolver::Step(const Simulation& sim) {
+    auto start = std::chrono::steady_clock::now();
+    float dt = sim.adaptiveTimestep ? stepStats.deltaTime : sim.fixedTimestep;
+    CpuKernelSet<float, float> kernels = CpuKernels::Get<float, float>(sim.cpuIsa, sim.kernelFamily);
+    CpuIntegration::ParticleStep<float> step(sim, dt, stepStats.previousDeltaTime, false, glm::vec2(0.0f), boundaryLimit);
+    for (CpuIntegration::Reduction& reduction : reductions) {
+        reduction = CpuIntegration::Reduction{ 0.0f, 0.0f, 0 };
+    }
+    largestWindow = 0;
+    haloParticles = 0;
+    windowParticles = 0;
+    migrated = 0;
+
+    // The first two tiles now; every tile after that two tiles ahead of the one in hand
+    bool advised = true;
+    auto prefetch = [&](const Tile& tile) {
+        if (tile.count[current] > 0) advised &= tile.files[current].Prefetch(0, tile.count[current] * sizeof(Record));
+    };
+    for (size_t k = 0; k < tiles.size() && k < 2; ++k) {
+        prefetch(tiles[k]);
+    }
+
+    unsigned int other = 1 - current;
+    for (size_t k = 0; k < tiles.size(); ++k) {
+        Tile& tile = tiles[k];
+        if (k + 2 < tiles.size()) prefetch(tiles[k + 2]);
+        BuildWindow(k);
+
+        CpuNeighbourData<float, float> data;
+        data.posX = posX.data();
+        data.posY = posY.data();
+        data.velX = velX.data();
+        data.velY = velY.data();
+        data.densities = densities.data();
+        data.pressures = pressures.data();
+        data.particleCells = particleCells.data();
+        data.cellStart = cellStart.data();
+        data.gridDim = gridDim;
+        CpuIntegration::SetParameters(data, sim);
+
+        // Densities of the tile and the row on either side, which the tile's forces read
+        unsigned int tileRow = tile.firstRow - windowFirstRow;
+        unsigned int densityFirstRow = tileRow > 0 ? tileRow - 1 : 0;
+        unsigned int densityLastRow = std::min(windowRows, tileRow + tile.rows + 1);
+        unsigned int densityFirst = cellStart[densityFirstRow * gridDim];
+        unsigned int densityCount = cellStart[densityLastRow * gridDim] - densityFirst;
+        float gasConstant = sim.gasConstant;
+        float restDensity = sim.restDensity;
+        pool.ParallelFor(densityCount, pool.DefaultGrain(densityCount), [&](size_t begin, size_t end, unsigned int) {
+            for (size_t i = densityFirst + begin; i < densityFirst + end; ++i) {
+                float density = std::max(kernels.density(data, static_cast<unsigned int>(i)), 1e-4f);
+                densities[i] = density;
+                pressures[i] = std::max(gasConstant * (density - restDensity), 0.0f);
+            }
+        });
+
+        // Forces and integration of the tile's own particles
+        unsigned int tileFirst = cellStart[tileRow * gridDim];
+        unsigned int tileCount = cellStart[(tileRow + tile.rows) * gridDim] - tileFirst;
+        advanced.resize(tileCount);
+        advancedRows.resize(tileCount);
+        pool.ParallelFor(tileCount, pool.DefaultGrain(tileCount), [&](size_t begin, size_t end, unsigned int thread) {
+            CpuIntegration::Reduction& reduction = reductions[thread];
+            for (size_t j = begin; j < end; ++j) {
+                unsigned int i = tileFirst + static_cast<unsigned int>(j);
+                CpuForceSums<float> sums;
+                kernels.forces(data, i, sums);
+                glm::vec2 pos_i(posX[i], posY[i]);
+                glm::vec2 vel_i(velX[i], velY[i]);
+                step.Advance(pos_i, vel_i, sums, reduction);
+                advanced[j] = Record{ pos_i.x, pos_i.y, vel_i.x, vel_i.y };
+                advancedRows[j] = CellCoordinate(pos_i.y);
+            }
+        });
+        if (!StoreTile(k)) return false;
+        if (k >= 2) {
+            const Tile& written = tiles[k - 2];
+            written.files[other].WriteBack(0, written.count[other] * sizeof(Record), true);
+        }
+
+        // The windows that read tile k - 1 are done: its copy of the state is spent
+        if (k > 0) tiles[k - 1].files[current].Discard(0, tiles[k - 1].files[current].Size());
+    }
+    if (!tiles.empty()) tiles.back().files[current].Discard(0, tiles.back().files[current].Size());
+
+    // Particles that changed tile, after the rows sorted there
+    for (Tile& tile : tiles) {
+        if (tile.arrivals.empty()) continue;
+        size_t first = tile.count[other];
+        if (!Reserve(tile, other, first + tile.arrivals.size())) return false;
+        std::copy(tile.arrivals.begin(), tile.arrivals.end(), tile.Records(other) + first);
+        tile.count[other] += tile.arrivals.size();
+        tile.files[other].WriteBack(first * sizeof(Record), tile.arrivals.size() * sizeof(Record));
+        tile.arrivals.clear();
+    }
+    current = other;
+    prefetched = advised;
+
+    // TIMESTEP, as CpuSolver's
+    float maxSpeed = 0.0f, maxAccel = 0.0f;
+    unsigned int nanResets = 0;
+    for (const CpuIntegration::Reduction& reduction : reductions) {
+        maxSpeed = std::max(maxSpeed, reduction.maxSpeed);
+        maxAccel = std::max(maxAccel, reduction.maxAccel);
+        nanResets += reduction.nanResets;
+    }
+    float dtVelocity = sim.cflNumber * sim.smoothingRadius / std::max(maxSpeed, 1e-6f);
+    float dtForce = sim.forceFactor * std::sqrt(sim.smoothingRadius / std::max(maxAccel, 1e-6f));
+    stepStats.previousDeltaTime = dt;
+    stepStats.deltaTime = std::clamp(std::min(dtVelocity, dtForce), sim.minTimestep, sim.maxTimestep);
+    stepStats.maxSpeed = maxSpeed;
+    stepStats.maxAccel = maxAccel;
+    stepStats.nanResets = nanResets;
+    stepStats.totalNanResets += nanResets;
+
+    residentFraction = MeasureResidency();
+    lastStepMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    totalMilliseconds += lastStepMilliseconds;
+    ++steps;
+    return true;
+}
+
+double OutOfCoreSolver::MeasureResidency() const {
+    size_t resident = 0, total = 0;
+    for (const Tile& tile : tiles) {
+        size_t bytes;
+        if (!tile.files[current].CountResident(bytes)) return -1.0;
+        resident += bytes;
+        total += tile.count[current] * sizeof(Record);
+    }
+    return total > 0 ? std::min(1.0, static_cast<double>(resident) / total) : 0.0;
+}
+
+OutOfCoreStats OutOfCoreSolver::GetStats() const {
+    OutOfCoreStats stats;
+    stats.threads = pool.GetThreadCount();
+    stats.tiles = static_cast<unsigned int>(tiles.size());
+    stats.gridDim = gridDim;
+    stats.particles = particleCount;
+    for (const Tile& tile : tiles) {
+        stats.fileBytes += tile.files[0].Size() + tile.files[1].Size();
+    }
+    stats.windowBytes = windowBytes;
+    stats.largestWindow = largestWindow;
+    stats.haloFraction = windowParticles > 0 ? static_cast<double>(haloParticles) / windowParticles : 0.0;
+    stats.migratedFraction = particleCount > 0 ? static_cast<double>(migrated) / particleCount : 0.0;
+    stats.residentFraction = residentFraction;
+    stats.prefetched = prefetched;
+    stats.steps = steps;
+    stats.lastStepMilliseconds = lastStepMilliseconds;
+    stats.stepsPerSecond = totalMilliseconds > 0.0 ? 1000.0 * steps / totalMilliseconds : 0.0;
+    stats.nanosecondsPerParticle = steps > 0 && particleCount > 0 ? 1e6 * totalMilliseconds / (static_cast<double>(steps) * particleCount) : 0.0;
+    return stats;
+}
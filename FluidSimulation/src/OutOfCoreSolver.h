@@ -0,0 +1,161 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "glm.hpp"
+#include "Simulation.h"
+#include "ThreadPool.h"
+#include "MappedFile.h"
+#include "CpuKernels.h"
+#include "CpuIntegration.h"
+
+// Throughput and memory of the out-of-core solver since the last Reset.
+struct OutOfCoreStats {
+    unsigned int threads = 0;
+    unsigned int tiles = 0;
+    unsigned int gridDim = 0;            // cells per side
+    size_t particles = 0;
+    size_t fileBytes = 0;                // both copies of every tile file
+    size_t windowBytes = 0;              // RAM of the largest window so far, halos and cell list included
+    size_t largestWindow = 0;            // particles in the largest window of the last step
+    double haloFraction = 0.0;           // share of the last step's window particles that were halo copies
+    double migratedFraction = 0.0;       // share of the particles that changed tile in the last step
+    double residentFraction = -1.0;      // share of the state in the page cache after the last step; -1: not known
+    bool prefetched = false;             // the OS accepted the read-ahead advice
+    unsigned long long steps = 0;
+    double lastStepMilliseconds = 0.0;
+    double stepsPerSecond = 0.0;         // over all steps since the last Reset
+    double nanosecondsPerParticle = 0.0; // per particle and step, over all steps since the last Reset
+};
+
+// The CPU backend's SPH step for particle counts whose state does not fit in RAM, run offline. The
+// domain's cell rows are cut into horizontal bands (tiles) of about tileParticles particles, and
+// each tile keeps its particles in two memory-mapped scratch files, one per copy of the state,
+// so the OS pages them in and out as a step streams over them. Only the tile in hand and its halo
+// are in RAM at a time.
+//
+// A step walks the tiles from the bottom up. For each tile it gathers a window: the tile's
+// particles and the two cell rows below and above it from its neighbours (only those two rows,
+// as each tile's file is sorted by row), counting-sorted into cell order in RAM. It sums the
+// densities of the tile and the row around it, then the forces of the tile alone, with the CPU
+// backend's gather kernels and integration (see CpuSolver.h), and writes the tile back into the
+// file of the other copy in row order. Particles that left the tile wait in RAM and are appended
+// to their new tile's file after the sweep, past its sorted rows, where the next halo gather
+// filters them by row. Reading one copy while writing the other keeps the halos at the state
+// the step started from.
+//
+// Ahead of the walk the solver asks the OS to read in the tile after next (madvise WILLNEED).
+// Behind it, it starts writing back each finished tile and waits for the one two tiles back, so
+// dirty pages never pile up, and it discards the copy nobody reads again. The page cache then
+// needs only a few tiles of working set however large the run, and the next step writes that
+// copy into freed pages rather than reading stale ones back from disk.
+//
+// Single precision, gather sums only; the smoothing radius, the domain and the tiles are fixed at
+// Reset. No mouse, and none of the GPU-only features (see CpuSolver.h). The particles per tile
+// drift as the fluid moves, so a tile may grow past tileParticles; its window grows with it.
+class OutOfCoreSolver {
+public:
+    // Tile files under directory; 0 threads: one per hardware thread
+    OutOfCoreSolver(const std::string& directory, unsigned int threads, size_t tileParticles);
+
+    // Lays out count particles of scene at rest straight into the tiles (see
+    // Simulation::LayOutScene), with sim's smoothing radius and the domain [-boundaryLimit,
+    // boundaryLimit]. False if a tile file could not be created or grown.
+    bool Reset(Scene scene, unsigned int count, const Simulation& sim, float boundaryLimit, float initialTimestep);
+    // One step with sim's parameters; false if a tile file could not be grown
+    bool Step(const Simulation& sim);
+
+    size_t GetParticleCount() const { return particleCount; }
+    const StepStats& GetStepStats() const { return stepStats; }
+    OutOfCoreStats GetStats() const;
+
+    // body(position, velocity) for every particle, tile by tile, streaming the files once
+    template <typename Body>
+    void ForEachParticle(Body&& body) const {
+        for (const Tile& tile : tiles) {
+            const Record* records = tile.Records(current);
+            for (size_t i = 0; i < tile.count[current]; ++i) {
+                body(glm::vec2(records[i].x, records[i].y), glm::vec2(records[i].vx, records[i].vy));
+            }
+        }
+    }
+
+private:
+    // One particle in a tile file
+    struct Record {
+        float x, y;
+        float vx, vy;
+    };
+
+    // Rows [firstRow, firstRow + rows) of the grid, and their particles in each copy. The first
+    // sorted[c] records of copy c are in row order, row r's from rowStart[c][r - firstRow]; the
+    // rest came from other tiles in the last step, in no order.
+    struct Tile {
+        unsigned int firstRow;
+        unsigned int rows;
+        MappedFile files[2];
+        size_t count[2];
+        size_t sorted[2];
+        std::vector<size_t> rowStart[2];
+        std::vector<Record> arrivals;  // this step's particles from other tiles
+
+        Record* Records(unsigned int copy) const { return static_cast<Record*>(files[copy].Data()); }
+        size_t Capacity(unsigned int copy) const { return files[copy].Size() / sizeof(Record); }
+    };
+
+    std::string directory;
+    size_t tileParticles;
+    std::vector<Tile> tiles;
+    std::vector<unsigned int> rowTiles;  // the tile of each cell row
+    unsigned int current;  // the copy holding the state
+    size_t particleCount;
+
+    // Square cells of at least h over [-boundaryLimit, boundaryLimit]
+    unsigned int gridDim;
+    float cellSize;
+    float boundaryLimit;
+
+    // The window of the tile in hand: rows [windowFirstRow, windowFirstRow + windowRows) in cell
+    // order, with an empty row above so the kernels' 3x3 lookups stay inside cellStart
+    unsigned int windowFirstRow;
+    unsigned int windowRows;
+    std::vector<float> posX, posY, velX, velY;
+    std::vector<float> densities, pressures;
+    std::vector<unsigned int> particleCells;  // window-local cell of each window particle
+    std::vector<unsigned int> cellStart;
+    std::vector<unsigned int> cellFill;
+    std::vector<unsigned int> gatheredCells;  // window-local cell of each gathered particle, in gather order
+    std::vector<Record> advanced;             // the tile's particles after the step, in window order
+    std::vector<unsigned int> advancedRows;
+    std::vector<size_t> rowFill;
+
+    std::vector<CpuIntegration::Reduction> reductions;
+    bool prefetched;
+    size_t windowBytes;
+    size_t largestWindow;
+    size_t haloParticles;
+    size_t windowParticles;
+    size_t migrated;
+    double residentFraction;
+
+    StepStats stepStats;
+    unsigned long long steps;
+    double lastStepMilliseconds;
+    double totalMilliseconds;
+
+    ThreadPool pool;
+
+    // Cell column of x or row of y
+    unsigned int CellCoordinate(float v) const;
+    // Grows copy's file to hold count records, with headroom
+    bool Reserve(Tile& tile, unsigned int copy, size_t count);
+    // Gathers tile k's window from the current copy
+    void BuildWindow(size_t k);
+    // body(record) over the current copy's particles of the tile in rows [firstRow, lastRow)
+    template <typename Body>
+    void ForEachInRows(const Tile& tile, unsigned int firstRow, unsigned int lastRow, Body&& body) const;
+    // Writes tile k's advanced particles that stay into the other copy in row order, and queues the
+    // others for their tiles
+    bool StoreTile(size_t k);
+    // Share of the current copy in the page cache, or -1 if the OS cannot say
+    double MeasureResidency() const;
+};
@@ -0,0 +1,301 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <new>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <GL/glew.h>
+#include "glm.hpp"
+
+// GLSL spelling and vertex attribute layout of the element types a particle field may have
+template <typename T> struct GlslType;
+template <> struct GlslType<float> { static constexpr const char* NAME = "float"; static constexpr int COMPONENTS = 1; static constexpr GLenum COMPONENT_TYPE = GL_FLOAT; };
+template <> struct GlslType<unsigned int> { static constexpr const char* NAME = "uint"; static constexpr int COMPONENTS = 1; static constexpr GLenum COMPONENT_TYPE = GL_UNSIGNED_INT; };
+template <> struct GlslType<glm::vec2> { static constexpr const char* NAME = "vec2"; static constexpr int COMPONENTS = 2; static constexpr GLenum COMPONENT_TYPE = GL_FLOAT; };
+template <> struct GlslType<glm::vec4> { static constexpr const char* NAME = "vec4"; static constexpr int COMPONENTS = 4; static constexpr GLenum COMPONENT_TYPE = GL_FLOAT; };
+
+// One per-particle attribute of element type T. Copies = 2 makes a ping-pong pair: a step reads
+// one copy and writes the other. A field derives from this and names itself for GLSL with
+// BLOCK (the buffer block, "Position" -> PositionBuffer) and ARRAY (the array, "positions").
+template <typename T, unsigned int Copies = 1>
+struct ParticleField {
+    static_assert(Copies == 1 || Copies == 2, "a particle field is single or a ping-pong pair");
+    using Type = T;
+    static constexpr unsigned int COPIES = Copies;
+};
+
+// Cache-line aligned storage, so vector loads of the host arrays never split a line at the start.
+// Growing default-initialises, which leaves fresh pages of plain types untouched for
+// ParticleStore::FirstTouch to place; the store writes the values it promises itself.
+template <typename T, std::size_t Alignment = 64>
+struct AlignedAllocator {
+    using value_type = T;
+    template <typename U> struct rebind { using other = AlignedAllocator<U, Alignment>; };
+
+    AlignedAllocator() = default;
+    template <typename U> AlignedAllocator(const AlignedAllocator<U, Alignment>&) {}
+
+    T* allocate(std::size_t n) { return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(Alignment))); }
+    void deallocate(T* p, std::size_t) { ::operator delete(p, std::align_val_t(Alignment)); }
+
+    template <typename U> void construct(U* p) { ::new (static_cast<void*>(p)) U; }
+    template <typename U, typename... Args> void construct(U* p, Args&&... args) {
+        ::new (static_cast<void*>(p)) U(std::forward<Args>(args)...);
+    }
+
+    template <typename U> bool operator==(const AlignedAllocator<U, Alignment>&) const { return true; }
+    template <typename U> bool operator!=(const AlignedAllocator<U, Alignment>&) const { return false; }
+};
+
+template <typename T>
+using AlignedVector = std::vector<T, AlignedAllocator<T>>;
+
+// Particle attributes declared once as a list of fields, kept as SoA host arrays and, when a GL
+// context exists, as one SSBO per field copy. Resize, Append, Permute and Upload apply to every
+// field, so adding an attribute is one more type in the list.
+//
+// Bindings follow the list: field k binds copy `read` at k, and the ping-pong fields bind their
+// other copy after all the fields, in list order (the shaders' "Out" buffers).
+// GlslDeclarations() gives each field a macro declaring its block at that binding, for example
+// PARTICLE_POSITIONS(readonly) and PARTICLE_POSITIONS_OUT(writeonly).
+template <typename... Fields>
+class ParticleStore {
+public:
+    static constexpr unsigned int FIELD_COUNT = sizeof...(Fields);
+
+    // --- Layout ---
+
+    template <typename F>
+    static constexpr unsigned int Binding() {
+        unsigned int index = 0, binding = 0;
+        ((std::is_same_v<F, Fields> ? (binding = index, ++index) : ++index), ...);
+        return binding;
+    }
+
+    template <typename F>
+    static constexpr unsigned int OutBinding() {
+        static_assert(F::COPIES == 2, "only ping-pong fields have an output binding");
+        unsigned int pairs = 0, binding = 0;
+        bool found = false;
+        ((std::is_same_v<F, Fields> ? (found = true, binding = FIELD_COUNT + pairs, 0)
+                                    : (found || Fields::COPIES != 2 ? 0 : (++pairs, 0))), ...);
+        return binding;
+    }
+
+    // "#define PARTICLE_<ARRAY>(qualifiers) layout(std430, binding = k) qualifiers buffer ..." for
+    // every field, plus PARTICLE_<ARRAY>_OUT for the ping-pong fields
+    static std::string GlslDeclarations() {
+        std::string declarations;
+        (AppendDeclaration<Fields>(declarations), ...);
+        return declarations;
+    }
+
+    // --- Host arrays ---
+
+    unsigned int Size() const { return count; }
+
+    // Copy `copy` of F (copy 0 for single fields)
+    template <typename F>
+    typename F::Type* Data(unsigned int copy = 0) { return Storage<F>().host[F::COPIES == 2 ? copy : 0].data(); }
+    template <typename F>
+    const typename F::Type* Data(unsigned int copy = 0) const { return Storage<F>().host[F::COPIES == 2 ? copy : 0].data(); }
+
+    // Every copy of every field; new slots are value-initialised
+    void Resize(unsigned int newCount) {
+        ForEachField([newCount](auto& field) {
+            using Type = typename std::decay_t<decltype(field)>::Type;
+            for (auto& copy : field.host) copy.resize(newCount, Type());
+        });
+        count = newCount;
+    }
+
+    // newCount particles with every value zeroed
+    void Reset(unsigned int newCount) {
+        Resize(0);
+        Resize(newCount);
+    }
+
+    void Reserve(unsigned int capacity) {
+        ForEachField([capacity](auto& field) {
+            for (auto& copy : field.host) copy.reserve(capacity);
+        });
+    }
+
+    // One particle, its values in field order, into copy 0 (and the other copy of pairs)
+    void Append(const typename Fields::Type&... values) {
+        (AppendValue<Fields>(values), ...);
+        ++count;
+    }
+
+    // Value-initialises slots [begin, end) of every copy of every field; disjoint ranges may run
+    // on different threads
+    void Zero(std::size_t begin, std::size_t end) {
+        ForEachField([begin, end](auto& field) {
+            using Type = typename std::decay_t<decltype(field)>::Type;
+            for (auto& copy : field.host) std::fill(copy.begin() + begin, copy.begin() + end, Type());
+        });
+    }
+
+    // Moves every host array to fresh memory that nothing has touched, copying the values over
+    // through forRanges(copyRange): forRanges calls copyRange(begin, end) over [0, Size()),
+    // each range on the thread that will work on it, so under the OS's first-touch policy each
+    // page lands on that thread's NUMA node. advise(data, bytes) sees every fresh array first
+    // (for huge pages, say). The permutation targets are left untouched for the first Permute
+    // to place the same way.
+    template <typename ForRanges, typename Advise>
+    void FirstTouch(ForRanges&& forRanges, Advise&& advise) {
+        unsigned int n = count;
+        ForEachField([&](auto& field) {
+            using Type = typename std::decay_t<decltype(field)>::Type;
+            for (auto& copy : field.host) {
+                AlignedVector<Type> fresh;
+                fresh.resize(n);
+                advise(static_cast<void*>(fresh.data()), sizeof(Type) * n);
+                forRanges([&](std::size_t begin, std::size_t end) {
+                    std::copy(copy.begin() + begin, copy.begin() + end, fresh.begin() + begin);
+                });
+                copy.swap(fresh);
+            }
+            AlignedVector<Type>().swap(field.permuted);
+            field.permuted.resize(n);
+            advise(static_cast<void*>(field.permuted.data()), sizeof(Type) * n);
+        });
+    }
+
+    // fn(data, elementBytes) for every host copy of every field, for placement queries
+    template <typename Fn>
+    void ForEachHostArray(Fn&& fn) const {
+        ForEachField([&fn](const auto& field) {
+            for (const auto& copy : field.host) fn(static_cast<const void*>(copy.data()), sizeof(copy[0]));
+        });
+    }
+
+    // Gathers copy 0 of every field into permuted order, slot <- order[slot], for the slots
+    // [begin, end). Disjoint ranges may run on different threads. CommitPermutation() then makes
+    // the gathered arrays copy 0.
+    void Permute(const unsigned int* order, std::size_t begin, std::size_t end) {
+        ForEachField([order, begin, end](auto& field) {
+            auto& source = field.host[0];
+            auto& target = field.permuted;
+            for (std::size_t slot = begin; slot < end; ++slot) {
+                target[slot] = source[order[slot]];
+            }
+        });
+    }
+    // Sizes the gather arrays; call before the Permute ranges
+    void BeginPermutation() {
+        unsigned int n = count;
+        ForEachField([n](auto& field) { field.permuted.resize(n); });
+    }
+    void CommitPermutation() {
+        ForEachField([](auto& field) { field.host[0].swap(field.permuted); });
+    }
+
+    // Exchanges the two copies of every ping-pong field
+    void SwapCopies() {
+        ForEachField([](auto& field) {
+            if constexpr (std::decay_t<decltype(field)>::COPIES == 2) field.host[0].swap(field.host[1]);
+        });
+    }
+
+    // --- GPU buffers ---
+
+    // One SSBO per field copy, up to `copies` of each (1: a render-only mirror), of capacity particles
+    void CreateBuffers(unsigned int capacity, unsigned int copies = 2) {
+        ForEachField([capacity, copies](auto& field) {
+            using Type = typename std::decay_t<decltype(field)>::Type;
+            for (unsigned int c = 0; c < std::decay_t<decltype(field)>::COPIES && c < copies; ++c) {
+                glGenBuffers(1, &field.buffers[c]);
+                glBindBuffer(GL_SHADER_STORAGE_BUFFER, field.buffers[c]);
+                glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(Type) * capacity, nullptr, GL_DYNAMIC_DRAW);
+            }
+        });
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+
+    // Copy `copy` of F (copy 0 for single fields)
+    template <typename F>
+    unsigned int Buffer(unsigned int copy = 0) const { return Storage<F>().buffers[F::COPIES == 2 ? copy : 0]; }
+
+    template <typename F>
+    void Bind(unsigned int copy = 0) const { glBindBufferBase(GL_SHADER_STORAGE_BUFFER, Binding<F>(), Buffer<F>(copy)); }
+    template <typename F>
+    void BindOut(unsigned int copy) const { glBindBufferBase(GL_SHADER_STORAGE_BUFFER, OutBinding<F>(), Buffer<F>(copy)); }
+
+    // Host copy 0, slots [first, first + n), into buffer copy `copy` of every field
+    void Upload(unsigned int first, unsigned int n, unsigned int copy = 0) const {
+        if (n == 0) return;
+        ForEachField([first, n, copy](const auto& field) {
+            using Field = std::decay_t<decltype(field)>;
+            using Type = typename Field::Type;
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, field.buffers[Field::COPIES == 2 ? copy : 0]);
+            glBufferSubData(GL_SHADER_STORAGE_BUFFER, sizeof(Type) * first, sizeof(Type) * n, field.host[0].data() + first);
+        });
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+
+    // Instanced vertex attributes firstLocation, firstLocation + 1, ... from buffer copy `copy`
+    // of each field in list order, for the currently bound VAO
+    void BindVertexAttributes(unsigned int firstLocation, unsigned int copy = 0) const {
+        unsigned int location = firstLocation;
+        ForEachField([&location, copy](const auto& field) {
+            using Field = std::decay_t<decltype(field)>;
+            using Glsl = GlslType<typename Field::Type>;
+            glBindBuffer(GL_ARRAY_BUFFER, field.buffers[Field::COPIES == 2 ? copy : 0]);
+            glEnableVertexAttribArrayARB(location);  // the bundled glew.h maps the core name to the DSA call
+            if (Glsl::COMPONENT_TYPE == GL_FLOAT) {
+                glVertexAttribPointer(location, Glsl::COMPONENTS, GL_FLOAT, GL_FALSE, sizeof(typename Field::Type), (void*)0);
+            }
+            else {
+                glVertexAttribIPointer(location, Glsl::COMPONENTS, Glsl::COMPONENT_TYPE, sizeof(typename Field::Type), (void*)0);
+            }
+            glVertexAttribDivisor(location, 1);
+            ++location;
+        });
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+private:
+    template <typename F>
+    struct FieldStorage {
+        using Type = typename F::Type;
+        static constexpr unsigned int COPIES = F::COPIES;
+        AlignedVector<Type> host[COPIES];
+        AlignedVector<Type> permuted;  // Permute's target, swapped in by CommitPermutation
+        unsigned int buffers[COPIES] = {};
+    };
+
+    std::tuple<FieldStorage<Fields>...> fields;
+    unsigned int count = 0;
+
+    template <typename F> FieldStorage<F>& Storage() { return std::get<FieldStorage<F>>(fields); }
+    template <typename F> const FieldStorage<F>& Storage() const { return std::get<FieldStorage<F>>(fields); }
+
+    template <typename Fn> void ForEachField(Fn&& fn) { (fn(Storage<Fields>()), ...); }
+    template <typename Fn> void ForEachField(Fn&& fn) const { (fn(Storage<Fields>()), ...); }
+
+    template <typename F>
+    void AppendValue(const typename F::Type& value) {
+        for (auto& copy : Storage<F>().host) copy.push_back(value);
+    }
+
+    template <typename F>
+    static void AppendDeclaration(std::string& declarations) {
+        std::string macro = "PARTICLE_";
+        for (const char* c = F::ARRAY; *c; ++c) {
+            macro += static_cast<char>(*c >= 'a' && *c <= 'z' ? *c - 'a' + 'A' : *c);
+        }
+        auto declare = [&](const std::string& suffix, const std::string& arraySuffix, unsigned int binding) {
+            declarations += "#define " + macro + suffix + "(qualifiers) layout(std430, binding = " + std::to_string(binding)
+                + ") qualifiers buffer " + F::BLOCK + arraySuffix + "Buffer { " + GlslType<typename F::Type>::NAME + " "
+                + F::ARRAY + arraySuffix + "[]; };\n";
+        };
+        declare("", "", Binding<F>());
+        if constexpr (F::COPIES == 2) {
+            declare("_OUT", "Out", OutBinding<F>());
+        }
+    }
+};
@@ -29,32 +29,11 @@ void Renderer::Init() {
     renderShader = std::make_unique<Shader>("assets/shaders/Basic.shader");
 }
 
-void Renderer::Render(unsigned int particleCount, unsigned int posSSBO, unsigned int velSSBO, unsigned int densitySSBO, unsigned int pressureSSBO, float simBoundaryLimit, float displayAspect) {
+void Renderer::Render(unsigned int particleCount, const ParticleData& particles, unsigned int copy, float simBoundaryLimit, float displayAspect) {
     glBindVertexArray(circleVAO);
 
-    // Position - Attribute 1
-    glBindBuffer(GL_ARRAY_BUFFER, posSSBO);
-    glEnableVertexAttribArrayARB(1);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec2), (void*)0);
-    glVertexAttribDivisor(1, 1);
-
-    // Velocity - Attribute 2
-    glBindBuffer(GL_ARRAY_BUFFER, velSSBO);
-    glEnableVertexAttribArrayARB(2);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec2), (void*)0);
-    glVertexAttribDivisor(2, 1);
-
-    // Density - Attribute 3
-    glBindBuffer(GL_ARRAY_BUFFER, densitySSBO);
-    glEnableVertexAttribArrayARB(3);
-    glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, sizeof(float), (void*)0);
-    glVertexAttribDivisor(3, 1);
-
-    // Pressure - Attribute 4
-    glBindBuffer(GL_ARRAY_BUFFER, pressureSSBO);
-    glEnableVertexAttribArrayARB(4);
-    glVertexAttribPointer(4, 1, GL_FLOAT, GL_FALSE, sizeof(float), (void*)0);
-    glVertexAttribDivisor(4, 1);
+    // Position, velocity, density, pressure - Attributes 1-4, one per particle field
+    particles.BindVertexAttributes(1, copy);
 
     // Clear and Draw
     glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
@@ -4,6 +4,7 @@
 #include <GL/glew.h>
 #include "glm.hpp"
 #include "Shader.h"
+#include "Simulation.h"
 
 class Renderer {
 public:
@@ -11,7 +12,8 @@ public:
     ~Renderer();
 
     void Init();
-    void Render(unsigned int particleCount, unsigned int posSSBO, unsigned int velSSBO, unsigned int densitySSBO, unsigned int pressureSSBO, float simBoundaryLimit, float displayAspect);
+    // copy: which copy of the ping-pong fields to draw
+    void Render(unsigned int particleCount, const ParticleData& particles, unsigned int copy, float simBoundaryLimit, float displayAspect);
 
 private:
     unsigned int circleVAO, circleVBO;
@@ -179,13 +179,18 @@ private:
 public:
     unsigned int shader_obj;
 
-    Shader(const std::string& filepath) : shader_obj(0)
+    // defines (compute shaders only) are inserted after the #version line
+    Shader(const std::string& filepath, const std::string& defines = "") : shader_obj(0)
     {
         if (filepath.size() > 5 && filepath.substr(filepath.size() - 5) == ".comp")
         {
             std::cout << "Loading Compute Shader: " << filepath << std::endl;
             std::string computeSource = ReadFile(filepath);
             if (!computeSource.empty()) {
+                size_t versionEnd = computeSource.find('\n');
+                if (!defines.empty() && versionEnd != std::string::npos) {
+                    computeSource.insert(versionEnd + 1, defines);
+                }
                 shader_obj = CreateComputeProgram(computeSource);
             }
         }
@@ -1,4 +1,5 @@
 #include "Simulation.h"
+#include "CpuSolver.h"
 #include <iostream>
 #include <random>
 #include <cmath>
@@ -6,8 +7,17 @@
 #include <vector>
 
 Simulation::Simulation()
-    : maxParticles(0), currentParticleCount(0),
-      positionSSBO(0), velocitySSBO(0), densitySSBO(0), pressureSSBO(0), cellCountsSSBO(0)
+    : maxParticles(0), currentParticleCount(0), backend(Backend::GPU), cpuRenderBuffers(false),
+      spawnRandom(std::random_device()()), readIndex(0), cellCountsSSBO(0), scratchSSBO(0),
+      alphaSSBO(0), kappaDensitySSBO(0), kappaDivergenceSSBO(0), dfsphStateSSBO(0),
+      sleepCountersSSBO(0), cellAwakeSSBO(0), sleepStateSSBO(0), sleepCountersStale(true),
+      resolutionSSBO(0), surfaceSSBO(0), freeListSSBO(0), resolutionAdapted(false), surfaceOffsetsValid(false),
+      timeBinSSBO(0), timeBinStatsSSBO(0),
+      sphTermsSSBO{ 0, 0 }, termsReadIndex(0), sphTermsValid(false),
+      slowForceSSBO(0), slowForceAge(0), slowForcesValid(false),
+      viscosityVectorsSSBO(0), viscosityProductsSSBO(0), viscosityPartialsSSBO(0), viscosityStateSSBO(0),
+      stepStatsSSBO(0), timestepSSBO(0), timestepReadbackBuffer(0), timestepReadbackFence(0),
+      sceneSpacing(0.05f), stepAccumulator(0.0f), lastSubstepCount(0), stepsSinceRateSample(0), rateSampleStart(0.0f), stepsPerSecond(0.0f)
 {
 }
 
@@ -16,98 +26,439 @@ Simulation::~Simulation() {
     // but explicit cleanup could be added here.
 }
 
-void Simulation::Init(unsigned int maxParticles, unsigned int initialParticles) {
+void Simulation::Init(unsigned int maxParticles, unsigned int initialParticles, Backend backend) {
     this->maxParticles = maxParticles;
     this->currentParticleCount = initialParticles;
+    this->backend = backend;
+    // Host arrays at full size up front, so changing the particle count never reallocates them
+    particles.Reserve(maxParticles);
 
-    // --- Generate Initial Data on CPU ---
-    std::vector<glm::vec2> initialPositions(currentParticleCount);
-    std::vector<glm::vec2> initialVelocities(currentParticleCount, glm::vec2(0.0f, 0.0f));
-
-    // Grid Configuration for Initialization
-    int numColumns = static_cast<int>(std::sqrt(currentParticleCount));
-    float spacing = 0.05f;
-    float offset = (numColumns - 1) * spacing / 2.0f;
+    if (backend == Backend::CPU) {
+        cpuSolver = CpuSolver::Create(cpuPrecision, maxParticles, cpuThreads, cpuNumaNodes, cpuHugePages);
 
-    for (int i = 0; i < (int)currentParticleCount; ++i) {
-        int col = i % numColumns;
-        int row = i / numColumns;
-        initialPositions[i] = glm::vec2(col * spacing - offset, row * spacing - offset);
+        // Render buffers only; glGenBuffers stays null until glewInit has run on a context
+        cpuRenderBuffers = glGenBuffers != nullptr;
+        if (cpuRenderBuffers) {
+            particles.CreateBuffers(maxParticles, 1);
+        }
+        readIndex = 0;
+        ResetScene(Scene::Block);
+        return;
     }
 
     // --- SSBO Initialization ---
-    // Position SSBO
-    glGenBuffers(1, &positionSSBO);
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, positionSSBO);
-    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(glm::vec2) * maxParticles, nullptr, GL_DYNAMIC_DRAW);
-    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(glm::vec2) * currentParticleCount, initialPositions.data());
-
-    // Velocity SSBO
-    glGenBuffers(1, &velocitySSBO);
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, velocitySSBO);
-    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(glm::vec2) * maxParticles, nullptr, GL_DYNAMIC_DRAW);
-    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(glm::vec2) * currentParticleCount, initialVelocities.data());
-
-    // Density SSBO
-    glGenBuffers(1, &densitySSBO);
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, densitySSBO);
-    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(float) * maxParticles, NULL, GL_DYNAMIC_DRAW);
-
-    // Pressure SSBO
-    glGenBuffers(1, &pressureSSBO);
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, pressureSSBO);
-    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(float) * maxParticles, NULL, GL_DYNAMIC_DRAW);
+    // Particle SSBOs: position / velocity read/write pairs (swapped every step), density, pressure
+    particles.CreateBuffers(maxParticles);
+    readIndex = 0;
 
     // Cell Counts SSBO
     glGenBuffers(1, &cellCountsSSBO);
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, cellCountsSSBO);
     glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(unsigned int) * NUM_GRID_CELLS, NULL, GL_DYNAMIC_DRAW);
 
+    // Scratch SSBO (PBF ping-pongs x* between this and the write position buffer,
+    // DFSPH runs its divergence-free solve on a copy of the step N velocities here,
+    // adaptive resolution keeps its merge partners here)
+    glGenBuffers(1, &scratchSSBO);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, scratchSSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(glm::vec2) * maxParticles, NULL, GL_DYNAMIC_DRAW);
+
+    // DFSPH alpha factor and kappa totals (the kappa totals are zeroed by ResetScene)
+    glGenBuffers(1, &alphaSSBO);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, alphaSSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(float) * maxParticles, NULL, GL_DYNAMIC_DRAW);
+
+    glGenBuffers(1, &kappaDensitySSBO);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, kappaDensitySSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(float) * maxParticles, NULL, GL_DYNAMIC_DRAW);
+
+    glGenBuffers(1, &kappaDivergenceSSBO);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, kappaDivergenceSSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(float) * maxParticles, NULL, GL_DYNAMIC_DRAW);
+
+    // DFSPH State SSBO: 3 indirect dispatch words, the error sum, then SolverStats
+    glGenBuffers(1, &dfsphStateSSBO);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, dfsphStateSSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, DFSPH_STATS_OFFSET + sizeof(SolverStats), NULL, GL_DYNAMIC_DRAW);
+
+    // Sleep Counters SSBO (cleared whenever they go stale, see StepSPH)
+    glGenBuffers(1, &sleepCountersSSBO);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, sleepCountersSSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(unsigned int) * maxParticles, NULL, GL_DYNAMIC_DRAW);
+
+    // Cell Awake SSBO (one flag per grid cell, cleared every step)
+    glGenBuffers(1, &cellAwakeSSBO);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, cellAwakeSSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(unsigned int) * NUM_GRID_CELLS, NULL, GL_DYNAMIC_DRAW);
+
+    // Sleep State SSBO: 3 indirect dispatch words, SleepStats, then the active particle indices
+    glGenBuffers(1, &sleepStateSSBO);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, sleepStateSSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, SLEEP_LIST_OFFSET + sizeof(unsigned int) * maxParticles, NULL, GL_DYNAMIC_DRAW);
+
+    // Resolution SSBO (mass, smoothing length per particle; reset to the uniform values by ResetScene)
+    glGenBuffers(1, &resolutionSSBO);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, resolutionSSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(glm::vec2) * maxParticles, NULL, GL_DYNAMIC_DRAW);
+
+    // Surface SSBO (offset from the neighbourhood centroid, written by density.comp)
+    glGenBuffers(1, &surfaceSSBO);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, surfaceSSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(float) * maxParticles, NULL, GL_DYNAMIC_DRAW);
+
+    // Free List SSBO: ResolutionStats, then up to one free slot per particle
+    glGenBuffers(1, &freeListSSBO);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, freeListSSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, FREE_LIST_SLOTS_OFFSET + sizeof(unsigned int) * maxParticles, NULL, GL_DYNAMIC_DRAW);
+
+    // Time Bin SSBO (per particle: bin this substep, bin chosen by the last kick; zeroed by ResetScene)
+    glGenBuffers(1, &timeBinSSBO);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, timeBinSSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, 2 * sizeof(unsigned int) * maxParticles, NULL, GL_DYNAMIC_DRAW);
+
+    // Time Bin Stats SSBO (TimeBinStats, cleared at the start of every base step)
+    glGenBuffers(1, &timeBinStatsSSBO);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, timeBinStatsSSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(TimeBinStats), NULL, GL_DYNAMIC_DRAW);
+
+    // SPH Terms SSBOs (m / rho, p m / rho per particle; density.comp and the fused force pass write them)
+    glGenBuffers(2, sphTermsSSBO);
+    for (int i = 0; i < 2; ++i) {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, sphTermsSSBO[i]);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(glm::vec2) * maxParticles, NULL, GL_DYNAMIC_DRAW);
+    }
+
+    // Slow Force SSBO (cached viscosity + surface tension, refreshed every slowForceInterval steps)
+    glGenBuffers(1, &slowForceSSBO);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, slowForceSSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(glm::vec2) * maxParticles, NULL, GL_DYNAMIC_DRAW);
+
+    // Viscosity CG SSBOs: (r, p) and (A p, 1 / A_ii) per particle, one partial sum per workgroup,
+    // and the solver state (3 indirect dispatch words, ViscositySolverStats, the CG scalars)
+    glGenBuffers(1, &viscosityVectorsSSBO);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, viscosityVectorsSSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(glm::vec4) * maxParticles, NULL, GL_DYNAMIC_DRAW);
+
+    glGenBuffers(1, &viscosityProductsSSBO);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, viscosityProductsSSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(glm::vec4) * maxParticles, NULL, GL_DYNAMIC_DRAW);
+
+    glGenBuffers(1, &viscosityPartialsSSBO);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, viscosityPartialsSSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(glm::vec4) * ((maxParticles + 127) / 128), NULL, GL_DYNAMIC_DRAW);
+
+    glGenBuffers(1, &viscosityStateSSBO);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, viscosityStateSSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, VISCOSITY_STATE_SIZE, NULL, GL_DYNAMIC_DRAW);
+
+    // Step Stats SSBO (max |v|, max |a|, NaN resets), zeroed by ResetScene and by timestep.comp afterwards
+    glGenBuffers(1, &stepStatsSSBO);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, stepStatsSSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(unsigned int) * 4, NULL, GL_DYNAMIC_DRAW);
+
+    // Timestep SSBO (mirrors StepStats), seeded by ResetScene
+    glGenBuffers(1, &timestepSSBO);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, timestepSSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(StepStats), NULL, GL_DYNAMIC_DRAW);
+
+    // Staging buffer for the readback: StepStats followed by SolverStats, SleepStats, ResolutionStats,
+    // TimeBinStats and ViscositySolverStats
+    glGenBuffers(1, &timestepReadbackBuffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, timestepReadbackBuffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, sizeof(StepStats) + sizeof(SolverStats) + sizeof(SleepStats) + sizeof(ResolutionStats) + sizeof(TimeBinStats) + sizeof(ViscositySolverStats), NULL, GL_STREAM_READ);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
 
+    // Kernel lookup table, filled for the kernel family by LoadKernelShaders
+    glGenTextures(1, &kernelTableTexture);
+    glBindTexture(GL_TEXTURE_1D, kernelTableTexture);
+    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_1D, 0);
+
     // --- Shader Loading ---
     // Assuming shaders are in assets/shaders/ relative to working directory
-    physicsUpdateShader = std::make_unique<Shader>("assets/shaders/physics.comp");
-    densityShader = std::make_unique<Shader>("assets/shaders/density.comp");
-    gridClearShader = std::make_unique<Shader>("assets/shaders/grid_clear.comp");
-    gridCountShader = std::make_unique<Shader>("assets/shaders/grid_count.comp");
+    // Compute shaders get the kernel descriptors of Kernels.h and the particle buffer
+    // declarations of ParticleData as #defines
+    const std::string computeDefines = Kernels::GlslDefines(kernelFamily) + ParticleData::GlslDeclarations();
+    LoadKernelShaders();
+    gridClearShader = std::make_unique<Shader>("assets/shaders/grid_clear.comp", computeDefines);
+    gridCountShader = std::make_unique<Shader>("assets/shaders/grid_count.comp", computeDefines);
+    timestepShader = std::make_unique<Shader>("assets/shaders/timestep.comp", computeDefines);
+    pbfPredictShader = std::make_unique<Shader>("assets/shaders/pbf_predict.comp", computeDefines);
+    pbfLambdaShader = std::make_unique<Shader>("assets/shaders/pbf_lambda.comp", computeDefines);
+    pbfDeltaShader = std::make_unique<Shader>("assets/shaders/pbf_delta.comp", computeDefines);
+    pbfUpdateShader = std::make_unique<Shader>("assets/shaders/pbf_update.comp", computeDefines);
+    dfsphFactorShader = std::make_unique<Shader>("assets/shaders/dfsph_factor.comp", computeDefines);
+    dfsphKappaShader = std::make_unique<Shader>("assets/shaders/dfsph_kappa.comp", computeDefines);
+    dfsphCheckShader = std::make_unique<Shader>("assets/shaders/dfsph_check.comp", computeDefines);
+    dfsphApplyShader = std::make_unique<Shader>("assets/shaders/dfsph_apply.comp", computeDefines);
+    dfsphForcesShader = std::make_unique<Shader>("assets/shaders/dfsph_forces.comp", computeDefines);
+    dfsphAdvectShader = std::make_unique<Shader>("assets/shaders/dfsph_advect.comp", computeDefines);
+    sleepMarkShader = std::make_unique<Shader>("assets/shaders/sleep_mark.comp", computeDefines);
+    sleepCompactShader = std::make_unique<Shader>("assets/shaders/sleep_compact.comp", computeDefines);
+    sleepArgsShader = std::make_unique<Shader>("assets/shaders/sleep_args.comp", computeDefines);
+    resolutionPairShader = std::make_unique<Shader>("assets/shaders/resolution_pair.comp", computeDefines);
+    resolutionMergeShader = std::make_unique<Shader>("assets/shaders/resolution_merge.comp", computeDefines);
+    resolutionSplitShader = std::make_unique<Shader>("assets/shaders/resolution_split.comp", computeDefines);
+    timeBinMarkShader = std::make_unique<Shader>("assets/shaders/timebin_mark.comp", computeDefines);
+    viscosityUpdateShader = std::make_unique<Shader>("assets/shaders/viscosity_update.comp", computeDefines);
+    viscosityDirectionShader = std::make_unique<Shader>("assets/shaders/viscosity_direction.comp", computeDefines);
+    viscosityCheckShader = std::make_unique<Shader>("assets/shaders/viscosity_check.comp", computeDefines);
+
+    ResetScene(Scene::Block);
 }
 
-void Simulation::Update(float deltaTime, float currentFrame, bool isMouseDown, float mouseX, float mouseY, float simBoundaryLimit) {
-    // 1. CLEAR: Reset the grid cell counters to zero
-    glUseProgram(gridClearShader->shader_obj);
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, cellCountsSSBO);
-    glDispatchCompute((NUM_GRID_CELLS + 127) / 128, 1, 1);
-    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+float Simulation::LayOutScene(Scene scene, unsigned int count, const std::function<void(unsigned int, glm::vec2)>& place) {
+    if (scene == Scene::Block) {
+        // Grid Configuration for Initialization
+        int numColumns = static_cast<int>(std::sqrt(count));
+        float spacing = 0.05f;
+        float offset = (numColumns - 1) * spacing / 2.0f;
+
+        for (int i = 0; i < (int)count; ++i) {
+            int col = i % numColumns;
+            int row = i / numColumns;
+            place(i, glm::vec2(col * spacing - offset, row * spacing - offset));
+        }
+        return spacing;
+    }
+    else if (scene == Scene::DamBreak) {
+        // Column of fluid against the left wall, half the domain wide
+        float spacing = std::min(0.05f, std::sqrt(1.0f * 1.8f / std::max(1u, count)));
+        int numColumns = std::max(1, static_cast<int>(0.9f / spacing));
+
+        for (int i = 0; i < (int)count; ++i) {
+            int col = i % numColumns;
+            int row = i / numColumns;
+            place(i, glm::vec2(-0.95f + col * spacing, -0.95f + row * spacing));
+        }
+        return spacing;
+    }
+    else if (scene == Scene::Drop) {
+        // Disk of fluid released from the upper half of the domain
+        const float radius = 0.4f;
+        const glm::vec2 center(0.0f, 0.4f);
+        float spacing = std::min(0.05f, std::sqrt(3.1415926f * radius * radius / std::max(1u, count)));
+
+        // Fill the disk on a square lattice: the points (x, y) with x^2 + y^2 < rim, for the
+        // smallest rim whose circle completes the count, then the rest from the points on that
+        // circle, spread evenly around it so the disk stays round
+        auto isqrt = [](long long v) {
+            long long root = static_cast<long long>(std::sqrt(static_cast<double>(v)));
+            while (root * root > v) --root;
+            while ((root + 1) * (root + 1) <= v) ++root;
+            return root;
+        };
+        auto pointsWithin = [&isqrt](long long squared) {
+            long long points = 0;
+            long long rows = isqrt(squared);
+            for (long long y = -rows; y <= rows; ++y) {
+                points += 2 * isqrt(squared - y * y) + 1;
+            }
+            return points;
+        };
+        long long low = 0, high = 1;
+        while (pointsWithin(high) < count) high *= 2;
+        while (low < high) {
+            long long middle = (low + high) / 2;
+            if (pointsWithin(middle) >= count) high = middle;
+            else low = middle + 1;
+        }
+        long long rim = low;
+        long long inside = rim > 0 ? pointsWithin(rim - 1) : 0;
+        long long rimPoints = pointsWithin(rim) - inside;
+        long long rimTaken = static_cast<long long>(count) - inside;
+
+        unsigned int placed = 0;
+        long long rimIndex = 0;
+        long long rows = isqrt(rim);
+        for (long long y = -rows; y <= rows; ++y) {
+            long long columns = isqrt(rim - y * y);
+            for (long long x = -columns; x <= columns; ++x) {
+                if (x * x + y * y == rim) {
+                    // Rim point k is taken when it starts a new share of rimPoints / rimTaken
+                    bool taken = (rimIndex + 1) * rimTaken / rimPoints > rimIndex * rimTaken / rimPoints;
+                    ++rimIndex;
+                    if (!taken) continue;
+                }
+                place(placed, center + glm::vec2(x * spacing, y * spacing));
+                ++placed;
+            }
+        }
+        return spacing;
+    }
+    return 0.05f;
+}
+
+void Simulation::ResetScene(Scene scene) {
+    // --- Generate Initial Data on CPU ---
+    particles.Reset(currentParticleCount);
+    glm::vec2* initialPositions = particles.Data<PositionField>();
+    sceneSpacing = LayOutScene(scene, currentParticleCount, [initialPositions](unsigned int i, glm::vec2 position) {
+        initialPositions[i] = position;
+    });
+
+    if (backend == Backend::CPU) {
+        cpuSolver->Reset(particles, maxTimestep);
+        stepStats = cpuSolver->GetStepStats();
+        stepAccumulator = 0.0f;
+        UploadCpuState();
+        return;
+    }
+
+    particles.Upload(0, currentParticleCount, readIndex);
+
+    // Restart the timestep controller: the fluid starts at rest, so seed with the largest step
+    unsigned int zeroStats[4] = { 0, 0, 0, 0 };
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, stepStatsSSBO);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(zeroStats), zeroStats);
+
+    stepStats = StepStats();
+    stepStats.deltaTime = maxTimestep;
+    stepStats.previousDeltaTime = 0.0f;  // no closing half-kick on the first leapfrog step
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, timestepSSBO);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(StepStats), &stepStats);
+
+    // Nothing to warm-start DFSPH from
+    float zero = 0.0f;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, kappaDensitySSBO);
+    glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32F, GL_RED, GL_FLOAT, &zero);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, kappaDivergenceSSBO);
+    glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32F, GL_RED, GL_FLOAT, &zero);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    solverStats = SolverStats();
+
+    // Everything starts awake
+    sleepCountersStale = true;
+    sleepStats = SleepStats();
+
+    // ...and at the finest resolution, with no free slots
+    glm::vec2 uniformResolution(particleMass, smoothingRadius);
+    unsigned int zeroCounts[3] = { 0, 0, 0 };
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, resolutionSSBO);
+    glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_RG32F, GL_RG, GL_FLOAT, &uniformResolution);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, freeListSSBO);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(zeroCounts), zeroCounts);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    resolutionAdapted = false;
+    surfaceOffsetsValid = false;
+    resolutionStats = ResolutionStats();
+
+    // ...and in the base step's time bin
+    unsigned int zeroBin = 0;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, timeBinSSBO);
+    glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zeroBin);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    timeBinStats = TimeBinStats();
+
+    // The fused step seeds its lagged terms with a density pass, and the slow forces start fresh
+    sphTermsValid = false;
+    slowForcesValid = false;
+    viscositySolverStats = ViscositySolverStats();
+
+    stepAccumulator = 0.0f;
+}
+
+void Simulation::Update(float frameTime, float currentFrame, bool isMouseDown, float mouseX, float mouseY, float simBoundaryLimit) {
+    // Fixed-timestep accumulator: bank the frame's wall time and pay it out in whole steps.
+    // In adaptive mode the step size is the last dt read back from the GPU, so the count is an estimate.
+    float stepDt = GetTimestep();
+    stepAccumulator += std::min(frameTime, 0.25f);
+
+    int substeps = static_cast<int>(stepAccumulator / stepDt);
+    if (substeps > maxSubstepsPerFrame) {
+        // Spiral-of-death guard: run the cap and drop the backlog instead of carrying it forward
+        substeps = maxSubstepsPerFrame;
+        stepAccumulator = 0.0f;
+    }
+    else {
+        stepAccumulator -= substeps * stepDt;
+    }
+    lastSubstepCount = substeps;
+
+    // Sim steps per second, measured independently of the render framerate
+    stepsSinceRateSample += substeps;
+    if (currentFrame - rateSampleStart >= 0.5f) {
+        stepsPerSecond = stepsSinceRateSample / (currentFrame - rateSampleStart);
+        stepsSinceRateSample = 0;
+        rateSampleStart = currentFrame;
+    }
+
+    if (substeps == 0) return;
+
+    // Uniforms are program state, so one upload serves every substep of this frame
+    SetStepUniforms(currentFrame, isMouseDown, mouseX, mouseY, simBoundaryLimit);
+    for (int i = 0; i < substeps; ++i) {
+        Step();
+    }
+    if (backend == Backend::CPU) {
+        UploadCpuState();
+    }
+}
+
+void Simulation::LoadKernelShaders() {
+    // The kernel family and the lookup table variant are compiled in rather than selected by a uniform
+    std::string defines = Kernels::GlslDefines(kernelFamily) + ParticleData::GlslDeclarations();
+    if (kernelLookupTable) {
+        defines += "#define KERNEL_LOOKUP_TABLE\n";
+    }
+    if (doubleSums) {
+        if (GLEW_VERSION_4_0 || GLEW_ARB_gpu_shader_fp64) defines += "#define DOUBLE_SUMS\n";
+        else std::cout << "Double sums need GL_ARB_gpu_shader_fp64; summing in float" << std::endl;
+    }
+    physicsUpdateShader = std::make_unique<Shader>("assets/shaders/physics.comp", defines);
+    densityShader = std::make_unique<Shader>("assets/shaders/density.comp", defines);
+    viscosityInitShader = std::make_unique<Shader>("assets/shaders/viscosity_init.comp", defines);
+    viscosityProductShader = std::make_unique<Shader>("assets/shaders/viscosity_product.comp", defines);
+
+    // The family's shapes sampled at texel centres, so entry 0 is q = 0 and the last q = 1
+    std::vector<float> kernelTable(3 * Kernels::TABLE_SIZE);
+    for (int i = 0; i < Kernels::TABLE_SIZE; ++i) {
+        Kernels::TableShapes(kernelFamily, static_cast<float>(i) / (Kernels::TABLE_SIZE - 1), &kernelTable[3 * i]);
+    }
+    glBindTexture(GL_TEXTURE_1D, kernelTableTexture);
+    glTexImage1D(GL_TEXTURE_1D, 0, GL_RGB32F, Kernels::TABLE_SIZE, 0, GL_RGB, GL_FLOAT, kernelTable.data());
+    glBindTexture(GL_TEXTURE_1D, 0);
+
+    kernelTableLoaded = kernelLookupTable;
+    loadedKernelFamily = kernelFamily;
+    doubleSumsLoaded = doubleSums;
+}
+
+void Simulation::SetStepUniforms(float currentFrame, bool isMouseDown, float mouseX, float mouseY, float simBoundaryLimit) {
+    if (backend == Backend::CPU) {
+        cpuSolver->SetFrameInput(isMouseDown, glm::vec2(mouseX, mouseY), simBoundaryLimit);
+        return;
+    }
+    if (kernelLookupTable != kernelTableLoaded || kernelFamily != loadedKernelFamily || doubleSums != doubleSumsLoaded) {
+        LoadKernelShaders();
+    }
+    float densityKernelScale = Kernels::WithFamily(kernelFamily, [this](auto kernels) { return Kernels::Scale(decltype(kernels)::Density, smoothingRadius); });
+    float gradientKernelScale = Kernels::WithFamily(kernelFamily, [this](auto kernels) { return Kernels::Scale(decltype(kernels)::Gradient, smoothingRadius); });
+    float laplacianKernelScale = Kernels::WithFamily(kernelFamily, [this](auto kernels) { return Kernels::Scale(decltype(kernels)::Laplacian, smoothingRadius); });
 
-    // 2. COUNT: Assign particles to grid cells and count them
     glUseProgram(gridCountShader->shader_obj);
     glUniform1ui(glGetUniformLocation(gridCountShader->shader_obj, "gridDim"), GRID_DIM);
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, positionSSBO); // READ positions
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, cellCountsSSBO); // WRITE counts
-
-    glDispatchCompute((currentParticleCount + 127) / 128, 1, 1);
-    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
 
-    // 3. CALCULATE: Calculate density
     glUseProgram(densityShader->shader_obj);
     glUniform1ui(glGetUniformLocation(densityShader->shader_obj, "particleCount"), currentParticleCount);
     glUniform1f(glGetUniformLocation(densityShader->shader_obj, "particleMass"), particleMass);
     glUniform1f(glGetUniformLocation(densityShader->shader_obj, "smoothingRadius"), smoothingRadius);
     glUniform1f(glGetUniformLocation(densityShader->shader_obj, "gasConstant"), gasConstant);
     glUniform1f(glGetUniformLocation(densityShader->shader_obj, "restDensity"), restDensity);
+    glUniform1i(glGetUniformLocation(densityShader->shader_obj, "useActiveList"), enableSleeping || localTimeStepping);
+    glUniform1i(glGetUniformLocation(densityShader->shader_obj, "variableResolution"), adaptiveResolution);
+    glUniform1f(glGetUniformLocation(densityShader->shader_obj, "densityKernelScale"), densityKernelScale);
 
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, positionSSBO);
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, densitySSBO);
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, pressureSSBO);
-
-    glDispatchCompute((currentParticleCount + 127) / 128, 1, 1);
-    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
-
-    // 4. FORCE PASS: Apply forces and integrate particle positions
     glUseProgram(physicsUpdateShader->shader_obj);
     glUniform1ui(glGetUniformLocation(physicsUpdateShader->shader_obj, "particleCount"), currentParticleCount);
-    glUniform1f(glGetUniformLocation(physicsUpdateShader->shader_obj, "deltaTime"), deltaTime > 0.008f ? 0.008f : deltaTime);
+    glUniform1f(glGetUniformLocation(physicsUpdateShader->shader_obj, "deltaTime"), fixedTimestep);
+    glUniform1i(glGetUniformLocation(physicsUpdateShader->shader_obj, "adaptiveTimestep"), adaptiveTimestep && !localTimeStepping);
+    glUniform1i(glGetUniformLocation(physicsUpdateShader->shader_obj, "integrator"), static_cast<int>(integrator));
+    glUniform1f(glGetUniformLocation(physicsUpdateShader->shader_obj, "globalDamping"), globalDamping);
     glUniform1f(glGetUniformLocation(physicsUpdateShader->shader_obj, "gravity"), gravityStrength);
     glUniform1f(glGetUniformLocation(physicsUpdateShader->shader_obj, "u_time"), currentFrame);
     glUniform1f(glGetUniformLocation(physicsUpdateShader->shader_obj, "particleMass"), particleMass);
@@ -115,6 +466,23 @@ void Simulation::Update(float deltaTime, float currentFrame, bool isMouseDown, f
     glUniform1f(glGetUniformLocation(physicsUpdateShader->shader_obj, "viscosityConstant"), viscosityConstant);
     glUniform1f(glGetUniformLocation(physicsUpdateShader->shader_obj, "is_mouse_pressed"), isMouseDown);
     glUniform2f(glGetUniformLocation(physicsUpdateShader->shader_obj, "mouse_pos"), mouseX, mouseY);
+    glUniform1i(glGetUniformLocation(physicsUpdateShader->shader_obj, "useActiveList"), enableSleeping || localTimeStepping);
+    glUniform1ui(glGetUniformLocation(physicsUpdateShader->shader_obj, "sleepSteps"), sleepSteps);
+    glUniform1f(glGetUniformLocation(physicsUpdateShader->shader_obj, "sleepSpeedThreshold"), sleepSpeedThreshold);
+    glUniform1f(glGetUniformLocation(physicsUpdateShader->shader_obj, "sleepAccelThreshold"), sleepAccelThreshold);
+    glUniform1i(glGetUniformLocation(physicsUpdateShader->shader_obj, "variableResolution"), adaptiveResolution);
+    glUniform1i(glGetUniformLocation(physicsUpdateShader->shader_obj, "localTimeStepping"), localTimeStepping);
+    glUniform1ui(glGetUniformLocation(physicsUpdateShader->shader_obj, "timeBinLevels"), std::clamp(timeBinLevels, 0, MAX_TIME_BIN_LEVEL));
+    glUniform1f(glGetUniformLocation(physicsUpdateShader->shader_obj, "cflNumber"), cflNumber);
+    glUniform1f(glGetUniformLocation(physicsUpdateShader->shader_obj, "forceFactor"), forceFactor);
+    glUniform1i(glGetUniformLocation(physicsUpdateShader->shader_obj, "fusedDensity"), UsesFusedStep());
+    glUniform1f(glGetUniformLocation(physicsUpdateShader->shader_obj, "gasConstant"), gasConstant);
+    glUniform1f(glGetUniformLocation(physicsUpdateShader->shader_obj, "restDensity"), restDensity);
+    glUniform1f(glGetUniformLocation(physicsUpdateShader->shader_obj, "densityKernelScale"), densityKernelScale);
+    glUniform1f(glGetUniformLocation(physicsUpdateShader->shader_obj, "gradientKernelScale"), gradientKernelScale);
+    glUniform1f(glGetUniformLocation(physicsUpdateShader->shader_obj, "laplacianKernelScale"), laplacianKernelScale);
+    glUniform1f(glGetUniformLocation(physicsUpdateShader->shader_obj, "surfaceKernelScale"), Kernels::Scale(Kernels::SurfaceColor, smoothingRadius));
+    glUniform1i(glGetUniformLocation(physicsUpdateShader->shader_obj, "implicitViscosity"), UsesImplicitViscosity());
     glUniform1f(glGetUniformLocation(physicsUpdateShader->shader_obj, "boundaryStiffness"), boundaryStiffness);
     glUniform1f(glGetUniformLocation(physicsUpdateShader->shader_obj, "boundaryDamping"), boundaryDamping);
     glUniform1f(glGetUniformLocation(physicsUpdateShader->shader_obj, "pressure_multipiler"), pressureMultiplier);
@@ -124,45 +492,907 @@ void Simulation::Update(float deltaTime, float currentFrame, bool isMouseDown, f
     float simBoundaryRadius = smoothingRadius * 0.000005f;
     glUniform1f(glGetUniformLocation(physicsUpdateShader->shader_obj, "boundary_limit"), simBoundaryLimit);
     glUniform1f(glGetUniformLocation(physicsUpdateShader->shader_obj, "boundary_radius"), simBoundaryRadius);
+    glUniform1i(glGetUniformLocation(physicsUpdateShader->shader_obj, "boundaryMode"), static_cast<int>(boundaryMode));
+    glUniform1f(glGetUniformLocation(physicsUpdateShader->shader_obj, "boundaryRestitution"), boundaryRestitution);
+
+    glUseProgram(sleepMarkShader->shader_obj);
+    glUniform1ui(glGetUniformLocation(sleepMarkShader->shader_obj, "particleCount"), currentParticleCount);
+    glUniform1ui(glGetUniformLocation(sleepMarkShader->shader_obj, "gridDim"), GRID_DIM);
+    glUniform1ui(glGetUniformLocation(sleepMarkShader->shader_obj, "sleepSteps"), sleepSteps);
+    glUniform1f(glGetUniformLocation(sleepMarkShader->shader_obj, "is_mouse_pressed"), isMouseDown);
+    glUniform2f(glGetUniformLocation(sleepMarkShader->shader_obj, "mouse_pos"), mouseX, mouseY);
+    glUniform1i(glGetUniformLocation(sleepMarkShader->shader_obj, "variableResolution"), adaptiveResolution);
+
+    glUseProgram(sleepCompactShader->shader_obj);
+    glUniform1ui(glGetUniformLocation(sleepCompactShader->shader_obj, "particleCount"), currentParticleCount);
+    glUniform1ui(glGetUniformLocation(sleepCompactShader->shader_obj, "gridDim"), GRID_DIM);
+    glUniform1f(glGetUniformLocation(sleepCompactShader->shader_obj, "smoothingRadius"), smoothingRadius);
+
+    glUseProgram(timeBinMarkShader->shader_obj);
+    glUniform1ui(glGetUniformLocation(timeBinMarkShader->shader_obj, "particleCount"), currentParticleCount);
+    glUniform1ui(glGetUniformLocation(timeBinMarkShader->shader_obj, "gridDim"), GRID_DIM);
+    glUniform1f(glGetUniformLocation(timeBinMarkShader->shader_obj, "deltaTime"), fixedTimestep);
+    glUniform1ui(glGetUniformLocation(timeBinMarkShader->shader_obj, "timeBinLevels"), std::clamp(timeBinLevels, 0, MAX_TIME_BIN_LEVEL));
+    glUniform1i(glGetUniformLocation(timeBinMarkShader->shader_obj, "variableResolution"), adaptiveResolution);
+    glUniform1i(glGetUniformLocation(timeBinMarkShader->shader_obj, "boundaryMode"), static_cast<int>(boundaryMode));
+    glUniform1f(glGetUniformLocation(timeBinMarkShader->shader_obj, "boundary_limit"), simBoundaryLimit);
+    glUniform1f(glGetUniformLocation(timeBinMarkShader->shader_obj, "boundaryRestitution"), boundaryRestitution);
+
+    glUseProgram(viscosityInitShader->shader_obj);
+    glUniform1ui(glGetUniformLocation(viscosityInitShader->shader_obj, "particleCount"), currentParticleCount);
+    glUniform1f(glGetUniformLocation(viscosityInitShader->shader_obj, "deltaTime"), fixedTimestep);
+    glUniform1i(glGetUniformLocation(viscosityInitShader->shader_obj, "adaptiveTimestep"), adaptiveTimestep);
+    glUniform1f(glGetUniformLocation(viscosityInitShader->shader_obj, "particleMass"), particleMass);
+    glUniform1f(glGetUniformLocation(viscosityInitShader->shader_obj, "smoothingRadius"), smoothingRadius);
+    glUniform1f(glGetUniformLocation(viscosityInitShader->shader_obj, "viscosityConstant"), viscosityConstant);
+    glUniform1i(glGetUniformLocation(viscosityInitShader->shader_obj, "variableResolution"), adaptiveResolution);
+    glUniform1f(glGetUniformLocation(viscosityInitShader->shader_obj, "laplacianKernelScale"), laplacianKernelScale);
+
+    glUseProgram(viscosityProductShader->shader_obj);
+    glUniform1ui(glGetUniformLocation(viscosityProductShader->shader_obj, "particleCount"), currentParticleCount);
+    glUniform1f(glGetUniformLocation(viscosityProductShader->shader_obj, "deltaTime"), fixedTimestep);
+    glUniform1i(glGetUniformLocation(viscosityProductShader->shader_obj, "adaptiveTimestep"), adaptiveTimestep);
+    glUniform1f(glGetUniformLocation(viscosityProductShader->shader_obj, "particleMass"), particleMass);
+    glUniform1f(glGetUniformLocation(viscosityProductShader->shader_obj, "smoothingRadius"), smoothingRadius);
+    glUniform1f(glGetUniformLocation(viscosityProductShader->shader_obj, "viscosityConstant"), viscosityConstant);
+    glUniform1i(glGetUniformLocation(viscosityProductShader->shader_obj, "variableResolution"), adaptiveResolution);
+    glUniform1f(glGetUniformLocation(viscosityProductShader->shader_obj, "laplacianKernelScale"), laplacianKernelScale);
+
+    glUseProgram(viscosityUpdateShader->shader_obj);
+    glUniform1ui(glGetUniformLocation(viscosityUpdateShader->shader_obj, "particleCount"), currentParticleCount);
+
+    glUseProgram(viscosityDirectionShader->shader_obj);
+    glUniform1ui(glGetUniformLocation(viscosityDirectionShader->shader_obj, "particleCount"), currentParticleCount);
+
+    glUseProgram(viscosityCheckShader->shader_obj);
+    glUniform1ui(glGetUniformLocation(viscosityCheckShader->shader_obj, "particleGroups"), (currentParticleCount + 127) / 128);
+    glUniform1f(glGetUniformLocation(viscosityCheckShader->shader_obj, "tolerance"), viscosityTolerance);
+
+    int mergeLevels = std::clamp(maxResolutionLevel, 1, MAX_RESOLUTION_LEVEL) - 1;
+    glUseProgram(resolutionPairShader->shader_obj);
+    glUniform1ui(glGetUniformLocation(resolutionPairShader->shader_obj, "particleCount"), currentParticleCount);
+    glUniform1f(glGetUniformLocation(resolutionPairShader->shader_obj, "maxMergeMass"), particleMass * static_cast<float>(1 << mergeLevels));
+    glUniform1f(glGetUniformLocation(resolutionPairShader->shader_obj, "mergeSurfaceOffset"), mergeSurfaceOffset);
+
+    glUseProgram(resolutionMergeShader->shader_obj);
+    glUniform1ui(glGetUniformLocation(resolutionMergeShader->shader_obj, "particleCount"), currentParticleCount);
+
+    glUseProgram(resolutionSplitShader->shader_obj);
+    glUniform1ui(glGetUniformLocation(resolutionSplitShader->shader_obj, "particleCount"), currentParticleCount);
+    glUniform1f(glGetUniformLocation(resolutionSplitShader->shader_obj, "particleMass"), particleMass);
+    glUniform1f(glGetUniformLocation(resolutionSplitShader->shader_obj, "smoothingRadius"), smoothingRadius);
+    glUniform1f(glGetUniformLocation(resolutionSplitShader->shader_obj, "splitSurfaceOffset"), splitSurfaceOffset);
+
+    glUseProgram(pbfPredictShader->shader_obj);
+    glUniform1ui(glGetUniformLocation(pbfPredictShader->shader_obj, "particleCount"), currentParticleCount);
+    glUniform1f(glGetUniformLocation(pbfPredictShader->shader_obj, "deltaTime"), fixedTimestep);
+    glUniform1i(glGetUniformLocation(pbfPredictShader->shader_obj, "adaptiveTimestep"), adaptiveTimestep);
+    glUniform1f(glGetUniformLocation(pbfPredictShader->shader_obj, "gravity"), gravityStrength);
+    glUniform1f(glGetUniformLocation(pbfPredictShader->shader_obj, "globalDamping"), globalDamping);
+    glUniform1f(glGetUniformLocation(pbfPredictShader->shader_obj, "is_mouse_pressed"), isMouseDown);
+    glUniform2f(glGetUniformLocation(pbfPredictShader->shader_obj, "mouse_pos"), mouseX, mouseY);
+    glUniform1f(glGetUniformLocation(pbfPredictShader->shader_obj, "boundary_limit"), simBoundaryLimit);
+
+    float latticeRestDensity = ComputeLatticeRestDensity(false);
+    glUseProgram(pbfLambdaShader->shader_obj);
+    glUniform1ui(glGetUniformLocation(pbfLambdaShader->shader_obj, "particleCount"), currentParticleCount);
+    glUniform1f(glGetUniformLocation(pbfLambdaShader->shader_obj, "particleMass"), particleMass);
+    glUniform1f(glGetUniformLocation(pbfLambdaShader->shader_obj, "smoothingRadius"), smoothingRadius);
+    glUniform1f(glGetUniformLocation(pbfLambdaShader->shader_obj, "restDensity"), latticeRestDensity);
+    glUniform1f(glGetUniformLocation(pbfLambdaShader->shader_obj, "relaxation"), pbfRelaxation);
+    glUniform1f(glGetUniformLocation(pbfLambdaShader->shader_obj, "poly6Scale"), Kernels::Scale(Kernels::Poly6, smoothingRadius));
+    glUniform1f(glGetUniformLocation(pbfLambdaShader->shader_obj, "spikyGradScale"), Kernels::Scale(Kernels::SpikyGradient, smoothingRadius));
+
+    glUseProgram(pbfDeltaShader->shader_obj);
+    glUniform1ui(glGetUniformLocation(pbfDeltaShader->shader_obj, "particleCount"), currentParticleCount);
+    glUniform1f(glGetUniformLocation(pbfDeltaShader->shader_obj, "particleMass"), particleMass);
+    glUniform1f(glGetUniformLocation(pbfDeltaShader->shader_obj, "smoothingRadius"), smoothingRadius);
+    glUniform1f(glGetUniformLocation(pbfDeltaShader->shader_obj, "restDensity"), latticeRestDensity);
+    glUniform1f(glGetUniformLocation(pbfDeltaShader->shader_obj, "tensileK"), pbfTensileK);
+    glUniform1f(glGetUniformLocation(pbfDeltaShader->shader_obj, "boundary_limit"), simBoundaryLimit);
+    glUniform1f(glGetUniformLocation(pbfDeltaShader->shader_obj, "poly6Scale"), Kernels::Scale(Kernels::Poly6, smoothingRadius));
+    glUniform1f(glGetUniformLocation(pbfDeltaShader->shader_obj, "spikyGradScale"), Kernels::Scale(Kernels::SpikyGradient, smoothingRadius));
+
+    glUseProgram(pbfUpdateShader->shader_obj);
+    glUniform1ui(glGetUniformLocation(pbfUpdateShader->shader_obj, "particleCount"), currentParticleCount);
+    glUniform1f(glGetUniformLocation(pbfUpdateShader->shader_obj, "deltaTime"), fixedTimestep);
+    glUniform1i(glGetUniformLocation(pbfUpdateShader->shader_obj, "adaptiveTimestep"), adaptiveTimestep);
+    glUniform1f(glGetUniformLocation(pbfUpdateShader->shader_obj, "particleMass"), particleMass);
+    glUniform1f(glGetUniformLocation(pbfUpdateShader->shader_obj, "smoothingRadius"), smoothingRadius);
+    glUniform1f(glGetUniformLocation(pbfUpdateShader->shader_obj, "xsphViscosity"), xsphViscosity);
+    glUniform1f(glGetUniformLocation(pbfUpdateShader->shader_obj, "poly6Scale"), Kernels::Scale(Kernels::Poly6, smoothingRadius));
+
+    unsigned int groups = (currentParticleCount + 127) / 128;
+    glUseProgram(dfsphFactorShader->shader_obj);
+    glUniform1ui(glGetUniformLocation(dfsphFactorShader->shader_obj, "particleCount"), currentParticleCount);
+    glUniform1f(glGetUniformLocation(dfsphFactorShader->shader_obj, "particleMass"), particleMass);
+    glUniform1f(glGetUniformLocation(dfsphFactorShader->shader_obj, "smoothingRadius"), smoothingRadius);
+    glUniform1f(glGetUniformLocation(dfsphFactorShader->shader_obj, "boundary_limit"), simBoundaryLimit);
+    glUniform1f(glGetUniformLocation(dfsphFactorShader->shader_obj, "boundarySpacing"), sceneSpacing);
+    glUniform1f(glGetUniformLocation(dfsphFactorShader->shader_obj, "spikyScale"), Kernels::Scale(Kernels::Spiky, smoothingRadius));
+    glUniform1f(glGetUniformLocation(dfsphFactorShader->shader_obj, "spikyGradScale"), Kernels::Scale(Kernels::SpikyGradient, smoothingRadius));
+
+    glUseProgram(dfsphKappaShader->shader_obj);
+    glUniform1ui(glGetUniformLocation(dfsphKappaShader->shader_obj, "particleCount"), currentParticleCount);
+    glUniform1f(glGetUniformLocation(dfsphKappaShader->shader_obj, "deltaTime"), fixedTimestep);
+    glUniform1i(glGetUniformLocation(dfsphKappaShader->shader_obj, "adaptiveTimestep"), adaptiveTimestep);
+    glUniform1f(glGetUniformLocation(dfsphKappaShader->shader_obj, "particleMass"), particleMass);
+    glUniform1f(glGetUniformLocation(dfsphKappaShader->shader_obj, "smoothingRadius"), smoothingRadius);
+    glUniform1f(glGetUniformLocation(dfsphKappaShader->shader_obj, "boundary_limit"), simBoundaryLimit);
+    glUniform1f(glGetUniformLocation(dfsphKappaShader->shader_obj, "boundarySpacing"), sceneSpacing);
+    glUniform1f(glGetUniformLocation(dfsphKappaShader->shader_obj, "restDensity"), ComputeLatticeRestDensity(true));
+    glUniform1f(glGetUniformLocation(dfsphKappaShader->shader_obj, "spikyScale"), Kernels::Scale(Kernels::Spiky, smoothingRadius));
+    glUniform1f(glGetUniformLocation(dfsphKappaShader->shader_obj, "spikyGradScale"), Kernels::Scale(Kernels::SpikyGradient, smoothingRadius));
+
+    glUseProgram(dfsphCheckShader->shader_obj);
+    glUniform1ui(glGetUniformLocation(dfsphCheckShader->shader_obj, "particleCount"), currentParticleCount);
+    glUniform1ui(glGetUniformLocation(dfsphCheckShader->shader_obj, "particleGroups"), groups);
+
+    glUseProgram(dfsphApplyShader->shader_obj);
+    glUniform1ui(glGetUniformLocation(dfsphApplyShader->shader_obj, "particleCount"), currentParticleCount);
+    glUniform1f(glGetUniformLocation(dfsphApplyShader->shader_obj, "deltaTime"), fixedTimestep);
+    glUniform1i(glGetUniformLocation(dfsphApplyShader->shader_obj, "adaptiveTimestep"), adaptiveTimestep);
+    glUniform1f(glGetUniformLocation(dfsphApplyShader->shader_obj, "particleMass"), particleMass);
+    glUniform1f(glGetUniformLocation(dfsphApplyShader->shader_obj, "smoothingRadius"), smoothingRadius);
+    glUniform1f(glGetUniformLocation(dfsphApplyShader->shader_obj, "boundary_limit"), simBoundaryLimit);
+    glUniform1f(glGetUniformLocation(dfsphApplyShader->shader_obj, "boundarySpacing"), sceneSpacing);
+    glUniform1f(glGetUniformLocation(dfsphApplyShader->shader_obj, "spikyScale"), Kernels::Scale(Kernels::Spiky, smoothingRadius));
+    glUniform1f(glGetUniformLocation(dfsphApplyShader->shader_obj, "spikyGradScale"), Kernels::Scale(Kernels::SpikyGradient, smoothingRadius));
+
+    glUseProgram(dfsphForcesShader->shader_obj);
+    glUniform1ui(glGetUniformLocation(dfsphForcesShader->shader_obj, "particleCount"), currentParticleCount);
+    glUniform1f(glGetUniformLocation(dfsphForcesShader->shader_obj, "deltaTime"), fixedTimestep);
+    glUniform1i(glGetUniformLocation(dfsphForcesShader->shader_obj, "adaptiveTimestep"), adaptiveTimestep);
+    glUniform1f(glGetUniformLocation(dfsphForcesShader->shader_obj, "gravity"), gravityStrength);
+    glUniform1f(glGetUniformLocation(dfsphForcesShader->shader_obj, "globalDamping"), globalDamping);
+    glUniform1f(glGetUniformLocation(dfsphForcesShader->shader_obj, "particleMass"), particleMass);
+    glUniform1f(glGetUniformLocation(dfsphForcesShader->shader_obj, "smoothingRadius"), smoothingRadius);
+    glUniform1f(glGetUniformLocation(dfsphForcesShader->shader_obj, "xsphViscosity"), xsphViscosity);
+    glUniform1f(glGetUniformLocation(dfsphForcesShader->shader_obj, "is_mouse_pressed"), isMouseDown);
+    glUniform2f(glGetUniformLocation(dfsphForcesShader->shader_obj, "mouse_pos"), mouseX, mouseY);
+    glUniform1f(glGetUniformLocation(dfsphForcesShader->shader_obj, "spikyScale"), Kernels::Scale(Kernels::Spiky, smoothingRadius));
 
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, positionSSBO);
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, velocitySSBO);
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, densitySSBO);
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, pressureSSBO);
+    glUseProgram(dfsphAdvectShader->shader_obj);
+    glUniform1ui(glGetUniformLocation(dfsphAdvectShader->shader_obj, "particleCount"), currentParticleCount);
+    glUniform1f(glGetUniformLocation(dfsphAdvectShader->shader_obj, "deltaTime"), fixedTimestep);
+    glUniform1i(glGetUniformLocation(dfsphAdvectShader->shader_obj, "adaptiveTimestep"), adaptiveTimestep);
+    glUniform1f(glGetUniformLocation(dfsphAdvectShader->shader_obj, "boundary_limit"), simBoundaryLimit);
+
+    glUseProgram(timestepShader->shader_obj);
+    glUniform1f(glGetUniformLocation(timestepShader->shader_obj, "smoothingRadius"), smoothingRadius);
+    glUniform1f(glGetUniformLocation(timestepShader->shader_obj, "cflNumber"), cflNumber);
+    glUniform1f(glGetUniformLocation(timestepShader->shader_obj, "forceFactor"), forceFactor);
+    glUniform1f(glGetUniformLocation(timestepShader->shader_obj, "minTimestep"), minTimestep);
+    glUniform1f(glGetUniformLocation(timestepShader->shader_obj, "maxTimestep"), maxTimestep);
+    glUniform1f(glGetUniformLocation(timestepShader->shader_obj, "fixedDeltaTime"), fixedTimestep);
+    glUniform1i(glGetUniformLocation(timestepShader->shader_obj, "adaptiveTimestep"), adaptiveTimestep);
+}
+
+void Simulation::Step() {
+    if (backend == Backend::CPU) {
+        cpuSolver->Step(*this);
+        stepStats = cpuSolver->GetStepStats();
+        return;
+    }
+
+    unsigned int writeIndex = 1 - readIndex;
+
+    // Every path but adaptive SPH assumes each slot holds one particle of particleMass
+    if (resolutionAdapted && (solver != Solver::SPH || !adaptiveResolution)) {
+        RestoreUniformResolution();
+    }
+
+    // 1. CLEAR: Reset the grid cell counters to zero
+    glUseProgram(gridClearShader->shader_obj);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, cellCountsSSBO);
+    glDispatchCompute((NUM_GRID_CELLS + 127) / 128, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    // 2. COUNT: Assign particles to grid cells and count them
+    glUseProgram(gridCountShader->shader_obj);
+    particles.Bind<PositionField>(readIndex); // READ positions
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, cellCountsSSBO); // WRITE counts
 
     glDispatchCompute((currentParticleCount + 127) / 128, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    // 3-4. SOLVE: advance positions/velocities from [readIndex] into [writeIndex]
+    if (solver == Solver::PBF) {
+        StepPBF(writeIndex);
+        sleepCountersStale = true;
+        sphTermsValid = false;
+        slowForcesValid = false;
+    }
+    else if (solver == Solver::DFSPH) {
+        StepDFSPH(writeIndex);
+        sleepCountersStale = true;
+        sphTermsValid = false;
+        slowForcesValid = false;
+    }
+    else if (localTimeStepping) {
+        StepLocal();
+        sleepCountersStale = true;
+    }
+    else {
+        StepSPH(writeIndex);
+    }
+
+    // 5. TIMESTEP: turn this step's reduction into the dt for the next one, entirely on the GPU
+    glUseProgram(timestepShader->shader_obj);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, stepStatsSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, timestepSSBO);
+    glDispatchCompute(1, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+
+    ReadBackStepStats();
+
+    // 6. SWAP: the freshly written buffers become the state the renderer and the next step read
+    // (StepLocal has already swapped after each of its substeps)
+    if (!UsesLocalTimeStepping()) {
+        readIndex = writeIndex;
+    }
+}
+
+void Simulation::StepSPH(unsigned int writeIndex) {
+    if (adaptiveResolution) {
+        AdaptResolution();
+    }
+    if (enableSleeping) {
+        BuildActiveList(writeIndex);
+    }
+    else {
+        sleepCountersStale = true;
+    }
+
+    SelectSlowForceRefresh();
+    if (UsesFusedStep()) {
+        StepFused(writeIndex);
+        return;
+    }
+    ComputeDensity(enableSleeping);
+    if (UsesImplicitViscosity()) {
+        SolveViscosity();
+    }
+    ComputeForces(writeIndex, enableSleeping);
+}
+
+void Simulation::SelectSlowForceRefresh() {
+    bool refresh = !slowForcesValid || ++slowForceAge >= std::max(1, slowForceInterval);
+    if (refresh) {
+        slowForceAge = 0;
+        slowForcesValid = true;
+    }
+    glUseProgram(physicsUpdateShader->shader_obj);
+    glUniform1i(glGetUniformLocation(physicsUpdateShader->shader_obj, "refreshSlowForces"), refresh);
+}
+
+void Simulation::StepFused(unsigned int writeIndex) {
+    // The first fused step after a reset or another solver needs the terms of the current state
+    if (!sphTermsValid) {
+        ComputeDensity(false);
+    }
+    // The solve uses the previous step's densities, like the neighbour terms
+    if (UsesImplicitViscosity()) {
+        SolveViscosity();
+    }
+
+    // One sweep: density into the density / pressure buffers and the next terms, forces from the last ones
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 23, sphTermsSSBO[termsReadIndex]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 24, sphTermsSSBO[1 - termsReadIndex]);
+    ComputeForces(writeIndex, false);
+    termsReadIndex = 1 - termsReadIndex;
+}
+
+void Simulation::ComputeDensity(bool activeListOnly) {
+    if (activeListOnly) {
+        glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, sleepStateSSBO);
+    }
+
+    // CALCULATE: Calculate density
+    glUseProgram(densityShader->shader_obj);
+    particles.Bind<PositionField>(readIndex);
+    particles.Bind<DensityField>();
+    particles.Bind<PressureField>();
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 13, sleepStateSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 16, resolutionSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 17, surfaceSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 23, sphTermsSSBO[termsReadIndex]);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_1D, kernelTableTexture);
+
+    if (activeListOnly) glDispatchComputeIndirect(0);
+    else glDispatchCompute((currentParticleCount + 127) / 128, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    surfaceOffsetsValid = adaptiveResolution;
+    // An active list leaves the other particles' terms behind
+    sphTermsValid = !activeListOnly;
+
+    glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+}
+
+void Simulation::ComputeForces(unsigned int writeIndex, bool activeListOnly) {
+    if (activeListOnly) {
+        glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, sleepStateSSBO);
+    }
+
+    // FORCE PASS: Apply forces and integrate particle positions
+    glUseProgram(physicsUpdateShader->shader_obj);
+    particles.Bind<PositionField>(readIndex);  // READ step N
+    particles.Bind<VelocityField>(readIndex);
+    particles.Bind<DensityField>();
+    particles.Bind<PressureField>();
+    particles.BindOut<PositionField>(writeIndex); // WRITE step N+1
+    particles.BindOut<VelocityField>(writeIndex);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, stepStatsSSBO);            // max |v|, max |a| reduction
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, timestepSSBO);             // dt chosen last step
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 13, sleepStateSSBO);          // active list
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 14, sleepCountersSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 16, resolutionSSBO);          // per-particle mass, h
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 20, timeBinSSBO);             // local time stepping
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 22, timeBinStatsSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 25, slowForceSSBO);           // multi-rate forces
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_1D, kernelTableTexture);                      // kernel lookup table
+
+    if (activeListOnly) glDispatchComputeIndirect(0);
+    else glDispatchCompute((currentParticleCount + 127) / 128, 1, 1);
     glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+
+    glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+}
+
+void Simulation::StepLocal() {
+    unsigned int groups = (currentParticleCount + 127) / 128;
+    unsigned int substeps = 1u << std::clamp(timeBinLevels, 0, MAX_TIME_BIN_LEVEL);
+    unsigned int zero = 0;
+
+    // Every bin is due at the first substep, so the particles are synchronised for merging
+    if (adaptiveResolution) {
+        AdaptResolution();
+    }
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, timeBinStatsSSBO);
+    glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+
+    // One decision per base step: every particle is kicked at the first substep
+    SelectSlowForceRefresh();
+
+    for (unsigned int substep = 0; substep < substeps; ++substep) {
+        unsigned int writeIndex = 1 - readIndex;
+
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, cellAwakeSSBO);
+        glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, sleepStateSSBO);
+        glClearBufferSubData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, 0, SLEEP_LIST_OFFSET, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+        // MARK: adopt the chosen bins, drift everything one substep, flag cells with due particles
+        glUseProgram(timeBinMarkShader->shader_obj);
+        glUniform1ui(glGetUniformLocation(timeBinMarkShader->shader_obj, "substep"), substep);
+        particles.Bind<PositionField>(readIndex);
+        particles.Bind<VelocityField>(readIndex);
+        particles.BindOut<PositionField>(writeIndex);
+        particles.BindOut<VelocityField>(writeIndex);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 15, cellAwakeSSBO);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 16, resolutionSSBO);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 20, timeBinSSBO);
+        glDispatchCompute(groups, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+        // COMPACT + ARGS: due particles and their neighbours form the active list, as for sleeping
+        glUseProgram(sleepCompactShader->shader_obj);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 13, sleepStateSSBO);
+        glDispatchCompute(groups, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+        glUseProgram(sleepArgsShader->shader_obj);
+        glDispatchCompute(1, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+
+        // Density over the list, kicks for its due particles only
+        glUseProgram(physicsUpdateShader->shader_obj);
+        glUniform1ui(glGetUniformLocation(physicsUpdateShader->shader_obj, "substep"), substep);
+        ComputeDensity(true);
+        ComputeForces(writeIndex, true);
+
+        readIndex = writeIndex;
+    }
+}
+
+void Simulation::SolveViscosity() {
+    unsigned int groups = (currentParticleCount + 127) / 128;
+
+    particles.Bind<PositionField>(readIndex);
+    particles.Bind<VelocityField>(readIndex);  // v*, then the solution
+    particles.Bind<DensityField>();
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, timestepSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 16, resolutionSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 26, viscosityVectorsSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 27, viscosityProductsSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 28, viscosityPartialsSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 29, viscosityStateSSBO);
+    glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, viscosityStateSSBO);
+
+    // INIT: r0 = M v* - A v*, preconditioner, p0 = z0
+    glUseProgram(viscosityInitShader->shader_obj);
+    glDispatchCompute(groups, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    // Arm the dispatch arguments, unless v* already satisfies the tolerance
+    glUseProgram(viscosityCheckShader->shader_obj);
+    glUniform1i(glGetUniformLocation(viscosityCheckShader->shader_obj, "stage"), 0);
+    glDispatchCompute(1, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+
+    // CG ITERATIONS: all queued up front, as in SolveDFSPH; viscosity_check.comp zeroes the
+    // indirect group count once the residual is under tolerance
+    for (int i = 0; i < viscosityMaxIterations; ++i) {
+        glUseProgram(viscosityProductShader->shader_obj);
+        glDispatchComputeIndirect(0);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+        glUseProgram(viscosityCheckShader->shader_obj);
+        glUniform1i(glGetUniformLocation(viscosityCheckShader->shader_obj, "stage"), 1);
+        glDispatchCompute(1, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+        glUseProgram(viscosityUpdateShader->shader_obj);
+        glDispatchComputeIndirect(0);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+        glUseProgram(viscosityCheckShader->shader_obj);
+        glUniform1i(glGetUniformLocation(viscosityCheckShader->shader_obj, "stage"), 2);
+        glDispatchCompute(1, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+
+        glUseProgram(viscosityDirectionShader->shader_obj);
+        glDispatchComputeIndirect(0);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    }
+
+    glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+}
+
+void Simulation::BuildActiveList(unsigned int writeIndex) {
+    unsigned int groups = (currentParticleCount + 127) / 128;
+    unsigned int zero = 0;
+
+    // Counters left over from another solver, a reset or sleeping being off: wake everything
+    if (sleepCountersStale) {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, sleepCountersSSBO);
+        glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+        sleepCountersStale = false;
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, cellAwakeSSBO);
+    glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, sleepStateSSBO);
+    glClearBufferSubData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, 0, SLEEP_LIST_OFFSET, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    // MARK: wake particles under the mouse, flag awake cells, carry sleepers over at rest
+    glUseProgram(sleepMarkShader->shader_obj);
+    particles.Bind<PositionField>(readIndex);
+    particles.BindOut<PositionField>(writeIndex);
+    particles.BindOut<VelocityField>(writeIndex);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 13, sleepStateSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 14, sleepCountersSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 15, cellAwakeSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 16, resolutionSSBO);
+    glDispatchCompute(groups, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    // COMPACT: every particle within h of an awake cell joins the active list
+    glUseProgram(sleepCompactShader->shader_obj);
+    glDispatchCompute(groups, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    // ARGS: indirect dispatch size for the density and force passes
+    glUseProgram(sleepArgsShader->shader_obj);
+    glDispatchCompute(1, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+}
+
+void Simulation::AdaptResolution() {
+    // The surface indicator comes from the previous step's density pass
+    if (!surfaceOffsetsValid) return;
+
+    unsigned int groups = (currentParticleCount + 127) / 128;
+    unsigned int zero = 0;
+    resolutionAdapted = true;
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, freeListSSBO);
+    glClearBufferSubData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, sizeof(int), 2 * sizeof(unsigned int), GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    // Split and merge in place on the step N state, before anything reads it this step
+    particles.Bind<PositionField>(readIndex);
+    particles.Bind<VelocityField>(readIndex);
+    particles.Bind<DensityField>();
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 16, resolutionSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 17, surfaceSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 18, freeListSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 19, scratchSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 25, slowForceSSBO);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    // PAIR: interior particles pick their nearest interior partner of the same mass
+    glUseProgram(resolutionPairShader->shader_obj);
+    glDispatchCompute(groups, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    // MERGE: mutual pairs combine, freeing the higher slot
+    glUseProgram(resolutionMergeShader->shader_obj);
+    glDispatchCompute(groups, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    // SPLIT: merged particles at the surface take a free slot and halve
+    glUseProgram(resolutionSplitShader->shader_obj);
+    glUniform1i(glGetUniformLocation(resolutionSplitShader->shader_obj, "forceSplit"), false);
+    glDispatchCompute(groups, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+void Simulation::RestoreUniformResolution() {
+    unsigned int groups = (currentParticleCount + 127) / 128;
+
+    particles.Bind<PositionField>(readIndex);
+    particles.Bind<VelocityField>(readIndex);
+    particles.Bind<DensityField>();
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 16, resolutionSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 17, surfaceSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 18, freeListSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 25, slowForceSSBO);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    // Each round halves every merged particle; a particle of 2^k masses needs k rounds, and
+    // conservation of mass guarantees the free list holds exactly the slots they need
+    glUseProgram(resolutionSplitShader->shader_obj);
+    glUniform1ui(glGetUniformLocation(resolutionSplitShader->shader_obj, "particleCount"), currentParticleCount);
+    glUniform1f(glGetUniformLocation(resolutionSplitShader->shader_obj, "particleMass"), particleMass);
+    glUniform1f(glGetUniformLocation(resolutionSplitShader->shader_obj, "smoothingRadius"), smoothingRadius);
+    glUniform1i(glGetUniformLocation(resolutionSplitShader->shader_obj, "forceSplit"), true);
+    for (int level = 0; level < MAX_RESOLUTION_LEVEL; ++level) {
+        glDispatchCompute(groups, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    }
+    glUniform1i(glGetUniformLocation(resolutionSplitShader->shader_obj, "forceSplit"), false);
+
+    resolutionAdapted = false;
+    surfaceOffsetsValid = false;
+    resolutionStats = ResolutionStats();
+    sphTermsValid = false;
+}
+
+void Simulation::StepPBF(unsigned int writeIndex) {
+    unsigned int groups = (currentParticleCount + 127) / 128;
+
+    // PREDICT: x* = x + dt * (v + dt * a_ext), written to the step N+1 position buffer
+    glUseProgram(pbfPredictShader->shader_obj);
+    particles.Bind<PositionField>(readIndex);
+    particles.Bind<VelocityField>(readIndex);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, timestepSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 9, particles.Buffer<PositionField>(writeIndex));
+    glDispatchCompute(groups, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    // CONSTRAINT ITERATIONS: lambda, then dp; x* ping-pongs between the write and scratch buffers
+    unsigned int predicted = particles.Buffer<PositionField>(writeIndex);
+    unsigned int predictedOut = scratchSSBO;
+    for (int i = 0; i < pbfIterations; ++i) {
+        glUseProgram(pbfLambdaShader->shader_obj);
+        particles.Bind<DensityField>();
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, particles.Buffer<PressureField>()); // lambda
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, predicted);
+        glDispatchCompute(groups, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+        glUseProgram(pbfDeltaShader->shader_obj);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, particles.Buffer<PressureField>());
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, predicted);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 9, predictedOut);
+        glDispatchCompute(groups, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+        std::swap(predicted, predictedOut);
+    }
+
+    // UPDATE: v = (x* - x) / dt plus XSPH; copy x* across only if it ended up in the scratch buffer
+    glUseProgram(pbfUpdateShader->shader_obj);
+    glUniform1i(glGetUniformLocation(pbfUpdateShader->shader_obj, "writePositions"), predicted != particles.Buffer<PositionField>(writeIndex));
+    particles.Bind<PositionField>(readIndex);
+    particles.Bind<VelocityField>(readIndex);
+    particles.Bind<DensityField>();
+    particles.BindOut<PositionField>(writeIndex);
+    particles.BindOut<VelocityField>(writeIndex);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, stepStatsSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, timestepSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, predicted);
+    glDispatchCompute(groups, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+}
+
+void Simulation::StepDFSPH(unsigned int writeIndex) {
+    unsigned int groups = (currentParticleCount + 127) / 128;
+
+    // FACTOR: density and alpha at the step N positions
+    glUseProgram(dfsphFactorShader->shader_obj);
+    particles.Bind<PositionField>(readIndex);
+    particles.Bind<DensityField>();
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 10, alphaSSBO);
+    glDispatchCompute(groups, 1, 1);
+
+    // DIVERGENCE-FREE SOLVE: on a copy of the step N velocities, so [readIndex] stays intact
+    glBindBuffer(GL_COPY_READ_BUFFER, particles.Buffer<VelocityField>(readIndex));
+    glBindBuffer(GL_COPY_WRITE_BUFFER, scratchSSBO);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, sizeof(glm::vec2) * currentParticleCount);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    SolveDFSPH(scratchSSBO, kappaDivergenceSSBO, false, dfsphMaxDivergenceIterations);
+
+    // NON-PRESSURE FORCES: v* into the step N+1 velocity buffer
+    glUseProgram(dfsphForcesShader->shader_obj);
+    particles.Bind<PositionField>(readIndex);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, scratchSSBO);
+    particles.Bind<DensityField>();
+    particles.BindOut<VelocityField>(writeIndex);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, timestepSSBO);
+    glDispatchCompute(groups, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    // CONSTANT-DENSITY SOLVE: corrects v* in place
+    SolveDFSPH(particles.Buffer<VelocityField>(writeIndex), kappaDensitySSBO, true, dfsphMaxDensityIterations);
+
+    // ADVECT: x(n+1) = x(n) + dt v*, walls, max |v| / |a| reduction
+    glUseProgram(dfsphAdvectShader->shader_obj);
+    particles.Bind<PositionField>(readIndex);
+    particles.Bind<VelocityField>(readIndex);
+    particles.BindOut<PositionField>(writeIndex);
+    particles.BindOut<VelocityField>(writeIndex);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, stepStatsSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, timestepSSBO);
+    glDispatchCompute(groups, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+}
+
+void Simulation::SolveDFSPH(unsigned int velocityBuffer, unsigned int kappaSumBuffer, bool densitySolve, int maxIterations) {
+    unsigned int groups = (currentParticleCount + 127) / 128;
+    float tolerance = densitySolve ? dfsphDensityTolerance : dfsphDivergenceTolerance;
+
+    particles.Bind<PositionField>(readIndex);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, velocityBuffer);
+    particles.Bind<DensityField>();
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, particles.Buffer<PressureField>());  // this iteration's kappa
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, timestepSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 10, alphaSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 11, kappaSumBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 12, dfsphStateSSBO);
+    glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, dfsphStateSSBO);
+
+    // Re-arm the dispatch arguments and counters for this solve
+    glUseProgram(dfsphCheckShader->shader_obj);
+    glUniform1i(glGetUniformLocation(dfsphCheckShader->shader_obj, "densitySolve"), densitySolve);
+    glUniform1f(glGetUniformLocation(dfsphCheckShader->shader_obj, "tolerance"), tolerance);
+    glUniform1ui(glGetUniformLocation(dfsphCheckShader->shader_obj, "minIterations"), densitySolve ? 2 : 1);
+    glUniform1i(glGetUniformLocation(dfsphCheckShader->shader_obj, "beginSolve"), true);
+    glDispatchCompute(1, 1, 1);
+    glUniform1i(glGetUniformLocation(dfsphCheckShader->shader_obj, "beginSolve"), false);
+
+    // WARM START: apply half of last step's kappa before measuring anything
+    glUseProgram(dfsphKappaShader->shader_obj);
+    glUniform1i(glGetUniformLocation(dfsphKappaShader->shader_obj, "densitySolve"), densitySolve);
+    glUniform1i(glGetUniformLocation(dfsphKappaShader->shader_obj, "warmStart"), true);
+    glDispatchCompute(groups, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    glUseProgram(dfsphApplyShader->shader_obj);
+    glDispatchCompute(groups, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+
+    glUseProgram(dfsphKappaShader->shader_obj);
+    glUniform1i(glGetUniformLocation(dfsphKappaShader->shader_obj, "warmStart"), false);
+
+    // JACOBI ITERATIONS: all queued up front. dfsph_check.comp zeroes the indirect group count
+    // once the error is under tolerance, so converged iterations cost an empty dispatch each.
+    for (int i = 0; i < maxIterations; ++i) {
+        glUseProgram(dfsphKappaShader->shader_obj);
+        glDispatchComputeIndirect(0);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+        glUseProgram(dfsphCheckShader->shader_obj);
+        glDispatchCompute(1, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+
+        glUseProgram(dfsphApplyShader->shader_obj);
+        glDispatchComputeIndirect(0);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    }
+
+    glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+}
+
+float Simulation::ComputeLatticeRestDensity(bool spikyKernel) const {
+    // Density of the scene's initial square lattice, summed with the same kernel as the solver:
+    // poly6 for pbf_lambda.comp, spiky for dfsph_factor.comp
+    float spacing = sceneSpacing;
+    float h = smoothingRadius;
+    float h2 = h * h;
+    float poly6 = Kernels::Scale(Kernels::Poly6, h);
+    float spiky = Kernels::Scale(Kernels::Spiky, h);
+    int reach = static_cast<int>(h / spacing) + 1;
+
+    float density = 0.0f;
+    for (int y = -reach; y <= reach; ++y) {
+        for (int x = -reach; x <= reach; ++x) {
+            float distSq = (x * x + y * y) * spacing * spacing;
+            if (distSq >= h2) continue;
+            if (spikyKernel) {
+                float term = h - std::sqrt(distSq);
+                density += particleMass * spiky * term * term * term;
+            }
+            else {
+                float term = h2 - distSq;
+                density += particleMass * poly6 * term * term;
+            }
+        }
+    }
+    return density;
+}
+
+static_assert(sizeof(StepStats) == 6 * sizeof(float), "StepStats must mirror TimestepBuffer in timestep.comp");
+static_assert(sizeof(SolverStats) == 4 * sizeof(float), "SolverStats must mirror the tail of SolverStateBuffer in dfsph_check.comp");
+static_assert(sizeof(SleepStats) == 2 * sizeof(unsigned int), "SleepStats must mirror the counts in SleepStateBuffer in sleep_args.comp");
+static_assert(sizeof(ResolutionStats) == 3 * sizeof(unsigned int), "ResolutionStats must mirror the head of FreeListBuffer in resolution_merge.comp");
+static_assert(sizeof(TimeBinStats) == 7 * sizeof(unsigned int), "TimeBinStats must mirror TimeBinStatsBuffer in physics.comp");
+static_assert(sizeof(ViscositySolverStats) == 2 * sizeof(unsigned int), "ViscositySolverStats must mirror iterations / residual in viscosity_check.comp");
+
+void Simulation::Simulate(int steps, float simBoundaryLimit) {
+    SetStepUniforms(0.0f, false, 0.0f, 0.0f, simBoundaryLimit);
+    for (int i = 0; i < steps; ++i) {
+        Step();
+    }
+    if (backend == Backend::CPU) {
+        UploadCpuState();
+    }
+}
+
+StepStats Simulation::FetchStepStats() {
+    if (backend == Backend::CPU) {
+        return cpuSolver->GetStepStats();
+    }
+    StepStats stats;
+    glFinish();
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, timestepSSBO);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(StepStats), &stats);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    return stats;
+}
+
+void Simulation::ReadParticles(std::vector<glm::vec2>& positions, std::vector<glm::vec2>& velocities) const {
+    if (backend == Backend::CPU) {
+        cpuSolver->CopyKinematics(positions, velocities);
+        return;
+    }
+    positions.resize(currentParticleCount);
+    velocities.resize(currentParticleCount);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, particles.Buffer<PositionField>(readIndex));
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(glm::vec2) * currentParticleCount, positions.data());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, particles.Buffer<VelocityField>(readIndex));
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(glm::vec2) * currentParticleCount, velocities.data());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void Simulation::ReadBackStepStats() {
+    // Collect the previous copy once its fence has signalled; never wait on the GPU.
+    if (timestepReadbackFence) {
+        GLenum status = glClientWaitSync(timestepReadbackFence, 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) return;
+
+        glDeleteSync(timestepReadbackFence);
+        timestepReadbackFence = 0;
+
+        glBindBuffer(GL_COPY_READ_BUFFER, timestepReadbackBuffer);
+        glGetBufferSubData(GL_COPY_READ_BUFFER, 0, sizeof(StepStats), &stepStats);
+        if (solver == Solver::DFSPH) {
+            glGetBufferSubData(GL_COPY_READ_BUFFER, sizeof(StepStats), sizeof(SolverStats), &solverStats);
+        }
+        if (solver == Solver::SPH && enableSleeping && !localTimeStepping) {
+            glGetBufferSubData(GL_COPY_READ_BUFFER, sizeof(StepStats) + sizeof(SolverStats), sizeof(SleepStats), &sleepStats);
+        }
+        if (solver == Solver::SPH && adaptiveResolution) {
+            glGetBufferSubData(GL_COPY_READ_BUFFER, sizeof(StepStats) + sizeof(SolverStats) + sizeof(SleepStats), sizeof(ResolutionStats), &resolutionStats);
+        }
+        if (UsesLocalTimeStepping()) {
+            glGetBufferSubData(GL_COPY_READ_BUFFER, sizeof(StepStats) + sizeof(SolverStats) + sizeof(SleepStats) + sizeof(ResolutionStats), sizeof(TimeBinStats), &timeBinStats);
+        }
+        if (UsesImplicitViscosity()) {
+            glGetBufferSubData(GL_COPY_READ_BUFFER, sizeof(StepStats) + sizeof(SolverStats) + sizeof(SleepStats) + sizeof(ResolutionStats) + sizeof(TimeBinStats), sizeof(ViscositySolverStats), &viscositySolverStats);
+        }
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    }
+
+    glBindBuffer(GL_COPY_READ_BUFFER, timestepSSBO);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, timestepReadbackBuffer);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, sizeof(StepStats));
+    if (solver == Solver::DFSPH) {
+        glBindBuffer(GL_COPY_READ_BUFFER, dfsphStateSSBO);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, DFSPH_STATS_OFFSET, sizeof(StepStats), sizeof(SolverStats));
+    }
+    if (solver == Solver::SPH && enableSleeping && !localTimeStepping) {
+        glBindBuffer(GL_COPY_READ_BUFFER, sleepStateSSBO);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, SLEEP_STATS_OFFSET, sizeof(StepStats) + sizeof(SolverStats), sizeof(SleepStats));
+    }
+    if (solver == Solver::SPH && adaptiveResolution) {
+        glBindBuffer(GL_COPY_READ_BUFFER, freeListSSBO);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, sizeof(StepStats) + sizeof(SolverStats) + sizeof(SleepStats), sizeof(ResolutionStats));
+    }
+    if (UsesLocalTimeStepping()) {
+        glBindBuffer(GL_COPY_READ_BUFFER, timeBinStatsSSBO);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, sizeof(StepStats) + sizeof(SolverStats) + sizeof(SleepStats) + sizeof(ResolutionStats), sizeof(TimeBinStats));
+    }
+    if (UsesImplicitViscosity()) {
+        glBindBuffer(GL_COPY_READ_BUFFER, viscosityStateSSBO);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, VISCOSITY_STATS_OFFSET, sizeof(StepStats) + sizeof(SolverStats) + sizeof(SleepStats) + sizeof(ResolutionStats) + sizeof(TimeBinStats), sizeof(ViscositySolverStats));
+    }
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    timestepReadbackFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
 }
 
 void Simulation::UpdateParticleCount(int newCount) {
     if (newCount == (int)currentParticleCount) return;
     if (newCount > (int)maxParticles) newCount = maxParticles;
 
+    // Free slots and merged particles only make sense for the old count
+    if (resolutionAdapted && backend == Backend::GPU) {
+        RestoreUniformResolution();
+    }
+
     if (newCount > (int)currentParticleCount) {
         int numToAdd = newCount - currentParticleCount;
-        std::vector<glm::vec2> newPositions(numToAdd);
-        std::vector<glm::vec2> newVelocities(numToAdd, glm::vec2(0.0f));
+        particles.Reset(newCount);
+        glm::vec2* newPositions = particles.Data<PositionField>() + currentParticleCount;
 
-        std::random_device rd;
-        std::mt19937 gen(rd());
         std::uniform_real_distribution<float> dist(0.0f, 1.0f);
 
         for (int i = 0; i < numToAdd; ++i) {
-            float radius = 0.2f * std::sqrt(dist(gen));
-            float angle = 2.0f * 3.1415926f * dist(gen);
+            float radius = 0.2f * std::sqrt(dist(spawnRandom));
+            float angle = 2.0f * 3.1415926f * dist(spawnRandom);
             newPositions[i] = glm::vec2(radius * cos(angle), radius * sin(angle));
         }
 
-        glBindBuffer(GL_SHADER_STORAGE_BUFFER, positionSSBO);
-        glBufferSubData(GL_SHADER_STORAGE_BUFFER, sizeof(glm::vec2) * currentParticleCount, sizeof(glm::vec2) * numToAdd, newPositions.data());
-
-        glBindBuffer(GL_SHADER_STORAGE_BUFFER, velocitySSBO);
-        glBufferSubData(GL_SHADER_STORAGE_BUFFER, sizeof(glm::vec2) * currentParticleCount, sizeof(glm::vec2) * numToAdd, newVelocities.data());
-
-        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        // Only the new slots of the host arrays are filled, and only they are uploaded
+        if (backend == Backend::CPU) {
+            cpuSolver->Append(particles, currentParticleCount);
+        }
+        else {
+            particles.Upload(currentParticleCount, numToAdd, readIndex);
+        }
         std::cout << "Added " << numToAdd << " particles." << std::endl;
     }
+    else if (backend == Backend::CPU) {
+        cpuSolver->Truncate(newCount);
+    }
 
     currentParticleCount = newCount;
+    if (backend == Backend::CPU) {
+        UploadCpuState();
+    }
+    sleepCountersStale = true;
+    sphTermsValid = false;
+    slowForcesValid = false;
     std::cout << "Particle count set to " << currentParticleCount << std::endl;
 }
+
+CpuStats Simulation::GetCpuStats() const {
+    return cpuSolver ? cpuSolver->GetCpuStats() : CpuStats();
+}
+
+void Simulation::UploadCpuState() {
+    if (!cpuRenderBuffers) return;
+    cpuSolver->CopyState(particles);
+    particles.Upload(0, particles.Size());
+}
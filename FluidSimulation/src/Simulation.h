@@ -1,32 +1,163 @@
 #pragma once
 #include <vector>
 #include <memory>
+#include <random>
+#include <functional>
 #include <GL/glew.h>
 #include "glm.hpp"
 #include "Shader.h"
+#include "Kernels.h"
+#include "CpuKernels.h"
+#include "ParticleStore.h"
+
+// Values reduced on the GPU during a step, read back asynchronously for the UI.
+struct StepStats {
+    float deltaTime = 0.0f;   // timestep chosen for the next step (adaptive mode)
+    float maxSpeed = 0.0f;    // max |v| over all particles
+    float maxAccel = 0.0f;    // max |a| over all particles
+    unsigned int nanResets = 0;       // NaN resets in the last step
+    unsigned int totalNanResets = 0;  // NaN resets since the last ResetScene
+    float previousDeltaTime = 0.0f;   // dt of the step just taken (leapfrog closing kick)
+};
+
+// DFSPH convergence of the last step, read back with StepStats.
+struct SolverStats {
+    unsigned int divergenceIterations = 0;
+    unsigned int densityIterations = 0;
+    float divergenceError = 0.0f;  // average relative error when the solve stopped
+    float densityError = 0.0f;
+};
+
+// Sleeping particles of the last step, read back with StepStats.
+struct SleepStats {
+    unsigned int activeParticles = 0;    // dispatched through density.comp / physics.comp
+    unsigned int sleepingParticles = 0;  // flagged asleep, including those still run as neighbours
+};
+
+// Adaptive resolution of the last step, read back with StepStats.
+struct ResolutionStats {
+    int freeSlots = 0;         // slots emptied by merges; live particles = count - freeSlots
+    unsigned int splits = 0;   // in the last step
+    unsigned int merges = 0;
+};
+
+// Local time stepping over the last base step, read back with StepStats.
+struct TimeBinStats {
+    static const int MAX_BINS = 6;
+    unsigned int particlesPerBin[MAX_BINS] = {};  // bin b steps with fixedTimestep / 2^b
+    unsigned int kicks = 0;                       // particle updates over the base step
+};
+
+// Implicit viscosity solve of the last step, read back with StepStats.
+struct ViscositySolverStats {
+    unsigned int iterations = 0;  // CG iterations
+    float residual = 0.0f;        // relative residual |r| / |M v*| when the solve stopped
+};
+
+// Initial particle layouts, also used as the benchmark scenes.
+enum class Scene {
+    Block,     // square lattice centred in the domain (the original start-up layout)
+    DamBreak,  // column against the left wall
+    Drop       // disk released from the upper half
+};
+
+// One force evaluation per step either way. Folded across steps, kick-drift-kick is the same
+// update as semi-implicit Euler (the closing half-kick of one step and the opening half-kick of
+// the next add up to one full kick), started half a kick later, so the stable dt is the same.
+// Leapfrog differs only in where the damping applies, in reporting the synchronised speed v(n)
+// to the adaptive timestep, and in kicking by the mean of the two steps' dt when dt changes.
+enum class Integrator {
+    SemiImplicitEuler = 0,  // v += a dt; x += v dt
+    Leapfrog = 1            // kick-drift-kick; stored velocities are the half-step v(n+1/2)
+};
+
+// Walls of the SPH solver (PBF and DFSPH have their own)
+enum class BoundaryMode {
+    Penalty = 0,    // spring force boundaryStiffness * penetration before integration; limits dt
+    Projection = 1  // clamp into the domain after integration and reflect the outward velocity
+};
+
+enum class Solver {
+    SPH = 0,  // weakly compressible: density.comp equation of state + physics.comp forces
+    PBF = 1,  // Position Based Fluids: iterative density-constraint projection
+    DFSPH = 2 // Divergence-free SPH: pressure solves on velocity for zero divergence and rest density
+};
+
+// Where the steps run, chosen once at Init
+enum class Backend {
+    GPU = 0,  // the compute shaders
+    CPU = 1   // CpuSolver on a thread pool; plain SPH only (see CpuSolver.h)
+};
+
+// The per-particle state every solver shares and the renderer draws. Positions and velocities
+// are ping-pong pairs; the other per-solver buffers (DFSPH, sleeping, ...) stay separate.
+struct PositionField : ParticleField<glm::vec2, 2> { static constexpr const char* BLOCK = "Position"; static constexpr const char* ARRAY = "positions"; };
+struct VelocityField : ParticleField<glm::vec2, 2> { static constexpr const char* BLOCK = "Velocity"; static constexpr const char* ARRAY = "velocities"; };
+struct DensityField : ParticleField<float> { static constexpr const char* BLOCK = "Density"; static constexpr const char* ARRAY = "densities"; };
+struct PressureField : ParticleField<float> { static constexpr const char* BLOCK = "Pressure"; static constexpr const char* ARRAY = "pressures"; };
+using ParticleData = ParticleStore<PositionField, VelocityField, DensityField, PressureField>;
+
+class CpuSolver;
+struct CpuStats;
 
 class Simulation {
 public:
     Simulation();
     ~Simulation();
 
-    void Init(unsigned int maxParticles, unsigned int initialParticles);
-    void Update(float deltaTime, float currentFrame, bool isMouseDown, float mouseX, float mouseY, float simBoundaryLimit);
+    // The CPU backend needs no GL context; with one (glewInit done) it also keeps render buffers
+    // of the particles, uploaded after every Update.
+    void Init(unsigned int maxParticles, unsigned int initialParticles, Backend backend = Backend::GPU);
+    // Advances the simulation by frameTime of wall-clock time in whole fixed substeps (see fixedTimestep).
+    void Update(float frameTime, float currentFrame, bool isMouseDown, float mouseX, float mouseY, float simBoundaryLimit);
     void UpdateParticleCount(int newCount);
+    // Re-lays out the current particles at rest and restarts the timestep controller.
+    void ResetScene(Scene scene);
+    // The layout ResetScene gives count particles: place(i, position) for each particle in index
+    // order, without storing them. Returns the lattice spacing.
+    static float LayOutScene(Scene scene, unsigned int count, const std::function<void(unsigned int, glm::vec2)>& place);
 
-    unsigned int GetPositionSSBO() const { return positionSSBO; }
-    unsigned int GetVelocitySSBO() const { return velocitySSBO; }
-    unsigned int GetDensitySSBO() const { return densitySSBO; }
-    unsigned int GetPressureSSBO() const { return pressureSSBO; }
+    // Runs a fixed number of steps outside the frame accumulator (benchmarks, batch runs).
+    void Simulate(int steps, float simBoundaryLimit);
+    // Blocking read of the GPU timestep state; for benchmarks, not the render loop.
+    StepStats FetchStepStats();
+    // Blocking copy of the current positions and velocities from either backend; for benchmarks.
+    // Only grows the arrays, so a caller that keeps them reads back without allocating.
+    void ReadParticles(std::vector<glm::vec2>& positions, std::vector<glm::vec2>& velocities) const;
+
+    // The particle buffers, and the copy of the pairs holding the last completed step. The next
+    // Update writes into the other copy, so these stay valid for rendering.
+    const ParticleData& GetParticles() const { return particles; }
+    unsigned int GetReadCopy() const { return readIndex; }
     unsigned int GetParticleCount() const { return currentParticleCount; }
     unsigned int GetMaxParticles() const { return maxParticles; }
+    // Lattice spacing of the last ResetScene layout.
+    float GetSceneSpacing() const { return sceneSpacing; }
+    // Density of that lattice at the smoothing radius, summed with poly6 or the spiky kernel: the
+    // rest density of PBF and DFSPH respectively
+    float ComputeLatticeRestDensity(bool spikyKernel) const;
+    // Timestep used by the last Update. In adaptive mode this lags the GPU by a frame or two.
+    float GetTimestep() const { return adaptiveTimestep && !UsesLocalTimeStepping() ? stepStats.deltaTime : fixedTimestep; }
+    const StepStats& GetStepStats() const { return stepStats; }
+    const SolverStats& GetSolverStats() const { return solverStats; }
+    const SleepStats& GetSleepStats() const { return sleepStats; }
+    const ResolutionStats& GetResolutionStats() const { return resolutionStats; }
+    const TimeBinStats& GetTimeBinStats() const { return timeBinStats; }
+    const ViscositySolverStats& GetViscositySolverStats() const { return viscositySolverStats; }
+    int GetLastSubstepCount() const { return lastSubstepCount; }
+    float GetStepsPerSecond() const { return stepsPerSecond; }
+    Backend GetBackend() const { return backend; }
+    // Thread count and throughput of the CPU backend; zeros on the GPU
+    CpuStats GetCpuStats() const;
 
     // Simulation Parameters
     float gravityStrength = 9.8f;
     float restDensity = 10.0f;
     float gasConstant = 1.0f;
+    BoundaryMode boundaryMode = BoundaryMode::Penalty;
     float boundaryStiffness = 1200.0f;
     float boundaryDamping = 0.75f;
+    float boundaryRestitution = 0.0f; // Projection: 0 stops the normal velocity, 1 bounces elastically
     float viscosity = 0.1f; // Used for UI slider, might need to map to viscosityConstant if they are related
     float viscosityConstant = 0.25f;
     float pressureMultiplier = 0.01f;
@@ -35,21 +166,283 @@ public:
     float smoothingRadius = 0.2f;
     float particleMass = 0.01f;
 
+    // Pressure solver, switchable at runtime
+    Solver solver = Solver::SPH;
+
+    // Position Based Fluids and DFSPH use the density of the scene's initial lattice as rest
+    // density rather than restDensity, which the weakly compressible solver never reaches at
+    // typical particle counts; starting at rest density keeps the first solve from exploding.
+    int pbfIterations = 4;
+    float pbfRelaxation = 10.0f;    // epsilon in lambda = -C / (sum |grad C|^2 + epsilon)
+    float pbfTensileK = 0.001f;     // artificial pressure (s_corr) strength
+
+    // XSPH viscosity of the PBF and DFSPH solvers (the SPH force pass uses viscosityConstant)
+    float xsphViscosity = 0.05f;
+
+    // DFSPH. Tolerances are average relative density errors: compression for the density
+    // solve, compression rate * dt for the divergence solve. Both solves are warm-started.
+    float dfsphDensityTolerance = 0.001f;
+    float dfsphDivergenceTolerance = 0.01f;
+    int dfsphMaxDensityIterations = 50;
+    int dfsphMaxDivergenceIterations = 50;
+
+    // Sleeping (SPH solver only). A particle whose |v| and |a| stay under the thresholds for
+    // sleepSteps consecutive steps falls asleep; only awake particles and those within h of one
+    // go through density.comp and physics.comp. The mouse wakes the particles under it.
+    bool enableSleeping = false;
+    float sleepSpeedThreshold = 0.02f;
+    float sleepAccelThreshold = 0.5f;
+    int sleepSteps = 30;
+
+    // Adaptive resolution (SPH solver only). Interior particles merge pairwise into particles of
+    // twice the mass and sqrt(2) times the smoothing length, up to particleMass * 2^maxResolutionLevel,
+    // and split back once they reach the free surface. A particle's distance from the
+    // kernel-weighted centroid of its neighbours, in smoothing lengths, tells surface from bulk.
+    bool adaptiveResolution = false;
+    int maxResolutionLevel = 2;
+    float splitSurfaceOffset = 0.1f;
+    float mergeSurfaceOffset = 0.03f;
+    static const int MAX_RESOLUTION_LEVEL = 4;
+
+    // Local time stepping (SPH solver only). Each step of fixedTimestep is split into
+    // 2^timeBinLevels substeps; a particle in bin b is kicked with fixedTimestep / 2^b every
+    // 2^(timeBinLevels - b) substeps, and its bin follows its own CFL and force criteria
+    // (cflNumber, forceFactor). Every particle drifts each substep. Replaces the adaptive
+    // timestep and sleeping while enabled.
+    bool localTimeStepping = false;
+    int timeBinLevels = 3;
+    static const int MAX_TIME_BIN_LEVEL = TimeBinStats::MAX_BINS - 1;
+    bool UsesLocalTimeStepping() const { return solver == Solver::SPH && localTimeStepping; }
+
+    // Fused SPH step (plain SPH only: not with local time stepping, sleeping or adaptive
+    // resolution). The force pass also sums density, so each step sweeps the neighbours once;
+    // the neighbours' pressure and m / rho come from the previous step.
+    bool fusedStep = false;
+    bool UsesFusedStep() const {
+        return solver == Solver::SPH && fusedStep && !localTimeStepping && !enableSleeping && !adaptiveResolution;
+    }
+
+    // Multi-rate forces (SPH solver). Viscosity and surface tension vary slowly, so they are
+    // recomputed every slowForceInterval steps and reused in between; pressure and integration
+    // run every step. 1 recomputes everything every step.
+    int slowForceInterval = 1;
+
+    // Implicit viscosity (SPH solver, not with local time stepping). Before the force pass the
+    // velocities are solved for (M + dt mu K) v = M v* by Jacobi-preconditioned conjugate
+    // gradients on the GPU, so viscosityConstant no longer limits dt. The solve stops once the
+    // relative residual is under viscosityTolerance or after viscosityMaxIterations.
+    bool implicitViscosity = false;
+    float viscosityTolerance = 0.001f;
+    int viscosityMaxIterations = 30;
+    bool UsesImplicitViscosity() const { return solver == Solver::SPH && implicitViscosity && !localTimeStepping; }
+
+    // Kernel family of the SPH solver's density, pressure and viscosity (see Kernels.h). The
+    // Wendland kernels do not pair particles up at two or three spacings, where poly6 / spiky
+    // does, but their gradients are normalised and stiffer, so they need a smaller dt.
+    // Switching rebuilds the SPH shaders.
+    KernelFamily kernelFamily = KernelFamily::Poly6Spiky;
+
+    // Kernel lookup table (SPH solver). The density and force passes read the kernel shapes
+    // from a Kernels::TABLE_SIZE entry 1D texture indexed by r / h and interpolated
+    // linearly, instead of evaluating the polynomials per neighbour pair. Switching rebuilds
+    // the SPH shaders.
+    bool kernelLookupTable = false;
+
+    // Double sums (SPH solver). The density and force passes add up each particle's neighbour
+    // terms in double (dvec2), as the CPU backend's mixed precision does; the terms and the
+    // particle buffers stay float. Needs fp64 shaders (GL 4.0 or GL_ARB_gpu_shader_fp64), and
+    // sums in float without them. Switching rebuilds the SPH shaders.
+    bool doubleSums = false;
+
+    // Time integration. Damping removes globalDamping * dt of the velocity every step.
+    Integrator integrator = Integrator::SemiImplicitEuler;
+    float globalDamping = 1.0f;
+
+    // Fixed-timestep accumulator: each frame runs as many steps of fixedTimestep as
+    // the elapsed time covers, capped at maxSubstepsPerFrame
+    float fixedTimestep = 0.008f;
+    int maxSubstepsPerFrame = 8;
+
+    // Adaptive timestep: dt = clamp(min(cfl * h / max|v|, forceFactor * sqrt(h / max|a|)), min, max)
+    bool adaptiveTimestep = false;
+    float cflNumber = 0.4f;
+    float forceFactor = 0.25f;
+    float minTimestep = 0.0001f;
+    float maxTimestep = 0.02f;
+
+    // Worker threads of the CPU backend, read at Init; 0 uses every hardware thread
+    unsigned int cpuThreads = 0;
+    // NUMA slabs of the CPU backend, read at Init: 0 gives one per node the OS reports (none on
+    // a single socket), 1 turns slabs and pinning off, and more than the OS has splits its
+    // nodes' CPUs (to exercise the partitioning on one socket)
+    unsigned int cpuNumaNodes = 0;
+    // Ask the OS for transparent huge pages for the CPU backend's arrays, read at Init (Linux)
+    bool cpuHugePages = false;
+    // Scalar types of the CPU backend's state and sums, read at Init (see CpuSolver)
+    CpuPrecision cpuPrecision = CpuPrecision::Single;
+    // Instruction set of the CPU backend's neighbour sums; unsupported choices fall back to Auto
+    CpuIsa cpuIsa = CpuIsa::Auto;
+    // The CPU backend's density and force sums visit each neighbour pair once (the half shell of
+    // its cell) and apply it to both particles, instead of gathering from both ends
+    bool cpuHalfShell = true;
+    // The CPU backend's results do not depend on the thread count or schedule (see CpuSolver),
+    // at the cost of sorting every cell's particles each step
+    bool cpuDeterministic = false;
+
 private:
     unsigned int maxParticles;
     unsigned int currentParticleCount;
 
-    unsigned int positionSSBO;
-    unsigned int velocitySSBO;
-    unsigned int densitySSBO;
-    unsigned int pressureSSBO;
+    // CPU backend: the solver, and its state staged for the render buffers
+    Backend backend;
+    std::unique_ptr<CpuSolver> cpuSolver;
+    bool cpuRenderBuffers;  // Init found a GL context and created copy 0 of the particle buffers
+    void UploadCpuState();
+
+    // Particle buffers; the host arrays stage scenes, added particles and the CPU backend's state.
+    // The pairs ping-pong: each step reads copy readIndex and writes 1 - readIndex,
+    // so neighbour reads never observe partially updated state.
+    ParticleData particles;
+    std::mt19937 spawnRandom;  // positions of added particles; seeded once
+    unsigned int readIndex;
     unsigned int cellCountsSSBO;
+    unsigned int scratchSSBO;  // scratch: second PBF x* buffer, DFSPH divergence-free velocities, merge partners
+
+    // DFSPH: alpha factors, per-solve kappa totals for warm starting, and the solver state
+    // (indirect dispatch arguments, error sum, iteration counts)
+    unsigned int alphaSSBO;
+    unsigned int kappaDensitySSBO;
+    unsigned int kappaDivergenceSSBO;
+    unsigned int dfsphStateSSBO;
+
+    // Sleeping: per-particle quiet-step counters, per-cell awake flags, and the active list
+    // (indirect dispatch arguments, counts, particle indices)
+    unsigned int sleepCountersSSBO;
+    unsigned int cellAwakeSSBO;
+    unsigned int sleepStateSSBO;
+    bool sleepCountersStale;  // counters no longer describe the particles; cleared before use
+
+    // Adaptive resolution: per-particle (mass, smoothing length), the surface indicator written by
+    // density.comp, and the free slot list (count, split/merge counts, slot indices)
+    unsigned int resolutionSSBO;
+    unsigned int surfaceSSBO;
+    unsigned int freeListSSBO;
+    bool resolutionAdapted;    // some slots may hold merged particles or be free
+    bool surfaceOffsetsValid;  // surfaceSSBO was written by a density pass since the last reset
+
+    // Local time stepping: per particle, the bin this substep and the bin its last kick chose;
+    // and TimeBinStats
+    unsigned int timeBinSSBO;
+    unsigned int timeBinStatsSSBO;
+
+    // Fused step: per-particle (m / rho, p m / rho), written by density.comp into [termsReadIndex]
+    // and by the fused force pass into the other half
+    unsigned int sphTermsSSBO[2];
+    unsigned int termsReadIndex;
+    bool sphTermsValid;  // [termsReadIndex] holds every particle's terms from the last SPH step
+
+    // Multi-rate forces: cached viscosity + surface tension per particle, and its age in steps
+    unsigned int slowForceSSBO;
+    int slowForceAge;
+    bool slowForcesValid;  // cleared whenever the cache no longer belongs to the particles
+
+    // Implicit viscosity: per particle the CG vectors (r, p) and (A p, 1 / A_ii), per workgroup
+    // the partial dot products, and the solver state (indirect dispatch arguments, stats, scalars)
+    unsigned int viscosityVectorsSSBO;
+    unsigned int viscosityProductsSSBO;
+    unsigned int viscosityPartialsSSBO;
+    unsigned int viscosityStateSSBO;
+
+    // Kernel lookup table: Kernels::TableShapes of the family at TABLE_SIZE values of q, RGB32F on
+    // texture unit 0
+    unsigned int kernelTableTexture;
+    bool kernelTableLoaded;  // the SPH shaders were built with the table
+    KernelFamily loadedKernelFamily;  // ... and for this family
+    bool doubleSumsLoaded;  // ... and with doubleSums
+
+    // Adaptive timestep: reduction results, the chosen dt, and a staging copy for readback
+    unsigned int stepStatsSSBO;
+    unsigned int timestepSSBO;
+    unsigned int timestepReadbackBuffer;
+    GLsync timestepReadbackFence;
+    StepStats stepStats;
+    SolverStats solverStats;
+    SleepStats sleepStats;
+    ResolutionStats resolutionStats;
+    TimeBinStats timeBinStats;
+    ViscositySolverStats viscositySolverStats;
+    float sceneSpacing;  // lattice spacing of the last ResetScene layout
+
+    // Accumulator state and steps/second bookkeeping
+    float stepAccumulator;
+    int lastSubstepCount;
+    int stepsSinceRateSample;
+    float rateSampleStart;
+    float stepsPerSecond;
+
+    // (Re)builds the SPH shaders for the kernel family and the analytic kernels or the lookup
+    // table, and refills the table
+    void LoadKernelShaders();
+    void SetStepUniforms(float currentFrame, bool isMouseDown, float mouseX, float mouseY, float simBoundaryLimit);
+    void Step();
+    void StepSPH(unsigned int writeIndex);
+    // Density and force passes of the SPH solver, over the active list or every particle
+    void ComputeDensity(bool activeListOnly);
+    void ComputeForces(unsigned int writeIndex, bool activeListOnly);
+    void StepFused(unsigned int writeIndex);
+    // Whether this step recomputes the cached slow forces; sets the force pass uniform
+    void SelectSlowForceRefresh();
+    // One base step in 2^timeBinLevels substeps; swaps the ping-pong pairs after each substep
+    void StepLocal();
+    // Implicit viscosity on the step N velocities, in place; needs this step's densities
+    void SolveViscosity();
+    void BuildActiveList(unsigned int writeIndex);
+    void AdaptResolution();
+    // Splits every merged particle back to particleMass, for the solvers and paths that assume it
+    void RestoreUniformResolution();
+    void StepPBF(unsigned int writeIndex);
+    void StepDFSPH(unsigned int writeIndex);
+    void SolveDFSPH(unsigned int velocityBuffer, unsigned int kappaSumBuffer, bool densitySolve, int maxIterations);
+    void ReadBackStepStats();
 
     std::unique_ptr<Shader> physicsUpdateShader;
     std::unique_ptr<Shader> densityShader;
     std::unique_ptr<Shader> gridClearShader;
     std::unique_ptr<Shader> gridCountShader;
+    std::unique_ptr<Shader> timestepShader;
+    std::unique_ptr<Shader> pbfPredictShader;
+    std::unique_ptr<Shader> pbfLambdaShader;
+    std::unique_ptr<Shader> pbfDeltaShader;
+    std::unique_ptr<Shader> pbfUpdateShader;
+    std::unique_ptr<Shader> dfsphFactorShader;
+    std::unique_ptr<Shader> dfsphKappaShader;
+    std::unique_ptr<Shader> dfsphCheckShader;
+    std::unique_ptr<Shader> dfsphApplyShader;
+    std::unique_ptr<Shader> dfsphForcesShader;
+    std::unique_ptr<Shader> dfsphAdvectShader;
+    std::unique_ptr<Shader> sleepMarkShader;
+    std::unique_ptr<Shader> sleepCompactShader;
+    std::unique_ptr<Shader> sleepArgsShader;
+    std::unique_ptr<Shader> resolutionPairShader;
+    std::unique_ptr<Shader> resolutionMergeShader;
+    std::unique_ptr<Shader> resolutionSplitShader;
+    std::unique_ptr<Shader> timeBinMarkShader;
+    std::unique_ptr<Shader> viscosityInitShader;
+    std::unique_ptr<Shader> viscosityProductShader;
+    std::unique_ptr<Shader> viscosityUpdateShader;
+    std::unique_ptr<Shader> viscosityDirectionShader;
+    std::unique_ptr<Shader> viscosityCheckShader;
 
     static const unsigned int GRID_DIM = 64;
     static const unsigned int NUM_GRID_CELLS = GRID_DIM * GRID_DIM;
+    // SolverStats sit after the dispatch arguments and error sum in dfsphStateSSBO
+    static const unsigned int DFSPH_STATS_OFFSET = 4 * sizeof(unsigned int);
+    // SleepStats follow the dispatch arguments in sleepStateSSBO, then the active indices
+    static const unsigned int SLEEP_STATS_OFFSET = 3 * sizeof(unsigned int);
+    static const unsigned int SLEEP_LIST_OFFSET = 5 * sizeof(unsigned int);
+    // ResolutionStats head freeListSSBO, followed by the free slot indices
+    static const unsigned int FREE_LIST_SLOTS_OFFSET = 3 * sizeof(unsigned int);
+    // ViscositySolverStats follow the dispatch arguments in viscosityStateSSBO, then the CG scalars
+    static const unsigned int VISCOSITY_STATS_OFFSET = 3 * sizeof(unsigned int);
+    static const unsigned int VISCOSITY_STATE_SIZE = 9 * sizeof(unsigned int);
 };
@@ -0,0 +1,94 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+// Bump allocator for scratch memory that lives for one simulation step. Allocate hands out
+// aligned slices of a block and Reset takes them all back at once. When a step needs more than
+// the block holds, the overflow goes to extra blocks, and the next Reset merges them into one
+// block of the combined size. After the first step that reaches the peak, the steps allocate
+// nothing from the heap.
+//
+// Only for trivially destructible types, whose slices are left uninitialised. Not thread-safe:
+// allocate on the calling thread before a parallel pass, then hand the slices to the workers.
+class StepArena {
+public:
+    explicit StepArena(std::size_t initialBytes = 0) {
+        if (initialBytes > 0) AddBlock(initialBytes);
+    }
+    StepArena(const StepArena&) = delete;
+    StepArena& operator=(const StepArena&) = delete;
+
+    template <typename T>
+    T* Allocate(std::size_t count) {
+        static_assert(std::is_trivially_destructible_v<T>, "StepArena never runs destructors");
+        return static_cast<T*>(AllocateBytes(sizeof(T) * count, alignof(T)));
+    }
+
+    void* AllocateBytes(std::size_t bytes, std::size_t alignment) {
+        bytes = std::max<std::size_t>(bytes, 1);
+        if (!blocks.empty()) {
+            if (void* slice = Take(blocks.back(), bytes, alignment)) return slice;
+            spilled += used;
+        }
+        // Overflow: a block for this request and as much again as the others, merged at the
+        // next Reset
+        AddBlock(std::max(bytes + alignment, Capacity()));
+        used = 0;
+        return Take(blocks.back(), bytes, alignment);
+    }
+
+    // Frees every slice; merges the blocks if the last step overflowed
+    void Reset() {
+        peakBytes = std::max(peakBytes, Used());
+        if (blocks.size() > 1) {
+            std::size_t total = Capacity();
+            blocks.clear();
+            AddBlock(total);
+        }
+        used = 0;
+        spilled = 0;
+    }
+
+    // Bytes the blocks hold, handed out this step and the most any step has used
+    std::size_t Capacity() const {
+        std::size_t total = 0;
+        for (const Block& block : blocks) total += block.size;
+        return total;
+    }
+    std::size_t Used() const { return spilled + used; }
+    std::size_t PeakBytes() const { return std::max(peakBytes, Used()); }
+
+private:
+    // Blocks start on a cache line, so slices aligned to one stay apart from their neighbours
+    static constexpr std::size_t LINE = 64;
+
+    struct Block {
+        std::unique_ptr<unsigned char[]> storage;
+        unsigned char* data;  // storage rounded up to a cache line
+        std::size_t size;
+    };
+    std::vector<Block> blocks;
+    std::size_t used = 0;     // bytes taken from the last block
+    std::size_t spilled = 0;  // bytes taken from the blocks before it this step
+    std::size_t peakBytes = 0;
+
+    void* Take(const Block& block, std::size_t bytes, std::size_t alignment) {
+        std::uintptr_t address = reinterpret_cast<std::uintptr_t>(block.data) + used;
+        std::size_t offset = used + ((alignment - address % alignment) % alignment);
+        if (offset + bytes > block.size) return nullptr;
+        used = offset + bytes;
+        return block.data + offset;
+    }
+
+    void AddBlock(std::size_t bytes) {
+        bytes = (bytes + LINE - 1) & ~(LINE - 1);
+        Block block{ std::unique_ptr<unsigned char[]>(new unsigned char[bytes + LINE]), nullptr, bytes };
+        std::uintptr_t address = reinterpret_cast<std::uintptr_t>(block.storage.get());
+        block.data = block.storage.get() + (LINE - address % LINE) % LINE;
+        blocks.push_back(std::move(block));
+    }
+};
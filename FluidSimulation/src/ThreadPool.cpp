@@ -0,0 +1,154 @@
+#include "ThreadPool.h"
+#include <algorithm>
+
+ThreadPool::ThreadPool(unsigned int threads)
+    : slabItems(0), remoteItems(0), jobInvoke(nullptr), jobContext(nullptr), remainingChunks(0), generation(0),
+      stopping(false)
+{
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned int i = 0; i < threads; ++i) {
+        queues.push_back(std::make_unique<Queue>());
+    }
+    threadNodes.assign(threads, 0);
+    nodeThreads.resize(1);
+    for (unsigned int i = 0; i < threads; ++i) {
+        nodeThreads[0].push_back(i);
+    }
+    for (unsigned int i = 1; i < threads; ++i) {
+        workers.emplace_back(&ThreadPool::WorkerLoop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+bool ThreadPool::PinToNodes(const std::vector<NumaNode>& nodes) {
+    unsigned int threadCount = GetThreadCount();
+    unsigned int nodeCount = std::max(1u, std::min(threadCount, static_cast<unsigned int>(nodes.size())));
+    nodeThreads.assign(nodeCount, {});
+    bool pinned = true;
+    for (unsigned int t = 0; t < threadCount; ++t) {
+        unsigned int node = t * nodeCount / threadCount;
+        threadNodes[t] = node;
+        nodeThreads[node].push_back(t);
+        if (nodes.empty()) continue;
+        pinned &= t == 0 ? Numa::PinCurrentThread(nodes[node]) : Numa::PinThread(workers[t - 1], nodes[node]);
+    }
+    return pinned;
+}
+
+void ThreadPool::Run(const size_t* slabEnds, size_t slabCount, size_t grain, Invoke invoke, void* context) {
+    size_t count = slabEnds[slabCount - 1];
+    if (count == 0) return;
+    grain = std::max<size_t>(1, grain);
+    size_t chunkCount = 0;
+    for (size_t slab = 0, begin = 0; slab < slabCount; begin = slabEnds[slab++]) {
+        chunkCount += (slabEnds[slab] - begin + grain - 1) / grain;
+    }
+
+    // Nothing to share: run inline and skip the wake-up
+    if (workers.empty() || chunkCount == 1) {
+        for (size_t begin = 0; begin < count; begin += grain) {
+            invoke(context, begin, std::min(count, begin + grain), 0);
+        }
+        return;
+    }
+    if (slabCount > 1) slabItems += count;
+
+    // Set the job before any chunk becomes visible; a worker still looking for work from the
+    // previous job only sees the new chunks through a queue mutex, after these stores
+    jobInvoke = invoke;
+    jobContext = context;
+    remainingChunks.store(chunkCount, std::memory_order_relaxed);
+    for (std::unique_ptr<Queue>& queue : queues) {
+        std::lock_guard<std::mutex> lock(queue->mutex);
+        queue->chunks.clear();
+        queue->head = 0;
+    }
+    // Chunks round-robin over the threads, or over its node's threads for each slab of a
+    // ParallelForSlabs
+    size_t dealt = 0;
+    for (size_t slab = 0, begin = 0; slab < slabCount; begin = slabEnds[slab++]) {
+        const std::vector<unsigned int>* owners = slabCount > 1 && slab < nodeThreads.size() ? &nodeThreads[slab] : nullptr;
+        unsigned int node = owners ? static_cast<unsigned int>(slab) : ANY_NODE;
+        for (size_t c = begin; c < slabEnds[slab]; c += grain, ++dealt) {
+            size_t owner = owners ? (*owners)[dealt % owners->size()] : dealt % queues.size();
+            Queue& queue = *queues[owner];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.chunks.push_back({ c, std::min(slabEnds[slab], c + grain), node });
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        ++generation;
+    }
+    wake.notify_all();
+
+    RunChunks(0);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [this] { return remainingChunks.load(std::memory_order_acquire) == 0; });
+}
+
+void ThreadPool::WorkerLoop(unsigned int thread) {
+    unsigned long long seen = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&] { return stopping || generation != seen; });
+            if (stopping) return;
+            seen = generation;
+        }
+        RunChunks(thread);
+    }
+}
+
+void ThreadPool::RunChunks(unsigned int thread) {
+    Chunk chunk;
+    while (PopOrSteal(thread, chunk)) {
+        jobInvoke(jobContext, chunk.begin, chunk.end, thread);
+        if (chunk.node != ANY_NODE && chunk.node != threadNodes[thread]) {
+            remoteItems.fetch_add(chunk.end - chunk.begin, std::memory_order_relaxed);
+        }
+        if (remainingChunks.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            std::lock_guard<std::mutex> lock(mutex);
+            done.notify_all();
+        }
+    }
+}
+
+bool ThreadPool::PopOrSteal(unsigned int thread, Chunk& chunk) {
+    {
+        Queue& own = *queues[thread];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (own.chunks.size() > own.head) {
+            chunk = own.chunks.back();
+            own.chunks.pop_back();
+            return true;
+        }
+    }
+    // Same node first, then the rest
+    size_t threadCount = queues.size();
+    for (int sameNode = 1; sameNode >= 0; --sameNode) {
+        for (size_t offset = 1; offset < threadCount; ++offset) {
+            size_t victimThread = (thread + offset) % threadCount;
+            if ((threadNodes[victimThread] == threadNodes[thread]) != (sameNode == 1)) continue;
+            Queue& victim = *queues[victimThread];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (victim.chunks.size() > victim.head) {
+                chunk = victim.chunks[victim.head++];
+                return true;
+            }
+        }
+    }
+    return false;
+}
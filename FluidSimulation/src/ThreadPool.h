@@ -0,0 +1,114 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstddef>
+#include <type_traits>
+#include "Numa.h"
+
+// Work-stealing thread pool for the CPU backend. ParallelFor cuts a range into chunks and deals
+// them round-robin onto one queue per thread; each thread pops its own queue from the back and,
+// once that is empty, steals from the front of the others, so uneven chunks (dense cells next
+// to empty ones) even out. The calling thread works as thread 0, so a pool of n threads starts
+// n - 1 workers. Jobs do not allocate once the queues have grown to the largest chunk count.
+//
+// PinToNodes splits the threads into groups, one per NUMA node, pinned to that node's CPUs.
+// ParallelForSlabs then deals slab k of a range only onto node k's threads. They steal within
+// their node first and from other nodes only when it has run dry; the items that moved across
+// nodes this way are counted.
+class ThreadPool {
+public:
+    // 0 threads: one per hardware thread
+    explicit ThreadPool(unsigned int threads);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    unsigned int GetThreadCount() const { return static_cast<unsigned int>(queues.size()); }
+
+    // Calls body(begin, end, thread) on chunks of at most grain items covering [0, count), with
+    // thread in [0, GetThreadCount()) unique among concurrent calls. Returns once all are done.
+    template <typename Body>
+    void ParallelFor(size_t count, size_t grain, Body&& body) {
+        Run(&count, 1, grain, [](void* context, size_t begin, size_t end, unsigned int thread) {
+            (*static_cast<std::remove_reference_t<Body>*>(context))(begin, end, thread);
+        }, &body);
+    }
+
+    // As ParallelFor over [0, slabEnds.back()), slab k being [slabEnds[k - 1], slabEnds[k]) and
+    // running on node k's threads (all threads when node k has none)
+    template <typename Body>
+    void ParallelForSlabs(const std::vector<size_t>& slabEnds, size_t grain, Body&& body) {
+        ParallelForSlabs(slabEnds.data(), slabEnds.size(), grain, body);
+    }
+    template <typename Body>
+    void ParallelForSlabs(const size_t* slabEnds, size_t slabCount, size_t grain, Body&& body) {
+        Run(slabEnds, slabCount, grain, [](void* context, size_t begin, size_t end, unsigned int thread) {
+            (*static_cast<std::remove_reference_t<Body>*>(context))(begin, end, thread);
+        }, &body);
+    }
+
+    // Thread t to node t * nodes / threads, the caller (thread 0) included, each pinned to its
+    // node's CPUs. Call before the first job. Returns false if the OS refused any pinning (the
+    // grouping still applies).
+    bool PinToNodes(const std::vector<NumaNode>& nodes);
+    unsigned int GetNodeCount() const { return static_cast<unsigned int>(nodeThreads.size()); }
+    unsigned int GetThreadNode(unsigned int thread) const { return threadNodes[thread]; }
+
+    // Items ParallelForSlabs has run with more than one slab, and those run off their slab's node
+    void GetSlabCounters(size_t& items, size_t& remoteItems) const {
+        items = slabItems;
+        remoteItems = this->remoteItems.load(std::memory_order_relaxed);
+    }
+
+    // A grain that gives every thread several chunks to balance with
+    size_t DefaultGrain(size_t count) const {
+        size_t chunks = 8 * static_cast<size_t>(GetThreadCount());
+        return count / chunks + 1;
+    }
+
+private:
+    using Invoke = void (*)(void* context, size_t begin, size_t end, unsigned int thread);
+
+    static constexpr unsigned int ANY_NODE = ~0u;
+
+    struct Chunk {
+        size_t begin;
+        size_t end;
+        unsigned int node;  // the slab's node, or ANY_NODE outside ParallelForSlabs
+    };
+
+    // The owner takes from the back, thieves from head; both under the mutex
+    struct Queue {
+        std::mutex mutex;
+        std::vector<Chunk> chunks;
+        size_t head = 0;
+    };
+
+    void Run(const size_t* slabEnds, size_t slabCount, size_t grain, Invoke invoke, void* context);
+    void WorkerLoop(unsigned int thread);
+    // Runs chunks until every queue is empty
+    void RunChunks(unsigned int thread);
+    bool PopOrSteal(unsigned int thread, Chunk& chunk);
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+    std::vector<unsigned int> threadNodes;               // per thread
+    std::vector<std::vector<unsigned int>> nodeThreads;  // per node, in thread order
+    size_t slabItems;
+    std::atomic<size_t> remoteItems;
+
+    // The current job; published to the workers through the queue mutexes
+    Invoke jobInvoke;
+    void* jobContext;
+    std::atomic<size_t> remainingChunks;
+
+    std::mutex mutex;
+    std::condition_variable wake;  // a new job or shutdown
+    std::condition_variable done;  // the last chunk of a job finished
+    unsigned long long generation;
+    bool stopping;
+};
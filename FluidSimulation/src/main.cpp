@@ -6,7 +6,14 @@
 #include "backends/imgui_impl_opengl3.h"
 #include "Simulation.h"
 #include "Renderer.h"
+#include "Benchmark.h"
+#include "CpuSolver.h"
+#include "AllocationCounter.h"
 #include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <string>
 
 // Globals for callbacks
 int g_ViewportX = 0;
@@ -23,13 +30,91 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height)
     glViewport(0, 0, width, height);
 }
 
-int main()
+int main(int argc, char** argv)
 {
+    // --- Command Line ---
+    // --benchmark [particles]: run the offline benchmarks in a hidden window and exit
+    // --cpu-benchmark [particles]: benchmark the CPU backend without opening a window and exit
+    // --cpu [threads]: step on the CPU backend instead of the compute shaders
+    // --numa [nodes]: NUMA slabs of the CPU backend (0: one per OS node, 1: off)
+    // --huge-pages: back the CPU backend's arrays with transparent huge pages
+    // --deterministic: CPU backend results independent of the thread count
+    // --precision single|mixed|double: scalar types of the CPU backend (see CpuSolver.h)
+    // --out-of-core [particles] [directory]: run the out-of-core solver with its tile files in
+    //   directory (see OutOfCoreSolver.h), without opening a window, and exit; --cpu sets its threads
+    // --tile-particles [particles]: particles per tile of the out-of-core solver
+    bool runBenchmark = false;
+    bool runCpuBenchmark = false;
+    unsigned int benchmarkParticles = 4000;
+    Backend backend = Backend::GPU;
+    unsigned int cpuThreads = 0;
+    unsigned int cpuNumaNodes = 0;
+    bool cpuHugePages = false;
+    bool cpuDeterministic = false;
+    CpuPrecision cpuPrecision = CpuPrecision::Single;
+    bool runOutOfCore = false;
+    unsigned int outOfCoreParticles = 100000000;
+    std::string outOfCoreDirectory = ".";
+    unsigned int tileParticles = 1u << 20;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--benchmark") == 0) {
+            runBenchmark = true;
+            if (i + 1 < argc && argv[i + 1][0] != '-') benchmarkParticles = (unsigned int)std::atoi(argv[++i]);
+        }
+        else if (std::strcmp(argv[i], "--cpu-benchmark") == 0) {
+            runCpuBenchmark = true;
+            if (i + 1 < argc && argv[i + 1][0] != '-') benchmarkParticles = (unsigned int)std::atoi(argv[++i]);
+        }
+        else if (std::strcmp(argv[i], "--cpu") == 0) {
+            backend = Backend::CPU;
+            if (i + 1 < argc && argv[i + 1][0] != '-') cpuThreads = (unsigned int)std::atoi(argv[++i]);
+        }
+        else if (std::strcmp(argv[i], "--numa") == 0) {
+            if (i + 1 < argc && argv[i + 1][0] != '-') cpuNumaNodes = (unsigned int)std::atoi(argv[++i]);
+        }
+        else if (std::strcmp(argv[i], "--huge-pages") == 0) {
+            cpuHugePages = true;
+        }
+        else if (std::strcmp(argv[i], "--deterministic") == 0) {
+            cpuDeterministic = true;
+        }
+        else if (std::strcmp(argv[i], "--precision") == 0 && i + 1 < argc) {
+            ++i;
+            if (std::strcmp(argv[i], "mixed") == 0) cpuPrecision = CpuPrecision::Mixed;
+            else if (std::strcmp(argv[i], "double") == 0) cpuPrecision = CpuPrecision::Double;
+            else cpuPrecision = CpuPrecision::Single;
+        }
+        else if (std::strcmp(argv[i], "--out-of-core") == 0) {
+            runOutOfCore = true;
+            if (i + 1 < argc && argv[i + 1][0] != '-') outOfCoreParticles = (unsigned int)std::atoi(argv[++i]);
+            if (i + 1 < argc && argv[i + 1][0] != '-') outOfCoreDirectory = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--tile-particles") == 0) {
+            if (i + 1 < argc && argv[i + 1][0] != '-') tileParticles = (unsigned int)std::atoi(argv[++i]);
+        }
+    }
+
+    if (runOutOfCore) {
+        Benchmark::OutOfCore(outOfCoreParticles, outOfCoreDirectory, tileParticles, cpuThreads);
+        return 0;
+    }
+
+    if (runCpuBenchmark) {
+        Benchmark::CpuInstructionSets(benchmarkParticles);
+        Benchmark::CpuPairTraversal(benchmarkParticles);
+        Benchmark::CpuBackend(benchmarkParticles);
+        Benchmark::CpuNumaSlabs(benchmarkParticles);
+        Benchmark::CpuDeterminism(benchmarkParticles);
+        Benchmark::CpuPrecisions(benchmarkParticles);
+        return 0;
+    }
+
     // --- Window Init ---
     if (!glfwInit()) return -1;
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    if (runBenchmark) glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
 
     GLFWwindow* window = glfwCreateWindow(1920, 1080, "Fluid Simulation", NULL, NULL);
     if (!window) {
@@ -46,6 +131,18 @@ int main()
         return -1;
     }
 
+    if (runBenchmark) {
+        Simulation sim;
+        sim.Init(benchmarkParticles, benchmarkParticles);
+        Benchmark::StableTimestep(sim);
+        Benchmark::MultiRateForces(sim);
+        Benchmark::KernelTable(sim);
+        Benchmark::DoubleSums(sim);
+        Benchmark::KernelFamilies(sim);
+        glfwTerminate();
+        return 0;
+    }
+
     // --- ImGui Init ---
     IMGUI_CHECKVERSION();
     ImGui::CreateContext();
@@ -59,7 +156,13 @@ int main()
     Simulation sim;
     Renderer renderer;
 
-    sim.Init(50000, 50000); // Max 50000, Initial 50000
+    sim.cpuThreads = cpuThreads;
+    sim.cpuNumaNodes = cpuNumaNodes;
+    sim.cpuHugePages = cpuHugePages;
+    sim.cpuDeterministic = cpuDeterministic;
+    sim.cpuPrecision = cpuPrecision;
+    sim.Init(50000, 50000, backend); // Max 50000, Initial 50000
+    bool gpuBackend = sim.GetBackend() == Backend::GPU;
     renderer.Init();
 
     glEnable(GL_BLEND);
@@ -73,9 +176,18 @@ int main()
 
     float lastFrame = 0.0f;
 
+    // Heap allocation check: a frame is steady once no widget has been active and the window has
+    // kept its size for STEADY_FRAMES frames, so edits that rebuild shaders or resize buffers
+    // have settled
+    const int STEADY_FRAMES = 60;
+    int quietFrames = 0;
+    int lastViewportWidth = g_ViewportWidth, lastViewportHeight = g_ViewportHeight;
+    unsigned long long frameAllocations = 0;
+
     // --- Main Loop ---
     while (!glfwWindowShouldClose(window))
     {
+        AllocationCounter::BeginFrame();
         glfwPollEvents();
 
         float currentFrame = (float)glfwGetTime();
@@ -114,21 +226,200 @@ int main()
         glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
         // --- Render ---
         float displayAspect = (float)g_ViewportWidth / (float)g_ViewportHeight;
-        renderer.Render(sim.GetParticleCount(), sim.GetPositionSSBO(), sim.GetVelocitySSBO(), sim.GetDensitySSBO(), sim.GetPressureSSBO(), simBoundaryLimit, displayAspect);
+        renderer.Render(sim.GetParticleCount(), sim.GetParticles(), sim.GetReadCopy(), simBoundaryLimit, displayAspect);
 
         // --- UI ---
         ImGui::Begin("Controls");
         ImGui::SliderFloat("Gravity", &sim.gravityStrength, 0.0f, 10.0f);
         ImGui::SliderFloat("Rest Density", &sim.restDensity, 0.0f, 10.0f);
         ImGui::SliderFloat("Gas Constant", &sim.gasConstant, 0.0f, 10.0f);
-        ImGui::SliderFloat("Boundary Stiffness", &sim.boundaryStiffness, 500.0f, 10000.0f);
-        ImGui::SliderFloat("Boundary Damping", &sim.boundaryDamping, 0.1f, 1.0f);
+        const char* boundaryModes[] = { "Penalty Springs", "Projection" };
+        int boundaryMode = static_cast<int>(sim.boundaryMode);
+        if (ImGui::Combo("Walls", &boundaryMode, boundaryModes, IM_ARRAYSIZE(boundaryModes))) {
+            sim.boundaryMode = static_cast<BoundaryMode>(boundaryMode);
+        }
+        if (sim.boundaryMode == BoundaryMode::Penalty) {
+            ImGui::SliderFloat("Boundary Stiffness", &sim.boundaryStiffness, 500.0f, 10000.0f);
+            ImGui::SliderFloat("Boundary Damping", &sim.boundaryDamping, 0.1f, 1.0f);
+        }
+        else {
+            ImGui::SliderFloat("Boundary Restitution", &sim.boundaryRestitution, 0.0f, 1.0f);
+        }
         ImGui::SliderFloat("Viscosity", &sim.viscosity, 0.0f, 2.0f);
-        ImGui::SliderFloat("Viscosity Const", &sim.viscosityConstant, 0.0f, 2.0f);
+        if (sim.UsesImplicitViscosity()) {
+            // No longer bounded by the timestep, so thick fluids are in reach
+            ImGui::SliderFloat("Viscosity Const", &sim.viscosityConstant, 0.0f, 100.0f, "%.3f", ImGuiSliderFlags_Logarithmic);
+        }
+        else {
+            ImGui::SliderFloat("Viscosity Const", &sim.viscosityConstant, 0.0f, 2.0f);
+        }
         ImGui::SliderFloat("Pressure Multiplier", &sim.pressureMultiplier, 0.0f, 0.01f);
         ImGui::SliderFloat("Surface Tension", &sim.surfaceTension, 0.0f, 1000.0f);
 
+        // The CPU backend runs plain SPH only, so the other solvers and the GPU passes are hidden
+        const char* solvers[] = { "SPH (weakly compressible)", "Position Based Fluids", "DFSPH (divergence-free)" };
+        int solver = static_cast<int>(sim.solver);
+        if (gpuBackend && ImGui::Combo("Solver", &solver, solvers, IM_ARRAYSIZE(solvers))) {
+            sim.solver = static_cast<Solver>(solver);
+        }
+        if (sim.solver == Solver::PBF) {
+            ImGui::SliderInt("PBF Iterations", &sim.pbfIterations, 1, 16);
+            ImGui::SliderFloat("PBF Relaxation", &sim.pbfRelaxation, 0.1f, 100.0f, "%.2f", ImGuiSliderFlags_Logarithmic);
+            ImGui::SliderFloat("PBF Tensile K", &sim.pbfTensileK, 0.0f, 0.01f, "%.4f");
+        }
+        if (sim.solver == Solver::DFSPH) {
+            ImGui::SliderFloat("Density Tolerance", &sim.dfsphDensityTolerance, 0.0001f, 0.05f, "%.4f", ImGuiSliderFlags_Logarithmic);
+            ImGui::SliderFloat("Divergence Tolerance", &sim.dfsphDivergenceTolerance, 0.001f, 0.2f, "%.3f", ImGuiSliderFlags_Logarithmic);
+            ImGui::SliderInt("Max Density Iterations", &sim.dfsphMaxDensityIterations, 2, 100);
+            ImGui::SliderInt("Max Divergence Iterations", &sim.dfsphMaxDivergenceIterations, 1, 100);
+        }
+        if (sim.solver != Solver::SPH) {
+            ImGui::SliderFloat("XSPH Viscosity", &sim.xsphViscosity, 0.0f, 0.5f);
+        }
+        else if (!gpuBackend) {
+            const char* kernelFamilies[] = { "Poly6 / Spiky", "Cubic Spline", "Wendland C2", "Wendland C4" };
+            int kernelFamily = static_cast<int>(sim.kernelFamily);
+            if (ImGui::Combo("Kernel Family", &kernelFamily, kernelFamilies, IM_ARRAYSIZE(kernelFamilies))) {
+                sim.kernelFamily = static_cast<KernelFamily>(kernelFamily);
+            }
+            const char* cpuIsas[] = { "Auto", "Scalar", "AVX2", "AVX-512" };
+            int cpuIsa = static_cast<int>(sim.cpuIsa);
+            if (ImGui::Combo("CPU Kernels", &cpuIsa, cpuIsas, IM_ARRAYSIZE(cpuIsas))) {
+                sim.cpuIsa = static_cast<CpuIsa>(cpuIsa);
+            }
+            if (sim.cpuIsa != CpuIsa::Auto && !CpuKernels::IsSupported(sim.cpuIsa)) {
+                ImGui::SameLine();
+                ImGui::TextDisabled("(not supported, using %s)", CpuKernels::Name(CpuKernels::Detect()));
+            }
+            ImGui::Checkbox("Half-Shell Pairs", &sim.cpuHalfShell);
+            ImGui::Checkbox("Deterministic", &sim.cpuDeterministic);
+        }
+        else {
+            ImGui::Checkbox("Fused Step", &sim.fusedStep);
+            if (sim.fusedStep && !sim.UsesFusedStep()) {
+                ImGui::SameLine();
+                ImGui::TextDisabled("(off with LTS, sleeping or adaptive resolution)");
+            }
+            ImGui::SliderInt("Slow Force Interval", &sim.slowForceInterval, 1, 16);
+            const char* kernelFamilies[] = { "Poly6 / Spiky", "Cubic Spline", "Wendland C2", "Wendland C4" };
+            int kernelFamily = static_cast<int>(sim.kernelFamily);
+            if (ImGui::Combo("Kernel Family", &kernelFamily, kernelFamilies, IM_ARRAYSIZE(kernelFamilies))) {
+                sim.kernelFamily = static_cast<KernelFamily>(kernelFamily);
+            }
+            ImGui::Checkbox("Kernel Lookup Table", &sim.kernelLookupTable);
+            ImGui::Checkbox("Double Sums", &sim.doubleSums);
+            ImGui::Checkbox("Implicit Viscosity", &sim.implicitViscosity);
+            if (sim.implicitViscosity && !sim.UsesImplicitViscosity()) {
+                ImGui::SameLine();
+                ImGui::TextDisabled("(off with LTS)");
+            }
+            if (sim.UsesImplicitViscosity()) {
+                ImGui::SliderFloat("Viscosity Tolerance", &sim.viscosityTolerance, 0.00001f, 0.1f, "%.5f", ImGuiSliderFlags_Logarithmic);
+                ImGui::SliderInt("Max Viscosity Iterations", &sim.viscosityMaxIterations, 1, 100);
+            }
+            ImGui::Checkbox("Local Time Stepping", &sim.localTimeStepping);
+            if (sim.localTimeStepping) {
+                ImGui::SliderInt("Time Bin Levels", &sim.timeBinLevels, 0, Simulation::MAX_TIME_BIN_LEVEL);
+            }
+            else {
+                ImGui::Checkbox("Sleeping", &sim.enableSleeping);
+            }
+            if (sim.enableSleeping && !sim.localTimeStepping) {
+                ImGui::SliderFloat("Sleep Speed", &sim.sleepSpeedThreshold, 0.001f, 0.5f, "%.3f", ImGuiSliderFlags_Logarithmic);
+                ImGui::SliderFloat("Sleep Accel", &sim.sleepAccelThreshold, 0.01f, 10.0f, "%.2f", ImGuiSliderFlags_Logarithmic);
+                ImGui::SliderInt("Sleep Steps", &sim.sleepSteps, 1, 200);
+            }
+            ImGui::Checkbox("Adaptive Resolution", &sim.adaptiveResolution);
+            if (sim.adaptiveResolution) {
+                ImGui::SliderInt("Max Merge Level", &sim.maxResolutionLevel, 1, Simulation::MAX_RESOLUTION_LEVEL);
+                ImGui::SliderFloat("Split Offset", &sim.splitSurfaceOffset, 0.01f, 1.0f, "%.3f", ImGuiSliderFlags_Logarithmic);
+                ImGui::SliderFloat("Merge Offset", &sim.mergeSurfaceOffset, 0.005f, 0.5f, "%.3f", ImGuiSliderFlags_Logarithmic);
+            }
+        }
+
+        const char* integrators[] = { "Semi-implicit Euler", "Leapfrog (KDK)" };
+        int integrator = static_cast<int>(sim.integrator);
+        if (ImGui::Combo("Integrator", &integrator, integrators, IM_ARRAYSIZE(integrators))) {
+            sim.integrator = static_cast<Integrator>(integrator);
+        }
+        ImGui::SliderFloat("Damping", &sim.globalDamping, 0.0f, 2.0f);
+
+        ImGui::SliderInt("Max Substeps/Frame", &sim.maxSubstepsPerFrame, 1, 32);
+        if (sim.UsesLocalTimeStepping()) {
+            // The base step is fixed; the CFL number and force factor pick each particle's bin
+            ImGui::SliderFloat("Base Timestep", &sim.fixedTimestep, 0.0005f, 0.02f, "%.4f");
+            ImGui::SliderFloat("CFL Number", &sim.cflNumber, 0.05f, 1.0f);
+            ImGui::SliderFloat("Force Factor", &sim.forceFactor, 0.05f, 1.0f);
+        }
+        else {
+            ImGui::Checkbox("Adaptive Timestep", &sim.adaptiveTimestep);
+            if (!sim.adaptiveTimestep) {
+                ImGui::SliderFloat("Fixed Timestep", &sim.fixedTimestep, 0.0005f, 0.02f, "%.4f");
+            }
+            else {
+                ImGui::SliderFloat("CFL Number", &sim.cflNumber, 0.05f, 1.0f);
+                ImGui::SliderFloat("Force Factor", &sim.forceFactor, 0.05f, 1.0f);
+                ImGui::SliderFloat("Max Timestep", &sim.maxTimestep, 0.001f, 0.05f, "%.4f");
+            }
+        }
+
         ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
+        if (AllocationCounter::IsEnabled()) {
+            ImGui::Text("Heap allocations %llu last frame%s", frameAllocations, quietFrames > STEADY_FRAMES ? " (steady)" : "");
+        }
+
+        ImGui::Text("Simulation %.0f steps/s (%d substeps this frame)", sim.GetStepsPerSecond(), sim.GetLastSubstepCount());
+
+        const StepStats& stats = sim.GetStepStats();
+        ImGui::Text("dt %.5f s | max |v| %.3f | max |a| %.1f | NaN resets %u", sim.GetTimestep(), stats.maxSpeed, stats.maxAccel, stats.nanResets);
+        if (!gpuBackend) {
+            CpuStats cpuStats = sim.GetCpuStats();
+            ImGui::Text("CPU %u threads, %s %s, %s%s | %.2f ms/step | %.0f steps/s per core | scratch %.1f KB", cpuStats.threads,
+                CpuKernels::Name(cpuStats.isa), CpuKernels::Name(cpuStats.precision), cpuStats.halfShell ? "half shell" : "gather",
+                cpuStats.deterministic ? ", deterministic" : "",
+                cpuStats.lastStepMilliseconds, cpuStats.stepsPerSecondPerCore, cpuStats.scratchBytes / 1024.0);
+            if (cpuStats.numaNodes > 1) {
+                ImGui::Text("NUMA %u slabs%s | remote reads %.1f%% | pages off node %.1f%%%s", cpuStats.numaNodes,
+                    cpuStats.pinned ? ", pinned" : "", 100.0 * cpuStats.remoteAccessRatio,
+                    100.0 * std::max(cpuStats.misplacedPages, 0.0), cpuStats.hugePages ? " | huge pages" : "");
+            }
+        }
+        if (sim.solver == Solver::DFSPH) {
+            const SolverStats& solverStats = sim.GetSolverStats();
+            ImGui::Text("DFSPH density %u it (%.3f%%) | divergence %u it (%.3f%%)",
+                solverStats.densityIterations, 100.0f * solverStats.densityError,
+                solverStats.divergenceIterations, 100.0f * solverStats.divergenceError);
+        }
+        if (sim.UsesImplicitViscosity()) {
+            const ViscositySolverStats& viscosityStats = sim.GetViscositySolverStats();
+            ImGui::Text("Viscosity CG %u it (residual %.1e)", viscosityStats.iterations, viscosityStats.residual);
+        }
+        if (sim.solver == Solver::SPH && sim.enableSleeping && !sim.localTimeStepping) {
+            const SleepStats& sleepStats = sim.GetSleepStats();
+            float count = static_cast<float>(std::max(1u, sim.GetParticleCount()));
+            ImGui::Text("Asleep %.1f%% | simulated %.1f%% (awake + neighbours)",
+                100.0f * sleepStats.sleepingParticles / count, 100.0f * sleepStats.activeParticles / count);
+        }
+        if (sim.UsesLocalTimeStepping()) {
+            // Updates per base step against global stepping at the finest occupied bin
+            const TimeBinStats& binStats = sim.GetTimeBinStats();
+            int finestBin = 0;
+            char bins[16 * (Simulation::MAX_TIME_BIN_LEVEL + 1)];  // formatted in place, without heap strings
+            int length = 0;
+            for (int b = 0; b <= std::clamp(sim.timeBinLevels, 0, Simulation::MAX_TIME_BIN_LEVEL); ++b) {
+                if (binStats.particlesPerBin[b] > 0) finestBin = b;
+                length += std::snprintf(bins + length, sizeof(bins) - length, "%s%u", b > 0 ? " / " : "", binStats.particlesPerBin[b]);
+            }
+            float globalKicks = static_cast<float>(std::max(1u, sim.GetParticleCount())) * static_cast<float>(1 << finestBin);
+            ImGui::Text("Bins dt/2^b: %s", bins);
+            ImGui::Text("Updates %u per step (%.0f%% of global stepping)", binStats.kicks, 100.0f * binStats.kicks / globalKicks);
+        }
+        if (sim.solver == Solver::SPH && sim.adaptiveResolution) {
+            const ResolutionStats& resolutionStats = sim.GetResolutionStats();
+            ImGui::Text("Live particles %d | splits %u | merges %u (last step)",
+                static_cast<int>(sim.GetParticleCount()) - resolutionStats.freeSlots,
+                resolutionStats.splits, resolutionStats.merges);
+        }
 
         static int particleSliderCount = sim.GetParticleCount();
         ImGui::SliderInt("Particle Count", &particleSliderCount, 1, sim.GetMaxParticles(), "%d", ImGuiSliderFlags_Logarithmic);
@@ -137,11 +428,25 @@ int main()
             sim.UpdateParticleCount(particleSliderCount);
         }
 
+        static int scene = 0;
+        const char* scenes[] = { "Block", "Dam Break", "Drop" };
+        ImGui::Combo("Scene", &scene, scenes, IM_ARRAYSIZE(scenes));
+        ImGui::SameLine();
+        if (ImGui::Button("Reset")) {
+            sim.ResetScene(static_cast<Scene>(scene));
+        }
+
         ImGui::End();
         ImGui::Render();
         ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
 
         glfwSwapBuffers(window);
+
+        bool resized = g_ViewportWidth != lastViewportWidth || g_ViewportHeight != lastViewportHeight;
+        lastViewportWidth = g_ViewportWidth;
+        lastViewportHeight = g_ViewportHeight;
+        quietFrames = ImGui::IsAnyItemActive() || resized ? 0 : quietFrames + 1;
+        frameAllocations = AllocationCounter::EndFrame(quietFrames > STEADY_FRAMES);
     }
 
     ImGui_ImplOpenGL3_Shutdown();